@@ -0,0 +1,213 @@
+//==================================================
+// Copyright (C) 2011 by Norwegian Radiation Protection Authority
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// Authors: Dag Robøle,
+//
+//==================================================
+// HEADER INCLUDES
+
+#include <cstring>
+#include <vector>
+#include <new>
+#include <process.h>
+#include <Windows.h>
+#include "header.h"
+#include "spectrum.h"
+#include "dat2inp.h"
+
+//==================================================
+// THE FIELD TABLE, GENERATED FROM THE SAME LIST AS THE OUTPUT FORMATS
+
+#define API_FIELD(name, type, label) { #name, DAT2INP_##type, offsetof(IO_Header, name), sizeof(((IO_Header*)0)->name) },
+
+static const dat2inp_field g_api_fields[] =
+{
+    IO_HEADER_FIELDS(API_FIELD)
+};
+
+#undef API_FIELD
+
+int dat2inp_api_version(void)
+{
+    return DAT2INP_API_VERSION;
+}
+
+size_t dat2inp_header_size(void)
+{
+    return sizeof(IO_Header);
+}
+
+const dat2inp_field* dat2inp_header_fields(size_t* count)
+{
+    if(count)
+        *count = sizeof(g_api_fields) / sizeof(g_api_fields[0]);
+    return g_api_fields;
+}
+
+//==================================================
+
+int dat2inp_decode_header(const char* data, size_t size, IO_Header* header)
+{
+    memset((void*)header, 0, sizeof(IO_Header));
+    return decode_header(data, size, *header) ? DAT2INP_OK : DAT2INP_TOO_SHORT;
+}
+
+int dat2inp_decode_spectrum(const char* data, size_t size, const IO_Header* header, unsigned int* counts, size_t max_channels)
+{
+    const char* channels = size == (unsigned int)size ? locate_spectrum(data, (unsigned int)size, *header) : 0;
+    size_t n = channels ? (size_t)header->channel_count : 0;
+    if(n > max_channels)
+        n = max_channels;
+
+    if(n)
+        memcpy(counts, channels, n * sizeof(unsigned int));
+    memset(counts + n, 0, (max_channels - n) * sizeof(unsigned int));
+    return channels ? DAT2INP_OK : DAT2INP_NO_SPECTRUM;
+}
+
+//==================================================
+// BATCH DECODING. THE THREADS TAKE THE NEXT SOURCE FROM A SHARED COUNTER,
+// EACH WRITES ONLY TO THE ROWS OF THE SOURCES IT TOOK, SO NO LOCKING IS NEEDED
+
+struct ApiBatch
+{
+    const dat2inp_source* sources;
+    size_t count;
+    IO_Header* headers;
+    unsigned int* counts;
+    size_t max_channels;
+    int* status;
+    volatile LONG next;
+    volatile LONG decoded;
+};
+
+static int read_source(const char* path, std::vector<char>& buffer, size_t& size)
+{
+    HANDLE hFile = CreateFile(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if(hFile == INVALID_HANDLE_VALUE)
+        return DAT2INP_OPEN_FAILED;
+
+    DWORD length = GetFileSize(hFile, NULL);
+    if(length == INVALID_FILE_SIZE)
+    {
+        CloseHandle(hFile);
+        return DAT2INP_READ_FAILED;
+    }
+    if(buffer.size() < (size_t)length + 1)
+        buffer.resize((size_t)length + 1);
+
+    DWORD total = 0, got = 0;
+    while(total < length && ReadFile(hFile, &buffer[total], length - total, &got, NULL) && got)
+        total += got;
+    CloseHandle(hFile);
+
+    size = total;
+    return total < length ? DAT2INP_READ_FAILED : DAT2INP_OK;
+}
+
+static void decode_sources(ApiBatch& batch)
+{
+    std::vector<char> buffer;
+    for(;;)
+    {
+        size_t i = (size_t)(InterlockedIncrement(&batch.next) - 1);
+        if(i >= batch.count)
+            return;
+
+        const dat2inp_source& source = batch.sources[i];
+        IO_Header& header = batch.headers[i];
+        unsigned int* counts = batch.counts ? batch.counts + i * batch.max_channels : 0;
+
+        const char* data = source.data;
+        size_t size = source.size;
+        int status = DAT2INP_OK;
+        if(!data)
+        {
+            status = read_source(source.path, buffer, size);
+            data = buffer.empty() ? "" : &buffer[0];
+        }
+
+        if(status == DAT2INP_OK)
+            status = dat2inp_decode_header(data, size, &header);
+        else memset((void*)&header, 0, sizeof(header));
+
+        if(counts)
+        {
+            int spectrum = dat2inp_decode_spectrum(data, status == DAT2INP_OK ? size : 0, &header, counts, batch.max_channels);
+            if(status == DAT2INP_OK)
+                status = spectrum;
+        }
+
+        batch.status[i] = status;
+        if(status == DAT2INP_OK)
+            InterlockedIncrement(&batch.decoded);
+    }
+}
+
+static unsigned __stdcall decode_thread(void* arg)
+{
+    decode_sources(*(ApiBatch*)arg);
+    return 0;
+}
+
+size_t dat2inp_decode_batch(const dat2inp_source* sources, size_t count, IO_Header* headers,
+                            unsigned int* counts, size_t max_channels, int* status, unsigned int threads)
+{
+    ApiBatch batch;
+    batch.sources = sources;
+    batch.count = count;
+    batch.headers = headers;
+    batch.counts = max_channels ? counts : 0;
+    batch.max_channels = max_channels;
+    batch.status = status;
+    batch.next = 0;
+    batch.decoded = 0;
+
+    if(!threads)
+    {
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        threads = info.dwNumberOfProcessors;
+    }
+    if(threads > count)
+        threads = (unsigned int)count;
+
+    // THE CALLING THREAD DECODES TOO, A THREAD THAT FAILS TO START IS NOT MISSED
+
+    std::vector<HANDLE> started;
+    for(unsigned int t = 1; t < threads; t++)
+    {
+        HANDLE thread = (HANDLE)_beginthreadex(NULL, 0, decode_thread, &batch, 0, NULL);
+        if(thread)
+            started.push_back(thread);
+    }
+
+    decode_sources(batch);
+
+    for(size_t t = 0; t < started.size(); t++)
+    {
+        WaitForSingleObject(started[t], INFINITE);
+        CloseHandle(started[t]);
+    }
+    return (size_t)batch.decoded;
+}
+
+//==================================================
@@ -0,0 +1,187 @@
+//==================================================
+// Copyright (C) 2011 by Norwegian Radiation Protection Authority
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// Authors: Dag Robøle,
+//
+//==================================================
+
+#ifndef BUFFERS_H
+#define BUFFERS_H
+
+//==================================================
+
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+//==================================================
+// CONTIGUOUS POOL OF NULL TERMINATED STRINGS.
+// USED FOR THE FILE LIST AND THE ERROR MESSAGES SO THAT A RUN OVER A LARGE
+// DIRECTORY ONLY GROWS TWO BLOCKS OF MEMORY INSTEAD OF ALLOCATING PER FILE.
+// ENTRIES ARE ADDRESSED BY INDEX SINCE THE BLOCK MAY MOVE WHEN IT GROWS
+
+class NamePool
+{
+public:
+
+    struct Entry
+    {
+        unsigned int offset;
+        unsigned int length;
+        unsigned int size;
+    };
+
+    NamePool() : m_chars(0), m_used(0), m_capacity(0), m_entries(0), m_count(0), m_max_count(0) {}
+    ~NamePool() { free(m_chars); free(m_entries); }
+
+    bool add(const char* prefix, const char* str, unsigned int size = 0)
+    {
+        size_t plen = prefix ? strlen(prefix) : 0;
+        size_t slen = strlen(str);
+        if(!reserve_chars(plen + slen + 1) || !reserve_entries(1))
+            return false;
+
+        Entry& e = m_entries[m_count++];
+        e.offset = (unsigned int)m_used;
+        e.length = (unsigned int)(plen + slen);
+        e.size = size;
+
+        memcpy(m_chars + m_used, prefix, plen);
+        memcpy(m_chars + m_used + plen, str, slen + 1);
+        m_used += plen + slen + 1;
+        return true;
+    }
+
+    void remove_last()
+    {
+        m_used = m_entries[--m_count].offset;
+    }
+
+    unsigned int count() const { return (unsigned int)m_count; }
+    const char* str(unsigned int i) const { return m_chars + m_entries[i].offset; }
+    unsigned int length(unsigned int i) const { return m_entries[i].length; }
+    unsigned int size(unsigned int i) const { return m_entries[i].size; }
+
+private:
+
+    NamePool(const NamePool&);
+    NamePool& operator=(const NamePool&);
+
+    bool reserve_chars(size_t n)
+    {
+        if(m_used + n <= m_capacity)
+            return true;
+        size_t cap = m_capacity ? m_capacity : 64 * 1024;
+        while(cap < m_used + n)
+            cap *= 2;
+        char* p = (char*)realloc(m_chars, cap);
+        if(!p)
+            return false;
+        m_chars = p;
+        m_capacity = cap;
+        return true;
+    }
+
+    bool reserve_entries(size_t n)
+    {
+        if(m_count + n <= m_max_count)
+            return true;
+        size_t cap = m_max_count ? m_max_count * 2 : 4096;
+        Entry* p = (Entry*)realloc(m_entries, cap * sizeof(Entry));
+        if(!p)
+            return false;
+        m_entries = p;
+        m_max_count = cap;
+        return true;
+    }
+
+    char* m_chars;
+    size_t m_used, m_capacity;
+    Entry* m_entries;
+    size_t m_count, m_max_count;
+};
+
+//==================================================
+// GROWABLE CHARACTER BUFFER USED TO SERIALIZE ONE RECORD AT A TIME.
+// THE SAME BUFFER IS CLEARED AND REUSED FOR EVERY RECORD SO IT ONLY
+// ALLOCATES UNTIL IT HAS REACHED THE SIZE OF THE LARGEST RECORD
+
+class RecordBuffer
+{
+public:
+
+    RecordBuffer() : m_data(0), m_size(0), m_capacity(0) {}
+    ~RecordBuffer() { free(m_data); }
+
+    void clear() { m_size = 0; }
+    const char* data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+    void append(const char* str, size_t n)
+    {
+        if(m_size + n > m_capacity)
+            grow(m_size + n);
+        memcpy(m_data + m_size, str, n);
+        m_size += n;
+    }
+
+    void append(const char* str) { append(str, strlen(str)); }
+
+    void append(char c)
+    {
+        if(m_size == m_capacity)
+            grow(m_size + 1);
+        m_data[m_size++] = c;
+    }
+
+    void swap(RecordBuffer& other)
+    {
+        char* data = m_data; m_data = other.m_data; other.m_data = data;
+        size_t size = m_size; m_size = other.m_size; other.m_size = size;
+        size_t capacity = m_capacity; m_capacity = other.m_capacity; other.m_capacity = capacity;
+    }
+
+private:
+
+    RecordBuffer(const RecordBuffer&);
+    RecordBuffer& operator=(const RecordBuffer&);
+
+    void grow(size_t n)
+    {
+        size_t cap = m_capacity ? m_capacity : 4096;
+        while(cap < n)
+            cap *= 2;
+        char* p = (char*)realloc(m_data, cap);
+        if(!p)
+            throw std::bad_alloc();
+        m_data = p;
+        m_capacity = cap;
+    }
+
+    char* m_data;
+    size_t m_size, m_capacity;
+};
+
+//==================================================
+
+#endif // BUFFERS_H
+
+//==================================================
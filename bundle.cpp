@@ -0,0 +1,204 @@
+//==================================================
+// Copyright (C) 2011 by Norwegian Radiation Protection Authority
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// Authors: Dag Robøle,
+//
+//==================================================
+// HEADER INCLUDES
+
+#include <cstring>
+#include <cctype>
+#include <algorithm>
+#include "bundle.h"
+
+//==================================================
+// ORDERS INDEX ENTRIES BY THE NAME THEY POINT TO
+
+struct BundleNameLess
+{
+    const char* names;
+    explicit BundleNameLess(const char* n) : names(n) {}
+    bool operator()(const BundleEntry& a, const BundleEntry& b) const { return strcmp(names + a.name_offset, names + b.name_offset) < 0; }
+};
+
+//==================================================
+// FUNCTION TO UPPER CASE A DAT NAME INTO dest, THE NAMES ARE STORED AND
+// LOOKED UP THIS WAY SINCE WINDOWS FILE NAMES ARE CASE INSENSITIVE
+
+void bundle_name(const char* name, char* dest)
+{
+    size_t i = 0;
+    for(; name[i] && i < MAX_PATH; i++)
+        dest[i] = (char)toupper((unsigned char)name[i]);
+    dest[i] = 0;
+}
+
+//==================================================
+// BUNDLE WRITER
+
+bool BundleWriter::open(const char* filename)
+{
+    m_file = fopen(filename, "wb");
+    m_offset = 0;
+    m_failed = false;
+    m_names.clear();
+    m_index.clear();
+    return m_file != 0;
+}
+
+// A FAILED WRITE LEAVES THE OFFSETS OF LATER ENTRIES UNKNOWN, SO NOTHING
+// MORE IS ADDED AND THE BUNDLE IS CLOSED WITHOUT AN INDEX
+
+bool BundleWriter::add(const char* name, const char* data, unsigned int size, unsigned __int64 hash)
+{
+    if(m_failed || fwrite(data, 1, size, m_file) != size)
+    {
+        m_failed = true;
+        return false;
+    }
+
+    char upper[MAX_PATH + 1];
+    bundle_name(name, upper);
+
+    BundleEntry entry;
+    entry.offset = m_offset;
+    entry.hash = hash;
+    entry.length = size;
+    entry.name_offset = (unsigned int)m_names.size();
+    m_names.append(upper, strlen(upper) + 1);
+    m_index.push_back(entry);
+
+    m_offset += size;
+    return true;
+}
+
+bool BundleWriter::close()
+{
+    if(!m_file)
+        return false;
+
+    if(m_failed)
+    {
+        fclose(m_file);
+        m_file = 0;
+        return false;
+    }
+
+    std::sort(m_index.begin(), m_index.end(), BundleNameLess(m_names.data()));
+
+    // THE NAMES ARE PADDED SO THE INDEX STARTS 8 BYTE ALIGNED IN THE MAPPED FILE
+
+    while((m_offset + m_names.size()) % sizeof(unsigned __int64))
+        m_names.append("", 1);
+
+    BundleTrailer trailer;
+    trailer.names_offset = m_offset;
+    trailer.index_offset = m_offset + m_names.size();
+    trailer.count = (unsigned int)m_index.size();
+    trailer.version = BUNDLE_VERSION;
+    memcpy(trailer.magic, BUNDLE_MAGIC, sizeof(trailer.magic));
+
+    bool ok = fwrite(m_names.data(), 1, m_names.size(), m_file) == m_names.size();
+    if(ok && !m_index.empty())
+        ok = fwrite(&m_index[0], sizeof(BundleEntry), m_index.size(), m_file) == m_index.size();
+    ok = ok && fwrite(&trailer, sizeof(trailer), 1, m_file) == 1;
+    ok = fclose(m_file) == 0 && ok;
+    m_file = 0;
+    return ok;
+}
+
+//==================================================
+// BUNDLE READER. THE TRAILER IS CHECKED AGAINST THE FILE SIZE ON OPEN SO A
+// TRUNCATED OR FOREIGN FILE IS REJECTED BEFORE ANY ENTRY IS LOOKED AT
+
+bool BundleReader::open(const char* filename)
+{
+    m_file = CreateFile(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+    if(m_file == INVALID_HANDLE_VALUE)
+        return false;
+
+    DWORD high = 0;
+    DWORD low = GetFileSize(m_file, &high);
+    m_size = ((unsigned __int64)high << 32) | low;
+    if(m_size < sizeof(BundleTrailer))
+        return false;
+
+    m_map = CreateFileMapping(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if(!m_map)
+        return false;
+    m_view = (const char*)MapViewOfFile(m_map, FILE_MAP_READ, 0, 0, 0);
+    if(!m_view)
+        return false;
+
+    BundleTrailer trailer;
+    memcpy(&trailer, m_view + m_size - sizeof(trailer), sizeof(trailer));
+    unsigned __int64 index_end = m_size - sizeof(trailer);
+    if(memcmp(trailer.magic, BUNDLE_MAGIC, sizeof(trailer.magic)) || trailer.version != BUNDLE_VERSION
+        || trailer.index_offset > index_end || (index_end - trailer.index_offset) / sizeof(BundleEntry) != trailer.count
+        || trailer.names_offset > trailer.index_offset
+        || (trailer.names_offset < trailer.index_offset && m_view[trailer.index_offset - 1]))
+        return false;
+
+    m_names = m_view + trailer.names_offset;
+    m_index = (const BundleEntry*)(m_view + trailer.index_offset);
+    m_count = trailer.count;
+    return true;
+}
+
+const BundleEntry* BundleReader::find(const char* name) const
+{
+    char upper[MAX_PATH + 1];
+    bundle_name(name, upper);
+
+    unsigned __int64 names_size = (unsigned __int64)((const char*)m_index - m_names);
+    unsigned int first = 0, last = m_count;
+    while(first < last)
+    {
+        unsigned int middle = first + (last - first) / 2;
+        const BundleEntry& entry = m_index[middle];
+        if(entry.name_offset >= names_size)
+            return 0;
+
+        int order = strcmp(m_names + entry.name_offset, upper);
+        if(!order)
+            return entry.offset + entry.length <= (unsigned __int64)(m_names - m_view) ? &entry : 0;
+        if(order < 0)
+            first = middle + 1;
+        else last = middle;
+    }
+    return 0;
+}
+
+void BundleReader::close()
+{
+    if(m_view)
+        UnmapViewOfFile(m_view);
+    if(m_map)
+        CloseHandle(m_map);
+    if(m_file != INVALID_HANDLE_VALUE)
+        CloseHandle(m_file);
+    m_file = INVALID_HANDLE_VALUE;
+    m_map = 0;
+    m_view = 0;
+    m_names = 0;
+    m_index = 0;
+    m_count = 0;
+}
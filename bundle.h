@@ -0,0 +1,122 @@
+//==================================================
+// Copyright (C) 2011 by Norwegian Radiation Protection Authority
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// Authors: Dag Robøle,
+//
+//==================================================
+
+#ifndef BUNDLE_H
+#define BUNDLE_H
+
+//==================================================
+
+#include <cstdio>
+#include <vector>
+#include <Windows.h>
+#include "buffers.h"
+
+//==================================================
+// INP BUNDLE FILE LAYOUT.
+// ALL INP TEXTS ARE STORED BACK TO BACK FROM THE START OF THE FILE, FOLLOWED
+// BY THE DAT NAMES AS NULL TERMINATED UPPER CASE STRINGS, THE INDEX AND THE
+// TRAILER. THE INDEX IS SORTED BY NAME SO A READER CAN MAP THE FILE AND
+// BINARY SEARCH IT. ALL NUMBERS ARE LITTLE ENDIAN, THE HASH IS THE 64 BIT
+// FNV-1a OF THE INP TEXT. A BUNDLE WITHOUT A VALID TRAILER IS INCOMPLETE
+
+#define BUNDLE_MAGIC		"DAT2INPB"
+#define BUNDLE_VERSION		1
+
+struct BundleEntry
+{
+    unsigned __int64 offset;
+    unsigned __int64 hash;
+    unsigned int length;
+    unsigned int name_offset;		// FROM THE START OF THE NAMES
+};
+
+struct BundleTrailer
+{
+    unsigned __int64 names_offset;
+    unsigned __int64 index_offset;
+    unsigned int count;
+    unsigned int version;
+    char magic[8];
+};
+
+//==================================================
+// WRITES A BUNDLE ONE INP AT A TIME. THE TEXTS GO STRAIGHT TO THE FILE,
+// ONLY THE NAMES AND INDEX ENTRIES ARE KEPT UNTIL close WRITES THEM
+
+class BundleWriter
+{
+public:
+
+    BundleWriter() : m_file(0), m_offset(0), m_failed(false) {}
+    ~BundleWriter() { if(m_file) fclose(m_file); }
+
+    bool open(const char* filename);
+    bool add(const char* name, const char* data, unsigned int size, unsigned __int64 hash);
+    bool close();
+
+private:
+
+    BundleWriter(const BundleWriter&);
+    BundleWriter& operator=(const BundleWriter&);
+
+    FILE* m_file;
+    unsigned __int64 m_offset;
+    bool m_failed;
+    RecordBuffer m_names;
+    std::vector<BundleEntry> m_index;
+};
+
+//==================================================
+// READS SINGLE INP TEXTS FROM A MAPPED BUNDLE
+
+class BundleReader
+{
+public:
+
+    BundleReader() : m_file(INVALID_HANDLE_VALUE), m_map(0), m_view(0), m_size(0), m_names(0), m_index(0), m_count(0) {}
+    ~BundleReader() { close(); }
+
+    bool open(const char* filename);
+    const BundleEntry* find(const char* name) const;
+    const char* data(const BundleEntry& entry) const { return m_view + entry.offset; }
+    void close();
+
+private:
+
+    BundleReader(const BundleReader&);
+    BundleReader& operator=(const BundleReader&);
+
+    HANDLE m_file;
+    HANDLE m_map;
+    const char* m_view;
+    unsigned __int64 m_size;
+    const char* m_names;
+    const BundleEntry* m_index;
+    unsigned int m_count;
+};
+
+//==================================================
+
+#endif // BUNDLE_H
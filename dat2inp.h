@@ -0,0 +1,99 @@
+//==================================================
+// Copyright (C) 2011 by Norwegian Radiation Protection Authority
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// Authors: Dag Robøle,
+//
+//==================================================
+
+#ifndef DAT2INP_H
+#define DAT2INP_H
+
+//==================================================
+
+#include <stddef.h>
+#include "main.h"
+
+//==================================================
+// C INTERFACE TO THE DAT DECODER, FOR PROGRAMS AND LANGUAGE BINDINGS THAT
+// READ DAT FILES IN PROCESS. BUILD api.cpp, header.cpp AND spectrum.cpp INTO
+// THE CALLING MODULE, OR INTO A DLL WITH DAT2INP_API SET TO __declspec(dllexport).
+// THE HEADER IS DECODED INTO struct IO_Header FROM main.h AND THE SPECTRUM
+// INTO 32 BIT COUNTS
+
+#ifndef DAT2INP_API
+#define DAT2INP_API
+#endif
+
+#define DAT2INP_API_VERSION	1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum { DAT2INP_OK, DAT2INP_OPEN_FAILED, DAT2INP_READ_FAILED, DAT2INP_TOO_SHORT, DAT2INP_NO_SPECTRUM };
+
+enum { DAT2INP_STRING, DAT2INP_CHAR, DAT2INP_SHORT, DAT2INP_INT, DAT2INP_FLOAT };
+
+// ONE FIELD OF struct IO_Header, SO A BINDING CAN DESCRIBE THE STRUCT
+// WITHOUT COMPILING main.h. STRINGS ARE ZERO TERMINATED WITHIN size BYTES
+
+typedef struct dat2inp_field
+{
+    const char* name;
+    int type;
+    size_t offset;
+    size_t size;
+} dat2inp_field;
+
+// A DAT FILE TO DECODE, EITHER THE PATH OF THE FILE WHEN data IS 0, OR
+// size BYTES OF THE FILE ALREADY IN MEMORY
+
+typedef struct dat2inp_source
+{
+    const char* path;
+    const char* data;
+    size_t size;
+} dat2inp_source;
+
+DAT2INP_API int dat2inp_api_version(void);
+DAT2INP_API size_t dat2inp_header_size(void);
+DAT2INP_API const dat2inp_field* dat2inp_header_fields(size_t* count);
+
+DAT2INP_API int dat2inp_decode_header(const char* data, size_t size, struct IO_Header* header);
+DAT2INP_API int dat2inp_decode_spectrum(const char* data, size_t size, const struct IO_Header* header, unsigned int* counts, size_t max_channels);
+
+// DECODES count SOURCES ON threads THREADS, 0 FOR ONE PER PROCESSOR. HEADER i
+// GOES TO headers[i] AND ITS SPECTRUM TO ROW i OF THE count BY max_channels
+// MATRIX counts, PADDED WITH ZEROS. counts MAY BE 0. THE DAT2INP_ STATUS OF
+// EACH SOURCE GOES TO status[i]. RETURNS THE NUMBER OF SOURCES DECODED
+
+DAT2INP_API size_t dat2inp_decode_batch(const dat2inp_source* sources, size_t count, struct IO_Header* headers,
+                                        unsigned int* counts, size_t max_channels, int* status, unsigned int threads);
+
+#ifdef __cplusplus
+}
+#endif
+
+//==================================================
+
+#endif // DAT2INP_H
+
+//==================================================
@@ -0,0 +1,434 @@
+//==================================================
+// Copyright (C) 2011 by Norwegian Radiation Protection Authority
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// Authors: Dag Robøle,
+//
+//==================================================
+// HEADER INCLUDES
+
+#include <cstring>
+#include <cctype>
+#include "header.h"
+#include "spectrum.h"
+
+// THE VECTOR VARIANTS ARE COMPILED LIKE THE SPECTRUM KERNELS, WHEREVER THE
+// COMPILER ALLOWS IT, AND ONLY RUN WHEN THE CPU SUPPORTS THEM
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define HEADER_SSE2
+#include <emmintrin.h>
+#endif
+
+#if (defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))) || defined(__SSE4_2__)
+#define HEADER_SSE42
+#include <nmmintrin.h>
+#endif
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#endif
+
+//==================================================
+// TRIM KERNELS. EACH RETURNS THE LENGTH OF THE STRING AT field UP TO ITS
+// FIRST NULL CHARACTER, BUT AT MOST len, WITH THE TRAILING WHITE SPACE LEFT
+// OUT. WHITE SPACE IS WHAT isspace ACCEPTS IN THE C LOCALE. field HOLDS len
+// CHARACTERS FOLLOWED BY AT LEAST TRIM_PADDING READABLE BYTES, SO THE VECTOR
+// VARIANTS CAN LOAD WHOLE REGISTERS PAST THE END
+
+#define TRIM_PADDING	16
+
+static size_t trim_field_scalar(const char* field, size_t len)
+{
+    const char* end = (const char*)memchr(field, 0, len);
+    size_t n = end ? (size_t)(end - field) : len;
+    while(n > 0 && isspace((unsigned char)field[n - 1]))
+        --n;
+    return n;
+}
+
+#ifdef HEADER_SSE2
+
+// INDEX OF THE LOWEST AND THE HIGHEST SET BIT OF A NONZERO MASK
+
+static unsigned int lowest_bit(unsigned int mask)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (unsigned int)index;
+#else
+    return (unsigned int)__builtin_ctz(mask);
+#endif
+}
+
+static unsigned int highest_bit(unsigned int mask)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse(&index, mask);
+    return (unsigned int)index;
+#else
+    return 31 - (unsigned int)__builtin_clz(mask);
+#endif
+}
+
+//==================================================
+// SSE2 KERNEL. THE NULL CHARACTER IS FOUND SIXTEEN BYTES AT A TIME, THEN THE
+// WHITE SPACE IS MASKED SIXTEEN BYTES AT A TIME FROM THE END. A BYTE IS WHITE
+// SPACE WHEN IT IS A SPACE OR LIES IN \t TO \r, TESTED AS byte - \t <= 4
+// WITHOUT SIGN
+
+static size_t trim_field_sse2(const char* field, size_t len)
+{
+    __m128i zero = _mm_setzero_si128();
+    size_t n = len;
+    for(size_t i = 0; i < len; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)(field + i));
+        unsigned int nulls = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero));
+        if(nulls)
+        {
+            size_t at = i + lowest_bit(nulls);
+            n = at < len ? at : len;
+            break;
+        }
+    }
+
+    __m128i space = _mm_set1_epi8(' ');
+    __m128i tab = _mm_set1_epi8('\t');
+    __m128i four = _mm_set1_epi8(4);
+    while(n > 0)
+    {
+        size_t start = n > 16 ? n - 16 : 0;
+        __m128i v = _mm_loadu_si128((const __m128i*)(field + start));
+        __m128i controls = _mm_cmpeq_epi8(_mm_max_epu8(_mm_sub_epi8(v, tab), four), four);
+        unsigned int blanks = (unsigned int)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, space), controls));
+        unsigned int kept = ~blanks & ((1u << (n - start)) - 1);
+        if(kept)
+            return start + highest_bit(kept) + 1;
+        n = start;
+    }
+    return 0;
+}
+
+#endif
+
+//==================================================
+// SSE4.2 KERNEL. pcmpistri FINDS THE NULL CHARACTER AND pcmpestri THE LAST
+// CHARACTER OUTSIDE THE WHITE SPACE RANGES, SIXTEEN BYTES AT A TIME
+
+#ifdef HEADER_SSE42
+
+static size_t trim_field_sse42(const char* field, size_t len)
+{
+    __m128i zero = _mm_setzero_si128();
+    size_t n = len;
+    for(size_t i = 0; i < len; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)(field + i));
+        int at = _mm_cmpistri(zero, v, _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_EACH);
+        if(at < 16)
+        {
+            n = i + at < len ? i + at : len;
+            break;
+        }
+    }
+
+    // THE RANGES ARE PAIRS OF LOWEST AND HIGHEST CHARACTER
+
+    const __m128i ranges = _mm_setr_epi8(' ', ' ', '\t', '\r', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    while(n > 0)
+    {
+        size_t start = n > 16 ? n - 16 : 0;
+        __m128i v = _mm_loadu_si128((const __m128i*)(field + start));
+        int last = _mm_cmpestri(ranges, 4, v, (int)(n - start),
+            _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_MASKED_NEGATIVE_POLARITY | _SIDD_MOST_SIGNIFICANT);
+        if(last < 16)
+            return start + last + 1;
+        n = start;
+    }
+    return 0;
+}
+
+#endif
+
+//==================================================
+// THE TRIM KERNEL IN USE, SCALAR UNTIL select_header_kernels INSTALLS THE
+// VARIANT FOR A CPU LEVEL. THE C API DECODES WITH THE SCALAR KERNEL UNLESS
+// THE PROGRAM USING IT SELECTS ANOTHER
+
+size_t (*trim_field)(const char* field, size_t len) = trim_field_scalar;
+
+//==================================================
+// FUNCTION TO INSTALL THE HEADER KERNELS FOR A CPU LEVEL. SSE4.1 ADDS NOTHING
+// FOR STRINGS AND USES THE SSE2 KERNEL. A LEVEL THAT WAS NOT COMPILED IN
+// FALLS BACK TO THE NEXT LOWER ONE, THE LEVEL INSTALLED IS RETURNED
+
+int select_header_kernels(int level)
+{
+#ifdef HEADER_SSE42
+    if(level >= CPU_SSE42)
+    {
+        trim_field = trim_field_sse42;
+        return CPU_SSE42;
+    }
+#endif
+
+#ifdef HEADER_SSE2
+    if(level >= CPU_SSE2)
+    {
+        trim_field = trim_field_sse2;
+        return level >= CPU_SSE41 ? CPU_SSE41 : CPU_SSE2;
+    }
+#endif
+
+    trim_field = trim_field_scalar;
+    return CPU_SCALAR;
+}
+
+//==================================================
+// FUNCTION USED TO EXTRACT AND TRIM A STRING FROM THE DAT BUFFER.
+// PASCAL STRINGS SEEMS TO STORE THE STRING LENGTH AT THE FIRST BYTES AND WITH
+// NO NULL TERMINATING CHARACTER, SO A WORKAROUND IS NEEDED. THE LENGTH BYTE IS
+// NOT TRUSTED, A CORRUPT FILE CAN NOT MAKE IT READ PAST THE FIELD CAPACITY.
+// THE FIELD IS COPIED TO A PADDED BUFFER FOR THE TRIM KERNEL, THE CHARACTERS
+// AFTER THE TRIMMED STRING ARE CLEARED UP TO THE LENGTH AS strncpy DID
+    
+void extract_string(const char* src, char* dest, unsigned char capacity)
+{            
+    char field[256 + TRIM_PADDING];
+    unsigned char len = (unsigned char)*src;	        
+    len = len < capacity ? len : capacity;
+    memcpy(field, src + sizeof(unsigned char), len);
+    memset(field + len, 0, TRIM_PADDING);
+
+    size_t n = trim_field(field, len);
+    memcpy(dest, field, n);
+    memset(dest + n, 0, len + 1 - n);
+}
+
+//==================================================
+// FUNCTION TO FILL THE IO_Header STRUCTURE WITH DATA EXTRACTED FROM THE DAT BUFFER.
+// THE OFFSETS ARE THE RESULT OF REVERSE ENGINEERING THE DAT FILE FORMAT,
+// encode_header BELOW MUST BE KEPT IN SYNC WITH THEM. ALL OFFSETS LIE WITHIN
+// THE HEADER, SO ONE SIZE CHECK UP FRONT GUARDS EVERY READ BELOW
+
+bool decode_header(const char* buffer, size_t size, IO_Header& io)
+{
+    if(size < DAT_HEADER_SIZE)
+        return false;
+
+    extract_string(buffer, io.spectrum_identifier, 4);
+    extract_string(buffer + 5, io.sample_identifier, 40);
+    extract_string(buffer + 46, io.project, 4);
+    extract_string(buffer + 51, io.sample_location, 30);
+    io.latitude = convert<float>(buffer + 82);
+    io.latitude_unit = *(buffer + 86);
+    io.longitude = convert<float>(buffer + 87);
+    io.longitude_unit = *(buffer + 91);
+    io.sample_height = convert<float>(buffer + 92);
+    io.sample_weight = convert<float>(buffer + 96);
+    io.sample_density = convert<float>(buffer + 100);
+    io.sample_volume = convert<float>(buffer + 104);
+    io.sample_quantity = convert<float>(buffer + 108);
+    io.sample_uncertainty = convert<float>(buffer + 112);
+    extract_string(buffer + 128, io.sampling_start, 12);
+    extract_string(buffer + 141, io.sampling_stop, 12);
+    extract_string(buffer + 154, io.reference_time, 12);
+    extract_string(buffer + 167, io.measurement_start, 12);
+    extract_string(buffer + 180, io.measurement_stop, 12);
+    io.FWHMPS = convert<float>(buffer + 245);
+    io.FWHMAN = convert<float>(buffer + 249);
+    io.THRESH = convert<float>(buffer + 253);
+    io.BSTF = convert<float>(buffer + 257);
+    io.ETOL = convert<float>(buffer + 261);
+    io.LOCH = convert<float>(buffer + 265);
+    io.ICA = convert<short>(buffer + 269);
+    io.real_time = convert<int>(buffer + 193);
+    io.live_time = convert<int>(buffer + 197);
+    io.measurement_time = convert<int>(buffer + 201);
+    derive_dead_time(io);
+    extract_string(buffer + 116, io.sample_unit, 2);
+    extract_string(buffer + 119, io.detector_identifier, 2);
+    extract_string(buffer + 122, io.year, 2);
+    extract_string(buffer + 125, io.beaker_identifier, 2);
+    extract_string(buffer + 209, io.nuclide_library, 12);
+    extract_string(buffer + 222, io.lim_file, 12);
+    extract_string(buffer + 271, io.energy_file, 12);
+    extract_string(buffer + 284, io.pef_file, 12);
+    extract_string(buffer + 297, io.tef_file, 12);
+    extract_string(buffer + 310, io.background_file, 12);
+    io.channel_count = convert<int>(buffer + 235);
+    extract_string(buffer + 239, io.format, 3);
+    io.record_length = convert<short>(buffer + 243);
+
+    io.PA1 = convert<int>(buffer + 323);
+    io.PA2 = convert<int>(buffer + 327);
+    io.PA3 = convert<int>(buffer + 331);
+    io.PA4 = convert<int>(buffer + 335);
+    io.PA5 = convert<int>(buffer + 339);
+    io.PA6 = convert<int>(buffer + 343);
+
+    io.print_out = convert<short>(buffer + 347);
+    io.plot_out = convert<short>(buffer + 349);
+    io.disk_out = convert<short>(buffer + 351);
+    io.ex_print_out = convert<short>(buffer + 353);
+    io.ex_disk_out = convert<short>(buffer + 355);
+
+    io.PO1 = convert<int>(buffer + 357);
+    io.PO2 = convert<int>(buffer + 361);
+    io.PO3 = convert<int>(buffer + 365);
+    io.PO4 = convert<int>(buffer + 369);
+    io.PO5 = convert<int>(buffer + 373);
+    io.PO6 = convert<int>(buffer + 377);
+
+    io.complete = convert<short>(buffer + 381);
+    io.analysed = convert<short>(buffer + 383);
+
+    io.ST1 = convert<short>(buffer + 385);
+    io.ST2 = convert<short>(buffer + 387);
+    io.ST3 = convert<short>(buffer + 389);
+    io.ST4 = convert<short>(buffer + 391);
+    io.ST5 = convert<short>(buffer + 393);
+    io.ST6 = convert<short>(buffer + 395);
+
+    return true;
+}
+
+//==================================================
+// FUNCTION TO COMPUTE THE DEAD TIME IN PERCENT OF THE LIVE TIME
+
+void derive_dead_time(IO_Header& io)
+{
+    io.dead_time = (float)io.real_time - io.live_time;
+    io.dead_time /= (float)io.live_time;
+    io.dead_time *= 100.0f;
+}
+
+//==================================================
+// FUNCTION TO WRITE THE IO_Header STRUCTURE BACK INTO A DAT BUFFER.
+// THIS IS THE INVERSE OF decode_header. ONLY THE HEADER IS TOUCHED, THE
+// SPECTRUM FOLLOWING IT IS LEFT AS IS. dead_time IS DERIVED AND NOT STORED.
+// RETURNS FALSE IF A STRING WAS TOO LONG FOR ITS FIELD AND WAS CUT OFF
+
+bool encode_header(const IO_Header& io, char* buffer)
+{
+    bool fits = true;
+    fits = insert_string(io.spectrum_identifier, buffer, 4) && fits;
+    fits = insert_string(io.sample_identifier, buffer + 5, 40) && fits;
+    fits = insert_string(io.project, buffer + 46, 4) && fits;
+    fits = insert_string(io.sample_location, buffer + 51, 30) && fits;
+    insert<float>(io.latitude, buffer + 82);
+    insert<char>(io.latitude_unit, buffer + 86);
+    insert<float>(io.longitude, buffer + 87);
+    insert<char>(io.longitude_unit, buffer + 91);
+    insert<float>(io.sample_height, buffer + 92);
+    insert<float>(io.sample_weight, buffer + 96);
+    insert<float>(io.sample_density, buffer + 100);
+    insert<float>(io.sample_volume, buffer + 104);
+    insert<float>(io.sample_quantity, buffer + 108);
+    insert<float>(io.sample_uncertainty, buffer + 112);
+    fits = insert_string(io.sample_unit, buffer + 116, 2) && fits;
+    fits = insert_string(io.detector_identifier, buffer + 119, 2) && fits;
+    fits = insert_string(io.year, buffer + 122, 2) && fits;
+    fits = insert_string(io.beaker_identifier, buffer + 125, 2) && fits;
+    fits = insert_string(io.sampling_start, buffer + 128, 12) && fits;
+    fits = insert_string(io.sampling_stop, buffer + 141, 12) && fits;
+    fits = insert_string(io.reference_time, buffer + 154, 12) && fits;
+    fits = insert_string(io.measurement_start, buffer + 167, 12) && fits;
+    fits = insert_string(io.measurement_stop, buffer + 180, 12) && fits;
+    insert<int>(io.real_time, buffer + 193);
+    insert<int>(io.live_time, buffer + 197);
+    insert<int>(io.measurement_time, buffer + 201);
+    fits = insert_string(io.nuclide_library, buffer + 209, 12) && fits;
+    fits = insert_string(io.lim_file, buffer + 222, 12) && fits;
+    insert<int>(io.channel_count, buffer + 235);
+    fits = insert_string(io.format, buffer + 239, 3) && fits;
+    insert<short>(io.record_length, buffer + 243);
+    insert<float>(io.FWHMPS, buffer + 245);
+    insert<float>(io.FWHMAN, buffer + 249);
+    insert<float>(io.THRESH, buffer + 253);
+    insert<float>(io.BSTF, buffer + 257);
+    insert<float>(io.ETOL, buffer + 261);
+    insert<float>(io.LOCH, buffer + 265);
+    insert<short>(io.ICA, buffer + 269);
+    fits = insert_string(io.energy_file, buffer + 271, 12) && fits;
+    fits = insert_string(io.pef_file, buffer + 284, 12) && fits;
+    fits = insert_string(io.tef_file, buffer + 297, 12) && fits;
+    fits = insert_string(io.background_file, buffer + 310, 12) && fits;
+
+    insert<int>(io.PA1, buffer + 323);
+    insert<int>(io.PA2, buffer + 327);
+    insert<int>(io.PA3, buffer + 331);
+    insert<int>(io.PA4, buffer + 335);
+    insert<int>(io.PA5, buffer + 339);
+    insert<int>(io.PA6, buffer + 343);
+
+    insert<short>(io.print_out, buffer + 347);
+    insert<short>(io.plot_out, buffer + 349);
+    insert<short>(io.disk_out, buffer + 351);
+    insert<short>(io.ex_print_out, buffer + 353);
+    insert<short>(io.ex_disk_out, buffer + 355);
+
+    insert<int>(io.PO1, buffer + 357);
+    insert<int>(io.PO2, buffer + 361);
+    insert<int>(io.PO3, buffer + 365);
+    insert<int>(io.PO4, buffer + 369);
+    insert<int>(io.PO5, buffer + 373);
+    insert<int>(io.PO6, buffer + 377);
+
+    insert<short>(io.complete, buffer + 381);
+    insert<short>(io.analysed, buffer + 383);
+
+    insert<short>(io.ST1, buffer + 385);
+    insert<short>(io.ST2, buffer + 387);
+    insert<short>(io.ST3, buffer + 389);
+    insert<short>(io.ST4, buffer + 391);
+    insert<short>(io.ST5, buffer + 393);
+    insert<short>(io.ST6, buffer + 395);
+
+    return fits;
+}
+
+//==================================================
+// FUNCTION USED TO STORE A STRING AS A PASCAL STRING IN THE DAT BUFFER.
+// IF THE STORED STRING ALREADY TRIMS TO THE SAME VALUE IT IS LEFT AS IS,
+// OTHERWISE THE LENGTH BYTE IS WRITTEN AND THE REST OF THE FIELD IS PADDED.
+// A STRING LONGER THAN THE FIELD IS CUT OFF AND FALSE IS RETURNED
+
+bool insert_string(const char* src, char* dest, unsigned char capacity)
+{
+    char current[256];
+    extract_string(dest, current, capacity);
+    if(!strcmp(current, src))
+        return true;
+
+    size_t len = strlen(src);
+    bool fits = len <= capacity;
+    if(!fits)
+        len = capacity;
+    *dest = (char)(unsigned char)len;
+    memcpy(dest + 1, src, len);
+    memset(dest + 1 + len, ' ', capacity - len);
+    return fits;
+}
+
+//==================================================
@@ -0,0 +1,82 @@
+//==================================================
+// Copyright (C) 2011 by Norwegian Radiation Protection Authority
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// Authors: Dag Robøle,
+//
+//==================================================
+
+#ifndef HEADER_H
+#define HEADER_H
+
+//==================================================
+
+#include <cstddef>
+#include <cstring>
+#include "main.h"
+
+//==================================================
+// CONVERT A SLICE OF A CHARACTER STRING TO A PRIMITIVE TYPE    
+
+template<class T>
+T convert(const char* src)
+{        
+    T t;
+    memcpy((void*)&t, (void*)src, sizeof(T));
+    return t;
+}
+
+//==================================================
+// WRITE A PRIMITIVE TYPE INTO A SLICE OF A CHARACTER STRING.
+// THE BYTES ARE ONLY TOUCHED WHEN THE VALUE DIFFERS    
+
+template<class T>
+void insert(const T& val, char* dest)
+{        
+    if(memcmp((const void*)&val, (const void*)dest, sizeof(T)))
+        memcpy((void*)dest, (const void*)&val, sizeof(T));
+}
+
+//==================================================
+// READING AND WRITING THE DAT HEADER. KEPT APART FROM THE PROGRAM SO THE
+// C API IN api.cpp CAN DECODE DAT FILES WITHOUT THE REST OF dat2inp
+
+void extract_string(const char* src, char* dest, unsigned char capacity);
+bool insert_string(const char* src, char* dest, unsigned char capacity);
+bool decode_header(const char* buffer, size_t size, IO_Header& io);
+bool encode_header(const IO_Header& io, char* buffer);
+void derive_dead_time(IO_Header& io);
+
+//==================================================
+// THE STRING TRIMMING OF extract_string IS A FUNCTION POINTER, SET BY
+// select_header_kernels TO THE SCALAR, SSE2 OR SSE4.2 VARIANT FOR A CPU LEVEL
+// FROM spectrum.h. ALL VARIANTS GIVE THE SAME RESULTS.
+// THE REST OF decode_header HAS NO VARIANTS. ITS FIELDS ARE LOADED FROM FIXED
+// OFFSETS INTO FIXED MEMBERS, WHICH COMPILES TO PLAIN MOVES WITH NO LOOP TO
+// VECTORIZE
+
+extern size_t (*trim_field)(const char* field, size_t len);
+int select_header_kernels(int level);
+
+//==================================================
+
+#endif // HEADER_H
+
+//==================================================
@@ -0,0 +1,174 @@
+//==================================================
+// Copyright (C) 2011 by Norwegian Radiation Protection Authority
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// Authors: Dag Robøle,
+//
+//==================================================
+// HEADER INCLUDES
+
+#include "limiter.h"
+
+//==================================================
+// THE BUCKETS HOLD AT MOST THIS MUCH OF THEIR RATE, SO AN IDLE PERIOD ONLY
+// ALLOWS A SHORT BURST AFTER IT. A WAITING OPERATION SLEEPS AT MOST
+// IO_LIMIT_SLEEP_MS BEFORE IT LOOKS AGAIN
+
+#define IO_LIMIT_BURST_MS		100
+#define IO_LIMIT_SLEEP_MS		50
+
+//==================================================
+// THE AVERAGE READ LATENCY WEIGHS EACH NEW READ BY 1 / IO_LATENCY_WEIGHT.
+// THE RATES ARE NEVER CUT BELOW 1 / IO_LIMIT_MIN_DIVISOR OF THE SET RATES
+
+#define IO_LATENCY_WEIGHT		8
+#define IO_LIMIT_BACKOFF_MS		250
+#define IO_LIMIT_RECOVERY		0.1
+#define IO_LIMIT_MIN_DIVISOR	64
+
+//==================================================
+
+static __int64 counter_now()
+{
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    return now.QuadPart;
+}
+
+IoLimiter::IoLimiter()
+    : m_enabled(false), m_frequency(1.0), m_bytes_rate(0.0), m_ops_rate(0.0), m_max_in_flight(0), m_latency_limit(0.0),
+      m_bytes(0.0), m_ops(0.0), m_in_flight(0), m_refilled(0), m_factor(1.0), m_latency(0.0), m_adjusted(0), m_backed_off(0)
+{
+    InitializeCriticalSection(&m_lock);
+}
+
+void IoLimiter::init(double bytes_rate, double ops_rate, unsigned int max_in_flight, unsigned int latency_limit)
+{
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    m_frequency = (double)frequency.QuadPart;
+
+    m_bytes_rate = bytes_rate;
+    m_ops_rate = ops_rate;
+    m_max_in_flight = max_in_flight;
+    m_latency_limit = latency_limit;
+    m_enabled = bytes_rate > 0.0 || ops_rate > 0.0 || max_in_flight > 0;
+
+    m_bytes = bytes_rate * IO_LIMIT_BURST_MS / 1000;
+    m_ops = ops_rate * IO_LIMIT_BURST_MS / 1000;
+    m_refilled = m_adjusted = m_backed_off = counter_now();
+}
+
+//==================================================
+// FUNCTION ADDING THE TOKENS EARNED SINCE THE LAST REFILL, CALLED LOCKED
+
+void IoLimiter::refill(__int64 now)
+{
+    double seconds = (now - m_refilled) / m_frequency;
+    m_refilled = now;
+
+    double burst = m_bytes_rate * IO_LIMIT_BURST_MS / 1000;
+    m_bytes += seconds * m_bytes_rate * m_factor;
+    m_bytes = m_bytes < burst ? m_bytes : burst;
+
+    burst = m_ops_rate * IO_LIMIT_BURST_MS / 1000;
+    m_ops += seconds * m_ops_rate * m_factor;
+    m_ops = m_ops < burst ? m_ops : burst;
+}
+
+//==================================================
+// FUNCTION WAITING UNTIL AN OPERATION ON bytes BYTES IS ALLOWED. RETURNS THE
+// TIME IT STARTED, TO BE HANDED TO end WHEN THE OPERATION IS DONE
+
+__int64 IoLimiter::begin(unsigned int bytes)
+{
+    if(!m_enabled)
+        return 0;
+
+    for(;;)
+    {
+        EnterCriticalSection(&m_lock);
+        __int64 now = counter_now();
+        refill(now);
+
+        double wait = 0.0;
+        if(m_bytes_rate > 0.0 && m_bytes < 0.0)
+            wait = -m_bytes / (m_bytes_rate * m_factor);
+        if(m_ops_rate > 0.0 && m_ops < 0.0 && -m_ops / (m_ops_rate * m_factor) > wait)
+            wait = -m_ops / (m_ops_rate * m_factor);
+
+        if(wait == 0.0 && (!m_max_in_flight || m_in_flight < m_max_in_flight))
+        {
+            if(m_bytes_rate > 0.0)
+                m_bytes -= bytes;
+            if(m_ops_rate > 0.0)
+                m_ops -= 1.0;
+            ++m_in_flight;
+            LeaveCriticalSection(&m_lock);
+            return now;
+        }
+        LeaveCriticalSection(&m_lock);
+
+        DWORD ms = (DWORD)(wait * 1000) + 1;
+        Sleep(ms < IO_LIMIT_SLEEP_MS ? ms : IO_LIMIT_SLEEP_MS);
+    }
+}
+
+//==================================================
+// FUNCTION ENDING AN OPERATION. WITH A LATENCY LIMIT THE TIME A READ TOOK
+// IS ADDED TO THE AVERAGE AND THE RATES ARE ADJUSTED TO IT
+
+void IoLimiter::end(int kind, __int64 started)
+{
+    if(!m_enabled)
+        return;
+
+    EnterCriticalSection(&m_lock);
+    --m_in_flight;
+
+    if(kind == IO_READ && m_latency_limit > 0.0)
+    {
+        __int64 now = counter_now();
+        double ms = (now - started) * 1000 / m_frequency;
+        m_latency += (ms - m_latency) / IO_LATENCY_WEIGHT;
+
+        if(m_latency > m_latency_limit)
+        {
+            if((now - m_backed_off) * 1000 / m_frequency >= IO_LIMIT_BACKOFF_MS)
+            {
+                refill(now);
+                m_factor /= 2;
+                m_factor = m_factor > 1.0 / IO_LIMIT_MIN_DIVISOR ? m_factor : 1.0 / IO_LIMIT_MIN_DIVISOR;
+                m_backed_off = now;
+            }
+        }
+        else if(m_factor < 1.0)
+        {
+            refill(now);
+            m_factor += (now - m_adjusted) / m_frequency * IO_LIMIT_RECOVERY;
+            m_factor = m_factor < 1.0 ? m_factor : 1.0;
+        }
+        m_adjusted = now;
+    }
+
+    LeaveCriticalSection(&m_lock);
+}
+
+//==================================================
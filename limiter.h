@@ -0,0 +1,88 @@
+//==================================================
+// Copyright (C) 2011 by Norwegian Radiation Protection Authority
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// Authors: Dag Robøle,
+//
+//==================================================
+
+#ifndef LIMITER_H
+#define LIMITER_H
+
+//==================================================
+
+#include <Windows.h>
+
+//==================================================
+// LIMITS THE FILE OPERATIONS OF A RUN. ONE LIMITER IS SHARED BY THE READER,
+// WRITER AND CONVERTING THREADS, SO THE LIMITS HOLD FOR ALL OF THEM
+// TOGETHER. TWO TOKEN BUCKETS HOLD THE BYTES AND THE OPERATIONS ALLOWED,
+// REFILLED AT THEIR RATE PER SECOND UP TO IO_LIMIT_BURST_MS WORTH. AN
+// OPERATION MAY TAKE A BUCKET BELOW ZERO AND THE NEXT ONE WAITS UNTIL IT IS
+// REFILLED, SO A FILE LARGER THAN THE BURST STILL PASSES. A ZERO RATE OR
+// COUNT IS NOT LIMITED.
+// WITH A LATENCY LIMIT THE RATES ARE HALVED WHEN THE AVERAGE READ TAKES
+// LONGER, AT MOST ONCE PER IO_LIMIT_BACKOFF_MS, AND GROW BACK BY A TENTH OF
+// THE SET RATES PER SECOND WHILE THE READS ARE FAST ENOUGH
+
+enum { IO_READ, IO_WRITE };
+
+class IoLimiter
+{
+public:
+
+    IoLimiter();
+    ~IoLimiter() { DeleteCriticalSection(&m_lock); }
+
+    void init(double bytes_rate, double ops_rate, unsigned int max_in_flight, unsigned int latency_limit);
+    __int64 begin(unsigned int bytes);
+    void end(int kind, __int64 started);
+
+private:
+
+    IoLimiter(const IoLimiter&);
+    IoLimiter& operator=(const IoLimiter&);
+
+    void refill(__int64 now);
+
+    CRITICAL_SECTION m_lock;
+    bool m_enabled;
+    double m_frequency;
+    double m_bytes_rate;
+    double m_ops_rate;
+    unsigned int m_max_in_flight;
+    double m_latency_limit;
+
+    double m_bytes;
+    double m_ops;
+    unsigned int m_in_flight;
+    __int64 m_refilled;
+
+    double m_factor;
+    double m_latency;
+    __int64 m_adjusted;
+    __int64 m_backed_off;
+};
+
+//==================================================
+
+#endif // LIMITER_H
+
+//==================================================
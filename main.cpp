@@ -34,8 +34,25 @@
 #include <cstring>
 #include <iterator>
 #include <algorithm>
+#include <set>
+#include <map>
 #include <cctype>
+#include <cstdlib>
+#include <cstddef>
+#include <cstdio>
+#include <climits>
+#include <new>
 #include "main.h"
+#include "buffers.h"
+#include "header.h"
+#include "pipeline.h"
+#include "writer.h"
+#include "spectrum.h"
+#include "bundle.h"
+#include "numbers.h"
+#include "sorter.h"
+#include "server.h"
+#include "progress.h"
 #include "SimpleOpt.h"
 #include <Windows.h>
 
@@ -53,28 +70,618 @@ std::string to_string(const T& val)
 }
 
 //==================================================
-// CONVERT A SLICE OF A CHARACTER STRING TO A PRIMITIVE TYPE    
+// APPEND ONLY JOURNAL OF CONVERTED FILES USED TO RESUME AN INTERRUPTED RUN.
+// EACH LINE HOLDS <name> <dat size> <dat hash> <output size> SEPARATED BY TABS.
+// LINES ARE COLLECTED IN MEMORY AND APPENDED IN BATCHES, A TRUNCATED LAST
+// LINE LEFT BY A CRASH IS IGNORED SO THAT FILE IS SIMPLY CONVERTED AGAIN.
+// A FILE ONLY COUNTS AS DONE WHEN ITS NAME, SIZE AND HASH ALL MATCH, SO A DAT
+// REWRITTEN AT THE SAME SIZE, AS --patch-dat DOES, IS CONVERTED AGAIN
+
+#define JOURNAL_BATCH_SIZE	64
+
+class Journal
+{
+public:
+
+    Journal() : m_file(0), m_pending(0), m_partial(false) {}
+    ~Journal() { close(); }
+
+    bool load(const char* filename)
+    {
+        FILE* f = fopen(filename, "rb");
+        if(!f)
+            return true;
+
+        char line[MAX_PATH + 128];
+        while(fgets(line, sizeof(line), f))
+        {
+            size_t len = strlen(line);
+            m_partial = !len || line[len - 1] != '\n';
+            if(m_partial)
+                continue;
+
+            char* tab = strchr(line, '\t');
+            if(!tab)
+                continue;
+            *tab = 0;
+            char* end;
+            unsigned int size = (unsigned int)strtoul(tab + 1, &end, 10);
+            if(*end != '\t')
+                continue;
+            unsigned __int64 dat_hash = _strtoui64(end + 1, &end, 16);
+            if(*end != '\t')
+                continue;
+            m_done.push_back(Entry(key(line, size), dat_hash));
+        }
+        fclose(f);
+
+        sort(m_done.begin(), m_done.end());
+        return true;
+    }
+
+    bool open(const char* filename)
+    {
+        m_file = fopen(filename, "ab");
+        if(m_file && m_partial)
+            fputc('\n', m_file);
+        return m_file != 0;
+    }
+
+    bool contains(const char* name, unsigned int size, unsigned __int64 dat_hash) const
+    {
+        return binary_search(m_done.begin(), m_done.end(), Entry(key(name, size), dat_hash));
+    }
+
+    size_t count() const { return m_done.size(); }
+
+    void add(const char* name, unsigned int size, unsigned __int64 dat_hash, unsigned int out_size)
+    {
+        if(!m_file)
+            return;
+
+        char tmp[96];
+        m_buffer.append(name);
+        m_buffer.append(tmp, sprintf(tmp, "\t%u\t%016llx\t%u\n", size, dat_hash, out_size));
+        if(++m_pending >= JOURNAL_BATCH_SIZE)
+            flush();
+    }
+
+    void flush()
+    {
+        if(!m_file || !m_buffer.size())
+            return;
+        fwrite(m_buffer.data(), 1, m_buffer.size(), m_file);
+        fflush(m_file);
+        m_buffer.clear();
+        m_pending = 0;
+    }
+
+    void close()
+    {
+        flush();
+        if(m_file)
+            fclose(m_file);
+        m_file = 0;
+    }
+
+    static unsigned __int64 key(const char* name, unsigned int size)
+    {
+        unsigned __int64 hash = 14695981039346656037ULL;
+        for(; *name; ++name)
+        {
+            hash ^= (unsigned char)toupper((unsigned char)*name);
+            hash *= 1099511628211ULL;
+        }
+        for(int i = 0; i < 4; i++, size >>= 8)
+        {
+            hash ^= size & 0xff;
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+
+private:
+
+    Journal(const Journal&);
+    Journal& operator=(const Journal&);
+
+    typedef pair<unsigned __int64, unsigned __int64> Entry;
+
+    FILE* m_file;
+    RecordBuffer m_buffer;
+    unsigned int m_pending;
+    bool m_partial;
+    vector<Entry> m_done;
+};
+
+//==================================================
+// SELECTION OF THE LISTED DAT FILES THIS PROCESS SHOULD CONVERT.
+// CALLED BY THE READER THREADS WITH THE DIRECTORY LISTING LOCKED AND BY THE
+// PROGRESS REPORTER WHILE IT COUNTS, SO IT ONLY READS THE FILTER. FILES IN
+// THE JOURNAL ARE STILL READ, THEIR HASH IS ONLY KNOWN FROM THE DATA
+
+struct ListingFilter
+{
+    unsigned int shard_index;
+    unsigned int shard_count;
+};
+
+unsigned int hash_name(const char* name);
+
+bool accept_file(const char* name, unsigned int size, void* context)
+{
+    ListingFilter* listing = (ListingFilter*)context;
+
+    return listing->shard_count <= 1 || hash_name(name) % listing->shard_count == listing->shard_index;
+}
+
+//==================================================
+// CACHE OF THE FILES REFERENCED FROM THE DAT HEADERS.
+// EACH DISTINCT NAME IS LOOKED UP IN THE SEARCH PATH ONCE PER RUN AND THE
+// ANSWER KEPT, SINCE MOST SPECTRA SHARE THE SAME FEW LIBRARIES. NAMES ARE
+// KEYED UPPER CASE AS WINDOWS FILE NAMES ARE CASE INSENSITIVE. THE CACHE IS
+// ONLY USED BY THE CONVERTING THREAD AND NEEDS NO LOCKING
+
+class ReferenceCache
+{
+public:
+
+    ReferenceCache() : m_missing(0) {}
+
+    void add_directories(const char* search_path)
+    {
+        while(*search_path)
+        {
+            const char* end = strchr(search_path, ';');
+            if(!end)
+                end = search_path + strlen(search_path);
+            if(end > search_path)
+            {
+                string dir(search_path, end);
+                if(dir[dir.length() - 1] != '\\' && dir[dir.length() - 1] != '/')
+                    dir += '\\';
+                m_dirs.push_back(dir);
+            }
+            search_path = *end ? end + 1 : end;
+        }
+    }
+
+    bool exists(const char* name)
+    {
+        string key(name);
+        for(string::size_type i = 0; i < key.length(); i++)
+            key[i] = (char)toupper((unsigned char)key[i]);
+
+        map<string, bool>::const_iterator it = m_known.find(key);
+        if(it != m_known.end())
+            return it->second;
+
+        bool found = false;
+        if(strchr(name, ':') || *name == '\\' || *name == '/')
+            found = is_file(name);
+        else if(m_dirs.empty())
+            found = is_file(name);
+        else
+        {
+            for(vector<string>::const_iterator dir = m_dirs.begin(); dir != m_dirs.end() && !found; ++dir)
+                found = is_file((*dir + name).c_str());
+        }
+
+        if(!found)
+            ++m_missing;
+        m_known[key] = found;
+        return found;
+    }
+
+    size_t checked() const { return m_known.size(); }
+    size_t missing() const { return m_missing; }
+
+private:
+
+    static bool is_file(const char* path)
+    {
+        DWORD attributes = GetFileAttributes(path);
+        return attributes != INVALID_FILE_ATTRIBUTES && !(attributes & FILE_ATTRIBUTE_DIRECTORY);
+    }
+
+    vector<string> m_dirs;
+    map<string, bool> m_known;
+    size_t m_missing;
+};
+
+//==================================================
+// FAILURE CLASSES RECORDED PER FILE. THE EXIT CODE IS THE BITWISE OR OF THE
+// CLASSES SEEN DURING THE RUN, 1 IS KEPT FOR ERRORS THAT STOP THE RUN
+
+enum ErrorClass
+{
+    ERROR_OPEN = 2,
+    ERROR_READ = 4,
+    ERROR_DECODE = 8,
+    ERROR_WRITE = 16,
+    ERROR_REFERENCE = 32,
+    ERROR_CLIPPED = 64
+};
+
+//==================================================
+// COLLECTS THE FAILURES OF A RUN SO THE RUN CAN GO ON PAST THEM.
+// THE READER AND WRITER THREADS HAND THEIR FAILURES BACK IN THEIR SLOTS, SO
+// ONLY THE CONVERTING THREAD ADDS ENTRIES AND NO LOCKING IS NEEDED
+
+class ErrorReport
+{
+public:
+
+    ErrorReport() : m_classes(0) {}
+
+    // THE MESSAGE AND FILE POOLS MUST STAY IN STEP, SO WHEN THE FILE CAN NOT BE
+    // STORED THE MESSAGE IS TAKEN BACK. THE CLASS IS KEPT EITHER WAY
+
+    void add(ErrorClass error, const char* message, const char* file)
+    {
+        m_classes |= error;
+        if(!m_messages.add(message, file, error))
+            return;
+        if(!m_files.add(0, file))
+            m_messages.remove_last();
+    }
+
+    unsigned int count() const { return m_messages.count(); }
+    const char* message(unsigned int i) const { return m_messages.str(i); }
+    const char* file(unsigned int i) const { return m_files.str(i); }
+    ErrorClass error(unsigned int i) const { return (ErrorClass)m_messages.size(i); }
+    int classes() const { return m_classes; }
+
+    static const char* name(ErrorClass error)
+    {
+        switch(error)
+        {
+            case ERROR_OPEN: return "open";
+            case ERROR_READ: return "read";
+            case ERROR_DECODE: return "decode";
+            case ERROR_WRITE: return "write";
+            case ERROR_REFERENCE: return "reference";
+            case ERROR_CLIPPED: return "clipped";
+        }
+        return "unknown";
+    }
+
+private:
+
+    NamePool m_messages;
+    NamePool m_files;
+    int m_classes;
+};
+
+//==================================================
+// TABLE DESCRIBING THE IO_Header FIELDS BY NAME.
+// USED TO RESOLVE FIELD NAMES GIVEN ON THE COMMAND LINE OR IN RULE FILES
+
+enum { FIELD_STRING, FIELD_CHAR, FIELD_SHORT, FIELD_INT, FIELD_FLOAT };
+
+struct IO_Field
+{
+    const char* name;
+    size_t offset;
+    int type;
+    size_t size;
+};
+
+#define IO_FIELD(name, type, label) { #name, offsetof(IO_Header, name), FIELD_##type, sizeof(((IO_Header*)0)->name) },
+
+const IO_Field g_io_fields[] =
+{
+    IO_HEADER_FIELDS(IO_FIELD)
+};
+
+#undef IO_FIELD
+
+const unsigned int g_io_field_count = sizeof(g_io_fields) / sizeof(g_io_fields[0]);
+
+// THE FIELDS NAMING FILES THAT gamma10 OPENS DURING THE ANALYSIS
+
+const char* const g_reference_fields[] = { "nuclide_library", "lim_file", "energy_file", "pef_file", "tef_file", "background_file" };
+const unsigned int g_reference_field_count = sizeof(g_reference_fields) / sizeof(g_reference_fields[0]);
+
+//==================================================
+// HEADER REWRITE RULES.
+// A RULE IS WRITTEN AS <operation>:<field>=<value> WHERE <operation> IS ONE OF
+//   set      ALWAYS STORE <value> IN THE FIELD
+//   default  STORE <value> IN THE FIELD IF IT IS EMPTY OR ZERO
+//   replace  <value> IS <old>/<new>, EVERY OCCURRENCE OF <old> IN A TEXT FIELD IS REPLACED BY <new>
+// RULES ARE COMPILED ONCE INTO A FLAT TABLE OF FIELD OFFSETS AND APPLY FUNCTIONS
+
+struct Rule
+{
+    void (*apply)(const Rule& rule, IO_Header& io);
+    size_t offset;
+    size_t size;
+    double number;
+    string value;
+    string replacement;
+};
 
 template<class T>
-T convert(const char* src)
-{        
-    T t;
-    memcpy((void*)&t, (void*)src, sizeof(T));
-    return t;
+void rule_set(const Rule& rule, IO_Header& io)
+{
+    *(T*)((char*)&io + rule.offset) = (T)rule.number;
+}
+
+template<class T>
+void rule_default(const Rule& rule, IO_Header& io)
+{
+    T* field = (T*)((char*)&io + rule.offset);
+    if(!*field)
+        *field = (T)rule.number;
+}
+
+void rule_set_char(const Rule& rule, IO_Header& io)
+{
+    *((char*)&io + rule.offset) = rule.value.empty() ? 0 : rule.value[0];
+}
+
+void rule_default_char(const Rule& rule, IO_Header& io)
+{
+    char* field = (char*)&io + rule.offset;
+    if(!*field)
+        *field = rule.value.empty() ? 0 : rule.value[0];
+}
+
+void rule_set_string(const Rule& rule, IO_Header& io)
+{
+    char* field = (char*)&io + rule.offset;
+    strncpy(field, rule.value.c_str(), rule.size - 1);
+    field[rule.size - 1] = 0;
+}
+
+void rule_default_string(const Rule& rule, IO_Header& io)
+{
+    if(!*((char*)&io + rule.offset))
+        rule_set_string(rule, io);
+}
+
+void rule_replace_string(const Rule& rule, IO_Header& io)
+{
+    char* field = (char*)&io + rule.offset;
+    if(!strstr(field, rule.value.c_str()))
+        return;
+
+    char result[256];
+    size_t n = 0;
+    const char* src = field;
+    const char* hit;
+    while((hit = strstr(src, rule.value.c_str())) != 0 && n < rule.size - 1)
+    {
+        for(; src < hit && n < rule.size - 1; ++src)
+            result[n++] = *src;
+        for(size_t k = 0; k < rule.replacement.length() && n < rule.size - 1; ++k)
+            result[n++] = rule.replacement[k];
+        src = hit + rule.value.length();
+    }
+    for(; *src && n < rule.size - 1; ++src)
+        result[n++] = *src;
+    result[n] = 0;
+
+    memcpy(field, result, n + 1);
+}
+
+void apply_rules(const vector<Rule>& rules, IO_Header& io)
+{
+    for(vector<Rule>::const_iterator it = rules.begin(); it != rules.end(); ++it)
+        it->apply(*it, io);
 }
 
+//==================================================
+// OUTPUT DIRECTORY TEMPLATE.
+// THE --output-dir VALUE MAY NAME IO_Header FIELDS IN BRACES, AS IN
+// OUT\{detector_identifier}\{year}. IT IS COMPILED ONCE INTO LITERAL PARTS AND
+// FIELDS, AND EACH DIRECTORY IS CREATED ONLY THE FIRST TIME IT IS SEEN
+
+struct PathPart
+{
+    const IO_Field* field;
+    string text;
+};
+
+struct OutputDir
+{
+    vector<PathPart> parts;
+    set<string> created;
+};
+
+//==================================================
+// SPECTRA MERGED ACROSS DAT FILES WITH EQUAL --merge-by FIELDS. A GROUP
+// KEEPS THE HEADER BYTES OF ITS FIRST FILE, THE SUMMED HEADER AND ONE 64 BIT
+// SUM PER CHANNEL, SO MEMORY GROWS WITH THE NUMBER OF GROUPS AND NOT FILES
+
+enum { MERGE_ADDED, MERGE_NO_SPECTRUM, MERGE_CHANNELS_DIFFER };
+
+// RESULTS OF diff_inp BESIDES THE NUMBER OF CHANGED FIELDS
+
+enum { DIFF_NEW_FILE = -1, DIFF_OPEN_FAILED = -2, DIFF_READ_FAILED = -3 };
+
+struct MergeGroup
+{
+    MergeGroup() : real_time(0), live_time(0), files(0) {}
+
+    string name;
+    IO_Header io;
+    vector<char> header;
+    vector<unsigned __int64> sums;
+    __int64 real_time;
+    __int64 live_time;
+    unsigned int files;
+};
+
+typedef map<string, MergeGroup> MergeGroups;
+
 //==================================================
 // FUNCTION DECLARATIONS AND GLOBALS
 
 void print_version(ostream& out);
 void print_usage(ostream& out);
 string get_args_error(int error);
-bool ends_with(const string& full, const string& ending);
-void extract_string(const char* src, char* dest);
-void dump(const IO_Header& io, ostream& out);
-void generate_inp(const IO_Header& io, ostream& out);
+bool ends_with(const char* full, const char* ending);
+bool parse_inp(istream& in, IO_Header& io);
+int patch_dat_files(const char* error_report);
+const IO_Field* find_field(const char* name);
+bool compile_rule(const string& text, Rule& rule, string& error);
+bool load_rules(const char* filename, vector<Rule>& rules, string& error);
+void dump(const IO_Header& io, RecordBuffer& out);
+void generate_inp(const IO_Header& io, RecordBuffer& out);
+void append_json_string(const char* str, RecordBuffer& out);
+void append_csv_string(const char* str, RecordBuffer& out);
+void format_ndjson(const char* file, const IO_Header& io, const SpectrumStats* stats, RecordBuffer& out);
+bool write_error_report(const ErrorReport& errors, const char* filename);
+int serve_convert(const char* name, const char* data, unsigned int size, int reply, RecordBuffer& out, void* context);
+int request_conversions(const char* pipe_name, int reply, const char* error_report);
+void format_csv_header(const vector<SpectrumROI>* rois, RecordBuffer& out);
+void format_csv(const char* file, const IO_Header& io, const vector<SpectrumROI>* rois, const SpectrumStats* stats, RecordBuffer& out);
+bool parse_roi(const char* text, SpectrumROI& roi);
+void write_stats(const SpectrumStats& stats, RecordBuffer& out);
+bool parse_shard(const char* text, unsigned int& index, unsigned int& count);
+bool parse_rate(const char* text, double& rate);
+unsigned __int64 hash_bytes(const char* data, size_t size);
+int diff_inp(const char* fname, const char* generated, size_t size, ostream& report);
+const IO_Field* verify_roundtrip(const char* buffer, const IO_Header& io);
+bool compile_output_dir(const char* text, OutputDir& output, string& error);
+const char* field_text(const IO_Field* field, const IO_Header& io, char* number);
+size_t expand_output_dir(const OutputDir& output, const IO_Header& io, char* path);
+bool is_separator(char c);
+size_t path_root_length(const char* path, size_t len);
+bool make_output_dir(OutputDir& output, char* path, size_t len);
+bool is_input_dir(const char* path, size_t len);
+int extract_inp(const char* bundle_file, const vector<const char*>& names);
+bool check_references(const IO_Header& io, ReferenceCache& cache, string& missing);
+bool parse_merge_fields(const char* text, vector<const IO_Field*>& fields, string& error);
+int merge_spectrum(const vector<const IO_Field*>& fields, const char* name, const char* buffer, unsigned int size, const IO_Header& io, MergeGroups& groups);
+int clip_int(__int64 value, bool& clipped);
+bool write_merged(MergeGroup& group, char* path, size_t len, RecordBuffer& record, unsigned int& clipped, bool& clipped_times);
+void format_write_slot(const WriteSlot& slot, RecordBuffer& inp, RecordBuffer& sta);
+unsigned int report_written(WritePipeline& writer, ErrorReport& errors, Journal* journal, bool quiet, unsigned int& converted);
+
+//==================================================
+// OUTPUT FORMATS.
+// serialize WALKS THE FIELD LIST AT COMPILE TIME AND HANDS EACH FIELD TO THE
+// FORMAT WITH ITS OWN TYPE, SO EVERY FORMAT BECOMES A STRAIGHT SEQUENCE OF
+// APPENDS WITH NO TYPE SWITCH AND NO STREAM FLAGS. A NEW FORMAT IS ONE MORE
+// CLASS WITH A field OVERLOAD FOR TEXT, char, short, int AND float
+
+template<class Format>
+void serialize(const IO_Header& io, Format& format)
+{
+#define SERIALIZE_FIELD(name, type, label) format.field(#name, label, io.name);
+    IO_HEADER_FIELDS(SERIALIZE_FIELD)
+#undef SERIALIZE_FIELD
+}
+
+// ONE VALUE PER LINE, FLOATS AS %.14e WHATEVER THE LOCALE
+
+class InpFormat
+{
+public:
+
+    explicit InpFormat(RecordBuffer& out) : m_out(out) {}
+
+    void field(const char*, const char*, const char* value) { m_out.append(value); m_out.append('\n'); }
+    void field(const char*, const char*, char value) { m_out.append(value); m_out.append('\n'); }
+    void field(const char* name, const char* label, short value) { field(name, label, (int)value); }
+    void field(const char*, const char*, int value) { char tmp[32]; size_t n = format_int(value, tmp); tmp[n] = '\n'; m_out.append(tmp, n + 1); }
+    void field(const char*, const char*, float value) { char tmp[48]; size_t n = format_scientific(value, tmp); tmp[n] = '\n'; m_out.append(tmp, n + 1); }
+
+private:
+
+    RecordBuffer& m_out;
+};
+
+// ONE LABELED VALUE PER LINE FOR THE FIELDS WITH A DUMP LABEL. THE DUMP KEEPS
+// THE FIELD ORDER IT HAD BEFORE THE FIELD LIST, WHICH IS NOT THE INP ORDER, SO
+// dump WALKS DUMP_FIELDS AND TAKES THE LABELS FROM IO_HEADER_FIELDS
+
+#define DUMP_LABEL(name, type, label) static const char* const g_dump_label_##name = label;
+IO_HEADER_FIELDS(DUMP_LABEL)
+#undef DUMP_LABEL
+
+#define DUMP_FIELDS(X) \
+    X(spectrum_identifier) X(sample_identifier) X(project) X(sample_location) \
+    X(latitude) X(latitude_unit) X(longitude) X(longitude_unit) \
+    X(sample_height) X(sample_weight) X(sample_density) X(sample_volume) X(sample_quantity) X(sample_uncertainty) \
+    X(sampling_start) X(sampling_stop) X(reference_time) X(measurement_start) X(measurement_stop) \
+    X(format) X(FWHMPS) X(FWHMAN) X(THRESH) X(BSTF) X(ETOL) X(LOCH) X(ICA) \
+    X(live_time) X(real_time) X(dead_time) X(measurement_time) X(channel_count) X(record_length) \
+    X(sample_unit) X(detector_identifier) X(year) X(beaker_identifier) \
+    X(nuclide_library) X(energy_file) X(pef_file) X(tef_file) X(background_file) X(lim_file)
+
+class DumpFormat
+{
+public:
+
+    explicit DumpFormat(RecordBuffer& out) : m_out(out) {}
+
+    void field(const char*, const char* label, const char* value) { if(label) { begin(label); m_out.append(value); m_out.append('\n'); } }
+    void field(const char*, const char* label, char value) { if(label) { begin(label); m_out.append(value); m_out.append('\n'); } }
+    void field(const char* name, const char* label, short value) { field(name, label, (int)value); }
+    void field(const char*, const char* label, int value) { char tmp[16]; if(label) { begin(label); m_out.append(tmp, sprintf(tmp, "%d\n", value)); } }
+    void field(const char*, const char* label, float value) { char tmp[48]; if(label) { begin(label); m_out.append(tmp, sprintf(tmp, "%g\n", (double)value)); } }
+
+private:
+
+    void begin(const char* label) { m_out.append(label); m_out.append(": ", 2); }
+
+    RecordBuffer& m_out;
+};
+
+// "name":value MEMBERS, EACH PRECEDED BY A COMMA. NON FINITE FLOATS ARE null
+
+class NdjsonFormat
+{
+public:
+
+    explicit NdjsonFormat(RecordBuffer& out) : m_out(out) {}
+
+    void field(const char* name, const char*, const char* value) { begin(name); append_json_string(value, m_out); }
+    void field(const char* name, const char*, char value) { char c[2] = { value, 0 }; begin(name); append_json_string(c, m_out); }
+    void field(const char* name, const char* label, short value) { field(name, label, (int)value); }
+    void field(const char* name, const char*, int value) { char tmp[16]; begin(name); m_out.append(tmp, sprintf(tmp, "%d", value)); }
+    void field(const char* name, const char*, float value)
+    {
+        char tmp[32];
+        size_t n = format_float(value, tmp);
+        begin(name);
+        if(n)
+            m_out.append(tmp, n);
+        else m_out.append("null", 4);
+    }
+
+private:
+
+    void begin(const char* name) { m_out.append(",\"", 2); m_out.append(name); m_out.append("\":", 2); }
+
+    RecordBuffer& m_out;
+};
+
+// CELLS EACH PRECEDED BY A COMMA. NON FINITE FLOATS ARE EMPTY CELLS
+
+class CsvFormat
+{
+public:
+
+    explicit CsvFormat(RecordBuffer& out) : m_out(out) {}
+
+    void field(const char*, const char*, const char* value) { m_out.append(','); append_csv_string(value, m_out); }
+    void field(const char*, const char*, char value) { char c[2] = { value, 0 }; m_out.append(','); append_csv_string(c, m_out); }
+    void field(const char* name, const char* label, short value) { field(name, label, (int)value); }
+    void field(const char*, const char*, int value) { char tmp[16]; m_out.append(tmp, sprintf(tmp, ",%d", value)); }
+    void field(const char*, const char*, float value) { char tmp[32]; m_out.append(','); m_out.append(tmp, format_float(value, tmp)); }
 
-enum { OPT_VERSION, OPT_USAGE, OPT_HELP, OPT_STDOUT, OPT_DUMP, OPT_DEFDETLIMLIB };
+private:
+
+    RecordBuffer& m_out;
+};
+
+enum { OPT_VERSION, OPT_USAGE, OPT_HELP, OPT_STDOUT, OPT_DUMP, OPT_DEFDETLIMLIB, OPT_PATCHDAT, OPT_RULE, OPT_RULES, OPT_FORMAT, OPT_STATS, OPT_ROI, OPT_SHARD, OPT_QUEUEDIR, OPT_JOURNAL, OPT_RESUME, OPT_READTHREADS, OPT_WRITETHREADS, OPT_MEMBUDGET, OPT_DIFF, OPT_VERIFY, OPT_OUTPUTDIR, OPT_BUNDLE, OPT_EXTRACT, OPT_CHECKREFS, OPT_SEARCHPATH, OPT_SORTBYTIME, OPT_ERRORREPORT, OPT_ORDER, OPT_SERVE, OPT_CONNECT, OPT_MERGEBY, OPT_CPU, OPT_PROGRESS, OPT_IOBYTES, OPT_IOOPS, OPT_IOINFLIGHT, OPT_IOLATENCY };
+
+enum { FORMAT_INP, FORMAT_DUMP, FORMAT_NDJSON, FORMAT_CSV };
 
 CSimpleOpt::SOption g_command_line_options[] =
 {
@@ -84,6 +691,38 @@ CSimpleOpt::SOption g_command_line_options[] =
     { OPT_STDOUT, 		("--stdout"), 							SO_NONE		},            
     { OPT_DUMP, 		("--dump"), 							SO_NONE		},
 	{ OPT_DEFDETLIMLIB,	("--default-detection-limit-library"),	SO_MULTI	},
+	{ OPT_PATCHDAT,		("--patch-dat"),						SO_NONE		},
+	{ OPT_RULE,			("--rule"),								SO_REQ_SEP	},
+	{ OPT_RULES,		("--rules"),							SO_REQ_SEP	},
+	{ OPT_FORMAT,		("--format"),							SO_REQ_SEP	},
+	{ OPT_STATS,		("--stats"),							SO_NONE		},
+	{ OPT_ROI,			("--roi"),								SO_REQ_SEP	},
+	{ OPT_SHARD,		("--shard"),							SO_REQ_SEP	},
+	{ OPT_QUEUEDIR,		("--queue-dir"),						SO_REQ_SEP	},
+	{ OPT_JOURNAL,		("--journal"),							SO_REQ_SEP	},
+	{ OPT_RESUME,		("--resume"),							SO_NONE		},
+	{ OPT_READTHREADS,	("--read-threads"),						SO_REQ_SEP	},
+	{ OPT_WRITETHREADS,	("--write-threads"),					SO_REQ_SEP	},
+	{ OPT_MEMBUDGET,	("--memory-budget"),					SO_REQ_SEP	},
+	{ OPT_DIFF,			("--diff"),								SO_NONE		},
+	{ OPT_VERIFY,		("--verify-roundtrip"),					SO_NONE		},
+	{ OPT_OUTPUTDIR,	("--output-dir"),						SO_REQ_SEP	},
+	{ OPT_BUNDLE,		("--bundle"),							SO_REQ_SEP	},
+	{ OPT_EXTRACT,		("--extract"),							SO_REQ_SEP	},
+	{ OPT_CHECKREFS,	("--check-references"),					SO_NONE		},
+	{ OPT_SEARCHPATH,	("--search-path"),						SO_REQ_SEP	},
+	{ OPT_SORTBYTIME,	("--sort-by-time"),						SO_NONE		},
+	{ OPT_ERRORREPORT,	("--error-report"),						SO_REQ_SEP	},
+	{ OPT_ORDER,		("--order"),							SO_REQ_SEP	},
+	{ OPT_SERVE,		("--serve"),							SO_REQ_SEP	},
+	{ OPT_CONNECT,		("--connect"),							SO_REQ_SEP	},
+	{ OPT_MERGEBY,		("--merge-by"),							SO_REQ_SEP	},
+	{ OPT_CPU,			("--cpu"),								SO_REQ_SEP	},
+	{ OPT_PROGRESS,		("--progress"),							SO_NONE		},
+	{ OPT_IOBYTES,		("--io-bytes"),							SO_REQ_SEP	},
+	{ OPT_IOOPS,		("--io-ops"),							SO_REQ_SEP	},
+	{ OPT_IOINFLIGHT,	("--io-in-flight"),						SO_REQ_SEP	},
+	{ OPT_IOLATENCY,	("--io-latency"),						SO_REQ_SEP	},
     SO_END_OF_OPTIONS
 };
 
@@ -103,9 +742,46 @@ int main(int argc, char **argv)
     // PROCESS COMMAND LINE OPTIONS    
     
     bool use_stdout = false;    
-    bool use_dump = false;    
-	bool has_defdetlimlib = false;
-	string defdetlimlib = "";
+	int format = FORMAT_INP;
+	bool use_patchdat = false;
+	bool use_diff = false;
+	bool use_verify = false;
+	bool use_check_refs = false;
+	bool use_sort = false;
+	RecordSorter sorter;
+	ReferenceCache references;
+	string missing_references;
+	unsigned int files_missing_references = 0;
+	bool use_stats = false;
+	unsigned int shard_index = 0, shard_count = 1;
+	const char* queue_dir = 0;
+	const char* journal_file = 0;
+	bool use_resume = false;
+	unsigned int read_threads = 1;
+	unsigned int write_threads = 1;
+	size_t memory_budget = 64 * 1024 * 1024;
+	vector<SpectrumROI> rois;
+	SpectrumROI roi;
+	vector<Rule> rules;
+	Rule rule;
+	string rule_error;
+	OutputDir output;
+	bool use_output_dir = false;
+	const char* bundle_file = 0;
+	vector<const char*> extract_names;
+	const char* error_report = 0;
+	int read_order = ORDER_LISTING;
+	bool use_progress = false;
+	ProgressReporter progress;
+	double io_bytes = 0.0, io_ops = 0.0;
+	unsigned int io_in_flight = 0, io_latency = 0;
+	IoLimiter limiter;
+	const char* serve_pipe = 0;
+	const char* connect_pipe = 0;
+	vector<const IO_Field*> merge_fields;
+	MergeGroups groups;
+	int cpu_level = detect_cpu_level();
+	int cpu_supported = cpu_level;
     
     CSimpleOpt args(argc, argv, g_command_line_options);               
     
@@ -124,420 +800,2193 @@ int main(int argc, char **argv)
 			case OPT_HELP:	      
 			case OPT_USAGE: print_usage(cout); return 0;
 			case OPT_STDOUT: use_stdout = true; break;	    
-			case OPT_DUMP: use_dump = true; break;	    
-			case OPT_DEFDETLIMLIB: 
-				char **margs = args.MultiArg(1);
-				if(!margs)
+			case OPT_DUMP: format = FORMAT_DUMP; break;	    
+			case OPT_FORMAT:
+				if(!strcmp(args.OptionArg(), "inp")) format = FORMAT_INP;
+				else if(!strcmp(args.OptionArg(), "dump")) format = FORMAT_DUMP;
+				else if(!strcmp(args.OptionArg(), "ndjson")) format = FORMAT_NDJSON;
+				else if(!strcmp(args.OptionArg(), "csv")) format = FORMAT_CSV;
+				else
 				{
+					cerr << "Unknown format: " << args.OptionArg() << "\n\n";
 					print_usage(cerr);
 					return 1;
 				}
-				defdetlimlib = margs[0];
-				has_defdetlimlib = true;
-				break;	    
-		}
-    }        
-    
-    if(args.FileCount())
-    {
-		print_usage(cerr);
-		return 1;
-    }
-    
-    // HEADER AND DATA STRUCTURE DECLARATIONS    
-        
-    IO_Header io;    
-    vector<string> files, error_messages;
-	vector<unsigned int> file_sizes;    
-	unsigned int processed_files = 0, max_file_size = 0;            
-	WIN32_FIND_DATA FindFileData;
-	HANDLE hFind = INVALID_HANDLE_VALUE;
-	DWORD dwError;		
-	string dir = ".\\*.DAT";		
-	
-	hFind = FindFirstFile(dir.c_str(), &FindFileData);
-	if (hFind == INVALID_HANDLE_VALUE) 	
-	{
-		clog << "No .DAT files found in current directory. Exiting..." << endl;
-	    return 0;	
-	}
-		
-	files.push_back(FindFileData.cFileName);	
-	file_sizes.push_back((unsigned int)FindFileData.nFileSizeLow);
-	max_file_size = (unsigned int)FindFileData.nFileSizeLow > max_file_size ? (unsigned int)FindFileData.nFileSizeLow : max_file_size;
-      	
-	while (FindNextFile(hFind, &FindFileData) != 0) 	
-	{
-		files.push_back(FindFileData.cFileName);	
-		file_sizes.push_back((unsigned int)FindFileData.nFileSizeLow);
-		max_file_size = (unsigned int)FindFileData.nFileSizeLow > max_file_size ? (unsigned int)FindFileData.nFileSizeLow : max_file_size;
-	}
-    
-	dwError = GetLastError();
-	FindClose(hFind);
-	if (dwError != ERROR_NO_MORE_FILES) 	
-	{
-		cerr << "Failed reading directory " + dir << endl;
-		return 1;
-	}
-    
-	char *buffer = new (nothrow) char[max_file_size + 1];
-	if(!buffer)
-	{
-		cerr << "Failed to allocate buffer[" << max_file_size + 1 << "]" << endl;
-		return 1;
-	}
-	else clog << "Allocated buffer[" << max_file_size + 1 << "]" << endl;	
-
-    // PROCESS EACH DAT FILE    
-    
-	for(unsigned int i=0; i<files.size(); i++)
-    {	
-		memset((void*)&io, 0, sizeof(io));    
-		memset((void*)buffer, 0, sizeof(buffer));				
-		
-		// READ THE DAT FILE INTO A BUFFER	
-	
-		ifstream fio(files[i].c_str(), fstream::binary);        
-		if(!fio.good())
-		{			
-			error_messages.push_back("UNABLE TO OPEN FILE: " + files[i]);
-			continue;
-		}			
-
-		if(!fio.read(buffer, file_sizes[i]))
-		{
-			fio.close();
-			error_messages.push_back("UNABLE TO READ FILE: " + files[i]);
-			continue;
-		}
-		fio.close();							
-	
-		// FILL THE IO_Header STRUCTURE WITH DATA EXTRACTED FROM THE DAT BUFFER	
-		
-		extract_string(buffer, io.spectrum_identifier);				
-		extract_string(buffer + 5, io.sample_identifier);					
-		extract_string(buffer + 46, io.project);					
-		extract_string(buffer + 51, io.sample_location);					
-		io.latitude = convert<float>(buffer + 82);				
-		io.latitude_unit = *(buffer + 86);			
-		io.longitude = convert<float>(buffer + 87);				
-		io.longitude_unit = *(buffer + 91);					
-		io.sample_height = convert<float>(buffer + 92);						
-		io.sample_weight = convert<float>(buffer + 96);				
-		io.sample_density = convert<float>(buffer + 100);			
-		io.sample_volume = convert<float>(buffer + 104);					
-		io.sample_quantity = convert<float>(buffer + 108);			
-		io.sample_uncertainty = convert<float>(buffer + 112);					
-		extract_string(buffer + 128, io.sampling_start);		
-		extract_string(buffer + 141, io.sampling_stop);		
-		extract_string(buffer + 154, io.reference_time);		
-		extract_string(buffer + 167, io.measurement_start);		
-		extract_string(buffer + 180, io.measurement_stop);		
-		io.FWHMPS = convert<float>(buffer + 245);			
-		io.FWHMAN = convert<float>(buffer + 249);			
-		io.THRESH = convert<float>(buffer + 253);			
-		io.BSTF = convert<float>(buffer + 257);			
-		io.ETOL = convert<float>(buffer + 261);			
-		io.LOCH = convert<float>(buffer + 265);				
-		io.ICA = convert<short>(buffer + 269);							
-		io.real_time = convert<int>(buffer + 193);				
-		io.live_time = convert<int>(buffer + 197);								
-		io.measurement_time = convert<int>(buffer + 201);									
-		io.dead_time = (float)io.real_time - io.live_time;
-		io.dead_time /= (float)io.live_time;
-		io.dead_time *= 100.0f;		
-		extract_string(buffer + 116, io.sample_unit);			
-		extract_string(buffer + 119, io.detector_identifier);			
-		extract_string(buffer + 122, io.year);			
-		extract_string(buffer + 125, io.beaker_identifier);		
-		extract_string(buffer + 209, io.nuclide_library);	
-		extract_string(buffer + 222, io.lim_file);
-		if(!strlen(io.lim_file) && has_defdetlimlib)
-			strcpy(io.lim_file, defdetlimlib.c_str());
-		extract_string(buffer + 271, io.energy_file);	
-		extract_string(buffer + 284, io.pef_file);	
-		extract_string(buffer + 297, io.tef_file);	
-		extract_string(buffer + 310, io.background_file);	
-		io.channel_count = convert<int>(buffer + 235);						
-		extract_string(buffer + 239, io.format);	
-		io.record_length = convert<int>(buffer + 243);						
-	
-		io.PA1 = convert<int>(buffer + 323);		
-		io.PA2 = convert<int>(buffer + 327);		
-		io.PA3 = convert<int>(buffer + 331);		
-		io.PA4 = convert<int>(buffer + 335);		
-		io.PA5 = convert<int>(buffer + 339);		
-		io.PA6 = convert<int>(buffer + 343);		
-	
-		io.print_out = convert<short>(buffer + 347);		
-		io.plot_out = convert<short>(buffer + 349);		
-		io.disk_out = convert<short>(buffer + 351);		
-		io.ex_print_out = convert<short>(buffer + 353);		
-		io.ex_disk_out = convert<short>(buffer + 355);		
-	
-		io.PO1 = convert<int>(buffer + 357);		
-		io.PO2 = convert<int>(buffer + 361);		
-		io.PO3 = convert<int>(buffer + 365);		
-		io.PO4 = convert<int>(buffer + 369);		
-		io.PO5 = convert<int>(buffer + 373);		
-		io.PO6 = convert<int>(buffer + 377);		
-	
-		io.complete = convert<short>(buffer + 381);		
-		io.analysed = convert<short>(buffer + 383);		
-	
-		io.ST1 = convert<int>(buffer + 385);		
-		io.ST2 = convert<int>(buffer + 387);		
-		io.ST3 = convert<int>(buffer + 389);		
-		io.ST4 = convert<int>(buffer + 391);		
-		io.ST5 = convert<int>(buffer + 393);		
-		io.ST6 = convert<int>(buffer + 395);				
-	
-		// WRITE RESULTS BASED ON COMMAND LINE OPTIONS	
-		
-		if(use_dump)
-			dump(io, cout);	
-		else if(use_stdout)
-			generate_inp(io, cout);
-		else
-		{
-			string fname = files[i].substr(0, files[i].length() - 4) + ".INP";
-			ofstream out(fname.c_str(), fstream::binary);
-			if(!out.good())
-			{
-				cerr << "FAILED TO OPEN FILE FOR WRITING: " << fname << endl;
-				return 1;
-			}
-			generate_inp(io, out);
-			out.close();
-		}		
+				break;
+			case OPT_PATCHDAT: use_patchdat = true; break;
+			case OPT_DIFF: use_diff = true; break;
+			case OPT_VERIFY: use_verify = true; break;
+			case OPT_CHECKREFS: use_check_refs = true; break;
+			case OPT_SORTBYTIME: use_sort = true; break;
+			case OPT_PROGRESS: use_progress = true; break;
+			case OPT_IOBYTES:
+			case OPT_IOOPS:
+				if(!parse_rate(args.OptionArg(), args.OptionId() == OPT_IOBYTES ? io_bytes : io_ops))
+				{
+					cerr << "Invalid rate: " << args.OptionArg() << "\n\n";
+					print_usage(cerr);
+					return 1;
+				}
+				break;
+			case OPT_IOINFLIGHT:
+				io_in_flight = (unsigned int)atoi(args.OptionArg());
+				if(io_in_flight < 1)
+				{
+					cerr << "Invalid number of operations in flight: " << args.OptionArg() << "\n\n";
+					print_usage(cerr);
+					return 1;
+				}
+				break;
+			case OPT_IOLATENCY:
+				io_latency = (unsigned int)atoi(args.OptionArg());
+				if(io_latency < 1)
+				{
+					cerr << "Invalid latency: " << args.OptionArg() << "\n\n";
+					print_usage(cerr);
+					return 1;
+				}
+				break;
+			case OPT_SEARCHPATH:
+				references.add_directories(args.OptionArg());
+				use_check_refs = true;
+				break;
+			case OPT_STATS: use_stats = true; break;
+			case OPT_SHARD:
+				if(!parse_shard(args.OptionArg(), shard_index, shard_count))
+				{
+					cerr << "Invalid shard: " << args.OptionArg() << "\n\n";
+					print_usage(cerr);
+					return 1;
+				}
+				break;
+			case OPT_READTHREADS:
+				read_threads = (unsigned int)atoi(args.OptionArg());
+				if(read_threads < 1 || read_threads > 64)
+				{
+					cerr << "Invalid number of read threads: " << args.OptionArg() << "\n\n";
+					print_usage(cerr);
+					return 1;
+				}
+				break;
+			case OPT_WRITETHREADS:
+				write_threads = (unsigned int)atoi(args.OptionArg());
+				if(!isdigit((unsigned char)args.OptionArg()[0]) || write_threads > 64)
+				{
+					cerr << "Invalid number of write threads: " << args.OptionArg() << "\n\n";
+					print_usage(cerr);
+					return 1;
+				}
+				break;
+			case OPT_MEMBUDGET:
+				memory_budget = (size_t)atoi(args.OptionArg());
+				if(!memory_budget || memory_budget > LONG_MAX)
+				{
+					cerr << "Invalid memory budget: " << args.OptionArg() << "\n\n";
+					print_usage(cerr);
+					return 1;
+				}
+				// The pipeline counts reserved bytes in a LONG, budgets of 2 GB and up are clamped
+				memory_budget = memory_budget < LONG_MAX / (1024 * 1024) ? memory_budget * 1024 * 1024 : LONG_MAX;
+				break;
+			case OPT_JOURNAL: journal_file = args.OptionArg(); break;
+			case OPT_BUNDLE: bundle_file = args.OptionArg(); break;
+			case OPT_ERRORREPORT: error_report = args.OptionArg(); break;
+			case OPT_SERVE: serve_pipe = args.OptionArg(); break;
+			case OPT_CONNECT: connect_pipe = args.OptionArg(); break;
+			case OPT_CPU:
+				cpu_level = strcmp(args.OptionArg(), "auto") ? find_cpu_level(args.OptionArg()) : cpu_supported;
+				if(cpu_level < 0)
+				{
+					cerr << "Invalid cpu level: " << args.OptionArg() << "\n\n";
+					print_usage(cerr);
+					return 1;
+				}
+				if(cpu_level > cpu_supported)
+				{
+					cerr << "This processor does not support " << args.OptionArg() << ", the highest level is " << cpu_level_name(cpu_supported) << endl;
+					return 1;
+				}
+				break;
+			case OPT_MERGEBY:
+				if(!parse_merge_fields(args.OptionArg(), merge_fields, rule_error))
+				{
+					cerr << rule_error << "\n\n";
+					print_usage(cerr);
+					return 1;
+				}
+				break;
+			case OPT_ORDER:
+				if(!strcmp(args.OptionArg(), "listing")) read_order = ORDER_LISTING;
+				else if(!strcmp(args.OptionArg(), "index")) read_order = ORDER_INDEX;
+				else if(!strcmp(args.OptionArg(), "extent")) read_order = ORDER_EXTENT;
+				else
+				{
+					cerr << "Unknown order: " << args.OptionArg() << "\n\n";
+					print_usage(cerr);
+					return 1;
+				}
+				break;
+			case OPT_EXTRACT: extract_names.push_back(args.OptionArg()); break;
+			case OPT_RESUME: use_resume = true; break;
+			case OPT_QUEUEDIR:
+				queue_dir = args.OptionArg();
+				if(!CreateDirectory(queue_dir, NULL) && GetLastError() != ERROR_ALREADY_EXISTS)
+				{
+					cerr << "Unable to create queue directory " << queue_dir << endl;
+					return 1;
+				}
+				break;
+			case OPT_ROI:
+				if(!parse_roi(args.OptionArg(), roi))
+				{
+					cerr << "Invalid region of interest: " << args.OptionArg() << "\n\n";
+					print_usage(cerr);
+					return 1;
+				}
+				rois.push_back(roi);
+				use_stats = true;
+				break;
+			case OPT_OUTPUTDIR:
+				if(!compile_output_dir(args.OptionArg(), output, rule_error))
+				{
+					cerr << rule_error << "\n\n";
+					print_usage(cerr);
+					return 1;
+				}
+				use_output_dir = true;
+				break;
+			case OPT_RULE:
+				if(!compile_rule(args.OptionArg(), rule, rule_error))
+				{
+					cerr << rule_error << "\n\n";
+					print_usage(cerr);
+					return 1;
+				}
+				rules.push_back(rule);
+				break;
+			case OPT_RULES:
+				if(!load_rules(args.OptionArg(), rules, rule_error))
+				{
+					cerr << rule_error << endl;
+					return 1;
+				}
+				break;
+			case OPT_DEFDETLIMLIB: 
+				char **margs = args.MultiArg(1);
+				if(!margs)
+				{
+					print_usage(cerr);
+					return 1;
+				}
+				if(!compile_rule(string("default:lim_file=") + margs[0], rule, rule_error))
+				{
+					cerr << rule_error << "\n\n";
+					print_usage(cerr);
+					return 1;
+				}
+				rules.push_back(rule);
+				break;	    
+		}
+    }        
+    
+    if(args.FileCount())
+    {
+		print_usage(cerr);
+		return 1;
+    }
+
+	// INSTALL THE CHANNEL AND HEADER KERNELS FOR THE PROCESSOR, OR THE LEVEL GIVEN WITH --cpu
+
+	select_spectrum_kernels(cpu_level);
+	select_header_kernels(cpu_level);
+
+	if(use_patchdat)
+		return patch_dat_files(error_report);
+
+	if(use_diff && (journal_file || queue_dir))
+	{
+		cerr << "--diff never writes any files and can not be combined with --journal or --queue-dir\n\n";
+		print_usage(cerr);
+		return 1;
+	}
+
+	if(!extract_names.empty())
+	{
+		if(!bundle_file)
+		{
+			cerr << "--extract needs the --bundle to extract from\n\n";
+			print_usage(cerr);
+			return 1;
+		}
+		return extract_inp(bundle_file, extract_names);
+	}
+
+	if(serve_pipe)
+	{
+		clog << "Serving conversions on " << serve_pipe << " with " << read_threads << " threads" << endl;
+		ConversionServer server;
+		if(!server.run(serve_pipe, read_threads, serve_convert, &rules))
+		{
+			cerr << "Unable to serve on " << serve_pipe << endl;
+			return 1;
+		}
+		return 0;
+	}
+
+	if(connect_pipe)
+	{
+		if(format != FORMAT_INP && format != FORMAT_NDJSON)
+		{
+			cerr << "--connect only receives the inp and ndjson formats\n\n";
+			print_usage(cerr);
+			return 1;
+		}
+		return request_conversions(connect_pipe, format == FORMAT_NDJSON ? SERVE_FIELDS : SERVE_INP, error_report);
+	}
+
+	if(bundle_file && (use_diff || use_output_dir || journal_file || use_stdout || use_stats || format != FORMAT_INP))
+	{
+		cerr << "--bundle only holds INP files and can not be combined with --diff, --output-dir, --journal, --stdout, --stats or --format\n\n";
+		print_usage(cerr);
+		return 1;
+	}
+
+	if(io_latency && io_bytes == 0.0 && io_ops == 0.0)
+	{
+		cerr << "--io-latency lowers the --io-bytes and --io-ops limits and needs at least one of them\n\n";
+		print_usage(cerr);
+		return 1;
+	}
+
+	bool use_merge = !merge_fields.empty();
+	if(use_merge && (!use_output_dir || use_diff || bundle_file || journal_file || use_stdout || use_stats || use_sort || format != FORMAT_INP))
+	{
+		cerr << "--merge-by writes merged DAT and INP files to the --output-dir and can not be combined with\n";
+		cerr << "--diff, --bundle, --journal, --stdout, --stats, --sort-by-time or --format\n\n";
+		print_usage(cerr);
+		return 1;
+	}
+
+	// THE MERGED FILES ARE NAMED AFTER THE FIRST FILE OF THEIR GROUP AND WOULD REPLACE
+	// IT IN THE INPUT DIRECTORY. A DIRECTORY WITH FIELDS IS CHECKED AGAIN PER GROUP
+
+	if(use_merge)
+	{
+		IO_Header empty;
+		char merge_dir[MAX_PATH + 1];
+		memset((void*)&empty, 0, sizeof(empty));
+		size_t len = expand_output_dir(output, empty, merge_dir);
+		if(len && is_input_dir(merge_dir, len))
+		{
+			cerr << "--merge-by can not write the merged files to the input directory\n\n";
+			print_usage(cerr);
+			return 1;
+		}
+	}
+
+	bool to_files = use_diff || (format == FORMAT_INP && !use_stdout && !bundle_file);
+	bool to_stdout = !use_diff && (use_stdout || format != FORMAT_INP);
+	if(use_sort && !to_stdout)
+	{
+		cerr << "--sort-by-time only orders output written to standard output\n\n";
+		print_usage(cerr);
+		return 1;
+	}
+
+	// WITH --sort-by-time THE SORTER AND THE READ PIPELINE SHARE THE BUDGET HALF EACH
+
+	size_t read_budget = memory_budget;
+	if(use_sort)
+	{
+		read_budget = memory_budget / 2;
+		sorter.init(memory_budget - read_budget);
+	}
+
+	if(use_output_dir && !to_files)
+	{
+		cerr << "--output-dir only applies when INP files are written\n\n";
+		print_usage(cerr);
+		return 1;
+	}
+
+	if(use_resume && !journal_file)
+	{
+		cerr << "--resume needs a --journal to resume from\n\n";
+		print_usage(cerr);
+		return 1;
+	}
+    
+    // HEADER AND DATA STRUCTURE DECLARATIONS    
+        
+    IO_Header io;    
+    ErrorReport errors;
+	RecordBuffer record;
+	Journal journal;
+	SpectrumStats stats;
+	const char* channels;
+	unsigned int processed_files = 0, claimed_elsewhere = 0, resumed_files = 0, changed_files = 0, new_files = 0, merged_groups = 0;            
+	char fname[MAX_PATH + 1];
+	ListingFilter listing;
+	const char* dir = ".\\*.DAT";		
+
+	BundleWriter bundle;
+	if(bundle_file && !bundle.open(bundle_file))
+	{
+		cerr << "Unable to open bundle " << bundle_file << endl;
+		return 1;
+	}
+
+	if(journal_file)
+	{
+		if(use_resume)
+		{
+			journal.load(journal_file);
+			clog << "Resuming from " << journal.count() << " journaled files" << endl;
+		}
+		if(!journal.open(journal_file))
+		{
+			cerr << "Unable to open journal " << journal_file << endl;
+			return 1;
+		}
+	}
+	
+	// START THE READER THREADS, THEY LIST THE DIRECTORY AS THEY GO
+
+	listing.shard_index = shard_index;
+	listing.shard_count = shard_count;
+
+	ReadPipeline pipeline;
+	pipeline.set_order(read_order);
+	limiter.init(io_bytes, io_ops, io_in_flight, io_latency);
+	pipeline.set_limiter(&limiter);
+	if(!pipeline.start(dir, read_threads, read_budget, queue_dir, accept_file, &listing))
+	{
+		cerr << "Failed to start " << read_threads << " readers" << endl;
+		return 1;
+	}
+
+	if(!pipeline.found_files()) 	
+	{
+		clog << "No .DAT files found in current directory. Exiting..." << endl;
+	    return 0;	
+	}
+	else if(!pipeline.reader_threads())
+		clog << "Unable to start reader threads, reading on the converting thread" << endl;
+	else clog << "Reading with " << pipeline.reader_threads() << " threads within " << read_budget / (1024 * 1024) << " MB" << endl;	
+
+	// ONE READER KEEPS ONE READ IN FLIGHT, THE ORDER CUTS SEEKS BUT DOES NOT OVERLAP READS
+	if(read_order != ORDER_LISTING && read_threads < 2)
+		clog << "One reader thread reads one file at a time, use --read-threads 2 or more to overlap reads" << endl;
+
+	// THE PROGRESS REPORTS TAKE THE PLACE OF THE LINE PER CONVERTED FILE. THE
+	// REPORTER COUNTS THE FILES FOR THE TIME LEFT WHILE THE READERS GO ON
+
+	// THE INP FILES ARE FORMATTED AND WRITTEN BY THE WRITER THREADS
+
+	WritePipeline writer;
+	bool use_writer = to_files && !use_diff && !use_merge;
+	if(use_writer)
+	{
+		writer.set_limiter(&limiter);
+		if(!writer.start(write_threads, format_write_slot))
+		{
+			cerr << "Failed to start " << write_threads << " writers" << endl;
+			return 1;
+		}
+		if(write_threads && !writer.writer_threads())
+			clog << "Unable to start writer threads, writing on the converting thread" << endl;
+		else if(write_threads)
+			clog << "Writing with " << writer.writer_threads() << " threads" << endl;
+	}
+
+	if(use_progress && !progress.start(dir, accept_file, &listing))
+		cerr << "Unable to start the progress reporter" << endl;
+
+	if(format == FORMAT_NDJSON || format == FORMAT_CSV)
+	{
+		setvbuf(stdout, 0, _IOFBF, 1 << 20);
+		if(format == FORMAT_CSV)
+		{
+			format_csv_header(use_stats ? &rois : 0, record);
+			fwrite(record.data(), 1, record.size(), stdout);
+		}
+	}
+
+    // PROCESS EACH DAT FILE AS SOON AS IT HAS BEEN READ. THE FILE IS COUNTED
+    // IN THE LOOP STEP, WHICH ALSO RUNS ON continue, SO ITS OWN ERRORS ARE IN
+    // THE COUNT THE PROGRESS REPORT SHOWS
+    
+	const ReadSlot* slot;
+	for(slot = pipeline.next(); slot != 0; progress.file_done(slot->size, errors.count()), slot = pipeline.next())
+    {	
+		const char* name = slot->name;
+		const char* buffer = slot->data;
+		memset((void*)&io, 0, sizeof(io));    
+
+		switch(slot->status)
+		{
+			case READ_CLAIMED:
+				++claimed_elsewhere;
+				continue;
+			case READ_OPEN_FAILED:
+				errors.add(ERROR_OPEN, "UNABLE TO OPEN FILE: ", name);
+				continue;
+			case READ_SHORT:
+				errors.add(ERROR_READ, "UNABLE TO READ FILE: ", name);
+				continue;
+			case READ_NO_MEMORY:
+				errors.add(ERROR_READ, "UNABLE TO ALLOCATE BUFFER FOR FILE: ", name);
+				continue;
+		}
+
+		// SKIP THE FILES THE JOURNAL HAS WITH THE SAME SIZE AND CONTENTS
+
+		unsigned __int64 dat_hash = journal_file ? hash_bytes(buffer, slot->size) : 0;
+		if(use_resume && journal.contains(name, slot->size, dat_hash))
+		{
+			++resumed_files;
+			continue;
+		}
+	
+		// FILL THE IO_Header STRUCTURE WITH DATA EXTRACTED FROM THE DAT BUFFER	
+		
+		if(!decode_header(buffer, slot->size, io))
+		{
+			errors.add(ERROR_DECODE, "FILE TOO SHORT FOR A DAT HEADER: ", name);
+			continue;
+		}
+
+		if(use_verify)
+		{
+			const IO_Field* field = verify_roundtrip(buffer, io);
+			if(field)
+				errors.add(ERROR_DECODE, (string("ROUND TRIP CHANGES ") + field->name + " IN FILE: ").c_str(), name);
+		}
+
+		apply_rules(rules, io);
+
+		// CHECK THAT THE FILES THE HEADER REFERS TO CAN BE FOUND
+
+		if(use_check_refs && !check_references(io, references, missing_references))
+		{
+			errors.add(ERROR_REFERENCE, ("MISSING REFERENCED FILES " + missing_references + " FOR FILE: ").c_str(), name);
+			++files_missing_references;
+		}
+
+		// WITH --merge-by THE SPECTRUM IS ADDED TO ITS GROUP AND THE GROUPS ARE
+		// WRITTEN WHEN ALL FILES ARE READ
+
+		if(use_merge)
+		{
+			switch(merge_spectrum(merge_fields, name, buffer, slot->size, io, groups))
+			{
+				case MERGE_NO_SPECTRUM:
+					errors.add(ERROR_DECODE, "NO SPECTRUM FOUND IN FILE: ", name);
+					continue;
+				case MERGE_CHANNELS_DIFFER:
+					errors.add(ERROR_DECODE, "CHANNEL COUNT DIFFERS FROM ITS MERGE GROUP IN FILE: ", name);
+					continue;
+			}
+			++processed_files;
+			continue;
+		}
+
+		// COMPUTE SPECTRUM STATISTICS IF REQUESTED
+
+		channels = 0;
+		if(use_stats)
+		{
+			channels = locate_spectrum(buffer, slot->size, io);
+			if(channels)
+				compute_stats(channels, io, rois, stats);
+			else errors.add(ERROR_DECODE, "NO SPECTRUM FOUND IN FILE: ", name);
+		}
+	
+		// WRITE RESULTS BASED ON COMMAND LINE OPTIONS	
+		
+		unsigned int out_size = 0;
+		// THE OUTPUT PATH WITHOUT EXTENSION IS BUILT IN THE REUSED fname BUFFER,
+		// PREFIXED BY THE OUTPUT DIRECTORY WHEN ONE IS GIVEN
+
+		unsigned int len = 0;
+		if(to_files)
+		{
+			if(use_output_dir)
+			{
+				len = (unsigned int)expand_output_dir(output, io, fname);
+				if(!len || (!use_diff && !make_output_dir(output, fname, len)))
+				{
+					errors.add(ERROR_WRITE, "UNABLE TO CREATE OUTPUT DIRECTORY FOR FILE: ", name);
+					continue;
+				}
+			}
+
+			unsigned int stem = (unsigned int)strlen(name) - 4;
+			if(len + stem + 5 > MAX_PATH)
+			{
+				errors.add(ERROR_WRITE, "OUTPUT PATH TOO LONG FOR FILE: ", name);
+				continue;
+			}
+			memcpy(fname + len, name, stem);
+			len += stem;
+		}
+
+		if(use_diff)
+		{
+			memcpy(fname + len, ".INP", 5);
+
+			record.clear();
+			generate_inp(io, record);
+			int changes = diff_inp(fname, record.data(), record.size(), cout);
+			if(changes == DIFF_OPEN_FAILED)
+				errors.add(ERROR_OPEN, "UNABLE TO OPEN INP FILE: ", fname);
+			else if(changes == DIFF_READ_FAILED)
+				errors.add(ERROR_READ, "UNABLE TO READ INP FILE: ", fname);
+			else if(changes == DIFF_NEW_FILE)
+				++new_files;
+			else if(changes)
+				++changed_files;
+			++processed_files;
+			continue;
+		}
+		else if(format == FORMAT_DUMP)
+		{
+			record.clear();
+			dump(io, record);
+			if(channels)
+				write_stats(stats, record);
+		}
+		else if(format == FORMAT_NDJSON || format == FORMAT_CSV)
+		{
+			record.clear();
+			if(format == FORMAT_NDJSON)
+				format_ndjson(name, io, channels ? &stats : 0, record);
+			else format_csv(name, io, use_stats ? &rois : 0, channels ? &stats : 0, record);
+			out_size = (unsigned int)record.size();
+		}
+		else if(bundle_file)
+		{
+			record.clear();
+			generate_inp(io, record);
+			out_size = (unsigned int)record.size();
+			__int64 started = limiter.begin(out_size);
+			bool added = bundle.add(name, record.data(), out_size, hash_bytes(record.data(), out_size));
+			limiter.end(IO_WRITE, started);
+			if(!added)
+			{
+				errors.add(ERROR_WRITE, "FAILED WRITING TO BUNDLE THE FILE: ", name);
+				continue;
+			}
+		}
+		else if(use_stdout)
+		{
+			record.clear();
+			generate_inp(io, record);
+			if(channels)
+				write_stats(stats, record);
+		}
+		else
+		{
+			// THE SLOTS THE WRITERS ARE DONE WITH ARE REPORTED FIRST, WHEN ALL
+			// SLOTS ARE TAKEN THE CONVERSION WAITS FOR THE WRITERS TO CATCH UP.
+			// WITH A JOURNAL THE INP IS WRITTEN UNDER A TEMPORARY NAME AND RENAMED
+			// WHEN COMPLETE, SO AN INTERRUPTED RUN NEVER LEAVES A TRUNCATED INP BEHIND
+
+			WriteSlot* queued;
+			unsigned int spins = 0;
+			report_written(writer, errors, journal_file ? &journal : 0, use_progress, processed_files);
+			while((queued = writer.acquire()) == 0)
+			{
+				if(!report_written(writer, errors, journal_file ? &journal : 0, use_progress, processed_files))
+					backoff(spins);
+			}
+
+			strcpy(queued->name, name);
+			queued->size = slot->size;
+			queued->hash = dat_hash;
+			memcpy(queued->path, fname, len);
+			queued->length = len;
+			queued->use_temp = journal_file != 0;
+			queued->io = io;
+			queued->has_stats = channels != 0;
+			if(channels)
+				queued->stats = stats;
+			writer.submit();
+			continue;
+		}
+
+		// RECORDS FOR STANDARD OUTPUT ARE WRITTEN AS THEY COME, OR HELD BACK AND
+		// ORDERED BY MEASUREMENT START WHEN SORTING. FILES WITHOUT A VALID TIME
+		// ARE WRITTEN LAST
+
+		if(to_stdout)
+		{
+			if(use_sort)
+			{
+				__int64 measured;
+				if(!parse_timestamp(io.measurement_start, measured))
+					measured = 0x7FFFFFFFFFFFFFFFLL;
+				// A FAILED SPILL IS REPORTED ONCE, THE RECORDS ADDED SO FAR ARE STILL WRITTEN
+
+				if(!sorter.add(measured, record.data(), record.size()))
+				{
+					errors.add(ERROR_WRITE, "FAILED TO WRITE TEMPORARY FILE FOR SORTING, STOPPED AT FILE: ", name);
+					break;
+				}
+			}
+			else fwrite(record.data(), 1, record.size(), stdout);
+		}		
+
+		if(journal_file)
+			journal.add(name, slot->size, dat_hash, out_size);
+
+		++processed_files;
+		if(!use_progress)
+			clog << name << " converted successfully" << endl;
+    }   
+
+	pipeline.stop();
+	writer.flush();
+	report_written(writer, errors, journal_file ? &journal : 0, use_progress, processed_files);
+	writer.stop();
+	progress.set_errors(errors.count());
+	progress.stop();
+
+	// WRITE ONE MERGED DAT AND INP FILE PER GROUP, NAMED AFTER THE FIRST FILE OF THE GROUP
+
+	for(MergeGroups::iterator it = groups.begin(); it != groups.end(); ++it)
+	{
+		MergeGroup& group = it->second;
+		const char* name = group.name.c_str();
+
+		unsigned int len = (unsigned int)expand_output_dir(output, group.io, fname);
+		if(!len || !make_output_dir(output, fname, len))
+		{
+			errors.add(ERROR_WRITE, "UNABLE TO CREATE OUTPUT DIRECTORY FOR MERGE GROUP OF FILE: ", name);
+			continue;
+		}
+		if(is_input_dir(fname, len))
+		{
+			errors.add(ERROR_WRITE, "OUTPUT DIRECTORY IS THE INPUT DIRECTORY FOR MERGE GROUP OF FILE: ", name);
+			continue;
+		}
+
+		unsigned int stem = (unsigned int)group.name.size() - 4;
+		if(len + stem + 5 > MAX_PATH)
+		{
+			errors.add(ERROR_WRITE, "OUTPUT PATH TOO LONG FOR MERGE GROUP OF FILE: ", name);
+			continue;
+		}
+		memcpy(fname + len, name, stem);
+		len += stem;
+
+		unsigned int clipped = 0;
+		bool clipped_times = false;
+		__int64 started = limiter.begin((unsigned int)(group.header.size() + group.sums.size() * sizeof(int)));
+		bool written = write_merged(group, fname, len, record, clipped, clipped_times);
+		limiter.end(IO_WRITE, started);
+		if(!written)
+		{
+			errors.add(ERROR_WRITE, "FAILED WRITING MERGED DAT AND INP FILE: ", fname);
+			continue;
+		}
+		if(clipped)
+		{
+			char count[16];
+			sprintf(count, "%u", clipped);
+			errors.add(ERROR_CLIPPED, (string("CLIPPED ") + count + " CHANNELS TO THE 32 BIT COUNT LIMIT IN MERGED FILE: ").c_str(), fname);
+		}
+		if(clipped_times)
+			errors.add(ERROR_CLIPPED, "CLIPPED THE REAL OR LIVE TIME TO THE 32 BIT LIMIT IN MERGED FILE: ", fname);
+
+		++merged_groups;
+		if(!use_progress)
+			clog << fname << " merged from " << group.files << " DAT files" << endl;
+	}
+
+	if(use_sort && !sorter.finish(stdout))
+		errors.add(ERROR_WRITE, "FAILED WRITING SORTED RECORDS", "");
+	if(fflush(stdout) || ferror(stdout))
+		errors.add(ERROR_WRITE, "FAILED WRITING TO STANDARD OUTPUT", "");
+
+	if(bundle_file && !bundle.close())
+		errors.add(ERROR_WRITE, "FAILED WRITING TO BUNDLE: ", bundle_file);
+	if(pipeline.listing_failed())
+		errors.add(ERROR_READ, "FAILED READING DIRECTORY ", dir);
+	journal.close();
+    
+    // PRINT STATUS INFORMATION
+    
+	for(unsigned int i=0; i<errors.count(); i++)
+		cerr << errors.message(i) << endl;
+	if(error_report && !write_error_report(errors, error_report))
+	{
+		cerr << "Unable to write error report " << error_report << endl;
+		errors.add(ERROR_WRITE, "FAILED WRITING ERROR REPORT: ", error_report);
+	}
+
+	if(use_diff)
+		clog << "Of " << processed_files << " DAT files, " << changed_files << " would change the existing INP file and " << new_files << " would write a new one" << endl;
+	else if(use_merge)
+		clog << "Of " << pipeline.accepted_files() - claimed_elsewhere - resumed_files << " DAT files, " << processed_files << " was merged into " << merged_groups << " files" << endl;
+	else clog << "Of " << pipeline.accepted_files() - claimed_elsewhere - resumed_files << " DAT files, " << processed_files << " was successfully converted" << endl;	
+	if(claimed_elsewhere)
+		clog << claimed_elsewhere << " DAT files was claimed by other processes" << endl;
+	if(use_check_refs)
+		clog << "Of " << references.checked() << " referenced files, " << references.missing() << " was not found, referenced by " << files_missing_references << " DAT files" << endl;
+	if(resumed_files)
+		clog << resumed_files << " DAT files was already converted according to the journal" << endl;
+    
+    return errors.classes();
+}
+
+//==================================================
+// FUNCTION TO WRITE VERSION INFORMATION    
+
+void print_version(ostream& out)
+{        
+    out << PROG_VERSION_MAJOR << "." << PROG_VERSION_MINOR;        
+}
+
+//==================================================
+// FUNCTION TO WRITE USAGE INFORMATION    
+
+void print_usage(ostream& out)
+{        
+    out << prog_name << " ";
+    print_version(out);
+    out << " - 2011 Dag Robole, Norwegian Radiation Protection Authority\n\n";
+    out << "This program is a utility program for gamma10.\n";
+    out << "It will convert any .DAT files in the current directory into .INP files.\n\n";        
+    out << "\t--version\n\t\tPrint version information and exit\n\n";
+    out << "\t--usage | --help\n\t\tPrint this message and exit\n\n";
+    out << "\t--stdout\n\t\tWrite results to standard output instead of .INP files\n\n";
+    out << "\t--dump\n\t\tWrite results to standard output instead of .INP files in debug friendly format\n\n";
+	out << "\t--format <inp|dump|ndjson|csv>\n\t\tSelect the output format. ndjson writes one JSON object per DAT file and csv writes\n";
+	out << "\t\tone row per DAT file after a header row, both to standard output\n\n";
+	out << "\t--default-detection-limit-library <filename>\n\t\tUse <filename> as the default detection limit library in DAT files\n";
+	out << "\t\twhere this field is empty.\n\t\tThe new version of gamma10 need a filename here so dont forget to supply it\n\n";
+	out << "\t--stats\n\t\tCompute total counts, peak channel, count rate and a " << SPECTRUM_PREVIEW_BINS << " bin preview of each spectrum.\n";
+	out << "\t\tThe statistics are written to a .STA file next to each .INP file, or added to the output\n";
+	out << "\t\twhen writing to standard output\n\n";
+	out << "\t--roi <first>:<last>\n\t\tAlso sum the counts of the channels <first> to <last>, implies --stats.\n";
+	out << "\t\tThis option can be repeated\n\n";
+	out << "\t--shard <index>/<count>\n\t\tOnly convert the DAT files whose name hashes to shard <index> of <count>, counting from 0.\n";
+	out << "\t\tRunning one process per shard converts every file exactly once\n\n";
+	out << "\t--queue-dir <directory>\n\t\tClaim each DAT file by creating a marker file in <directory> before converting it.\n";
+	out << "\t\tProcesses sharing <directory>, also across hosts on a shared file system, never\n";
+	out << "\t\tconvert the same file twice. Remove the directory to convert the files again\n\n";
+	out << "\t--journal <filename>\n\t\tAppend the name, size and hash of each converted DAT file to <filename>\n\n";
+	out << "\t--resume\n\t\tSkip the DAT files already recorded in the --journal, unless their size or contents have\n\t\tchanged. The files are still read to compare their hash\n\n";
+	out << "\t--read-threads <count>\n\t\tRead DAT files with <count> threads while converting, default is 1. Each thread\n";
+	out << "\t\thas one read in flight, so with the default the reads run next to the conversion but\n";
+	out << "\t\tone at a time. Overlapping reads with each other takes 2 or more\n\n";
+	out << "\t--write-threads <count>\n\t\tFormat and write the INP and STA files with <count> threads while converting, default is 1,\n";
+	out << "\t\tat most 64. Each thread has one file in flight, more threads overlap the file creation that\n";
+	out << "\t\tis slow on network shares. With 0 the files are written by the converting thread\n\n";
+	out << "\t--memory-budget <megabytes>\n\t\tLimit the memory used for DAT files read ahead of conversion, default is 64, at most 2047.\n\t\tWith --sort-by-time half of it is used for the records being sorted\n\n";
+	out << "\t--rule <operation>:<field>=<value>\n\t\tRewrite a header field during conversion. <operation> is one of\n";
+	out << "\t\tset      always store <value> in <field>\n";
+	out << "\t\tdefault  store <value> in <field> where it is empty or zero\n";
+	out << "\t\treplace  <value> is <old>/<new>, replace every occurrence of <old> in <field> with <new>\n";
+	out << "\t\t<field> is an IO_Header field name like nuclide_library or detector_identifier.\n";
+	out << "\t\tThis option can be repeated, rules are applied in the order given\n\n";
+	out << "\t--rules <filename>\n\t\tRead rules from <filename>, one per line. Lines starting with # are ignored\n\n";
+	out << "\t--diff\n\t\tCompare the INP each DAT file would give with the existing .INP file and list the fields\n";
+	out << "\t\tthat would change on standard output. No files are written\n\n";
+	out << "\t--verify-roundtrip\n\t\tCheck that every header survives being written back to a DAT header and to an INP\n";
+	out << "\t\tfile and read again unchanged, and report the first field that does not\n\n";
+	out << "\t--output-dir <directory>\n\t\tWrite the INP files to the given directory instead of next to the DAT files.\n";
+	out << "\t\tHeader fields in braces are filled in per file and missing directories are created,\n";
+	out << "\t\tfor example: --output-dir INP\\{detector_identifier}\\{year}\n\n";
+	out << "\t--bundle <file>\n\t\tWrite all INP files into one bundle file with an index sorted by DAT name\n\n";
+	out << "\t--extract <DAT file>\n\t\tWrite the INP of the given DAT file from the --bundle to standard output.\n";
+	out << "\t\tCan be given more than once\n\n";
+	out << "\t--check-references\n\t\tCheck that the library and calibration files named in each DAT header exist,\n";
+	out << "\t\tand list the DAT files referring to missing files\n\n";
+	out << "\t--search-path <directory>[;<directory>...]\n\t\tLook for the referenced files in these directories instead of the current one,\n";
+	out << "\t\timplies --check-references\n\n";
+	out << "\t--sort-by-time\n\t\tWrite the output to standard output ordered by measurement start instead of\n";
+	out << "\t\tdirectory order. Runs larger than half the --memory-budget are sorted through temporary files\n\n";
+	out << "\t--error-report <filename>\n\t\tWrite every failure of the run to <filename> as one line of JSON with its class,\n";
+	out << "\t\tfile and message. A failing file never stops the run, the exit code is the sum of the\n";
+	out << "\t\tfailure classes seen: 2 open, 4 read, 8 decode, 16 write, 32 missing references and\n";
+	out << "\t\t64 merged sums clipped to the 32 bit limit\n\n";
+	out << "\t--order <listing|index|extent>\n\t\tRead the DAT files in directory listing order, the default, in file index order or in\n";
+	out << "\t\tthe order their data is stored on the volume. The last two list the whole directory\n";
+	out << "\t\tbefore reading and cut seeking on rotating disks. They do not read ahead by themselves,\n";
+	out << "\t\twith the default single reader there is still only one read in flight, so use them with\n";
+	out << "\t\t--read-threads 2 or more\n\n";
+	out << "\t--serve <pipe name>\n\t\tConvert DAT files for clients of the named pipe, for example \\\\.\\pipe\\dat2inp, until the\n";
+	out << "\t\tprocess is stopped. A request holds a DAT path or DAT bytes and is answered with INP text\n";
+	out << "\t\tor the header fields as JSON. --read-threads sets the number of server threads and\n";
+	out << "\t\t--rule and --rules apply to every conversion\n\n";
+	out << "\t--connect <pipe name>\n\t\tSend every DAT file in the current directory to a --serve process and write the\n";
+	out << "\t\treplies to standard output, as INP text or with --format ndjson as JSON\n\n";
+	out << "\t--merge-by <field>[,<field>...]\n\t\tSum the spectra, real times and live times of the DAT files with equal values of the\n";
+	out << "\t\tgiven fields, for example sample_identifier,detector_identifier, and write one merged .DAT\n";
+	out << "\t\tand .INP file per group, named after its first file. Needs an --output-dir other than the\n";
+	out << "\t\tcurrent directory. Sums that do not fit 32 bits are clipped and reported in failure class 64\n\n";
+	out << "\t--cpu <auto|scalar|sse2|sse4.1|sse4.2>\n\t\tUse the spectrum and header string kernels for the given processor level instead of the\n";
+	out << "\t\thighest one the processor supports. All levels give the same results, this is for testing\n\t\tand timing\n\n";
+	out << "\t--progress\n\t\tReport the files and megabytes per second and the errors a few times per second, instead\n";
+	out << "\t\tof a line per converted file. The files are counted in the background while they are\n";
+	out << "\t\tconverted, the time left is shown once the count is done\n\n";
+	out << "\t--io-bytes <rate>[K|M|G]\n\t\tRead and write at most <rate> bytes per second, counted over all reader threads and the\n";
+	out << "\t\toutput files, to leave a shared file system to other users\n\n";
+	out << "\t--io-ops <rate>\n\t\tOpen at most <rate> files per second for reading or writing\n\n";
+	out << "\t--io-in-flight <count>\n\t\tKeep at most <count> file reads and writes going at the same time\n\n";
+	out << "\t--io-latency <milliseconds>\n\t\tHalve the --io-bytes and --io-ops rates while reading a file takes longer than\n";
+	out << "\t\t<milliseconds> on average and raise them back as reads get faster\n\n";
+	out << "\t--patch-dat\n\t\tWrite the header fields of each .INP file back into the .DAT file with the same name.\n";
+	out << "\t\tEach patched .DAT file is written whole to a .DA~ file that is then renamed over it, so a\n";
+	out << "\t\tfailed write leaves the .DAT file as it was\n\n";
+    out << "Examples:\n\t" << prog_name << " --default-detection-limit-library mdalib01.lib\n\t" << prog_name << " --stdout\n";
+    out << "\t" << prog_name << " --rule replace:nuclide_library=LIB01/LIB02 --rule set:energy_file=ENERGY.CAL\n" << endl;        
+}
+
+//==================================================
+// FUNCTION RETURNING A STRING REPRESENTATION OF A SinpleOpt ERROR    
+
+string get_args_error(int error)
+{        
+    switch (error) 
+    {
+	case SO_SUCCESS: return "Success";
+	case SO_OPT_INVALID: return "Unrecognized option";
+	case SO_OPT_MULTIPLE: return "Option matched multiple strings";
+	case SO_ARG_INVALID: return "Option does not accept argument";
+	case SO_ARG_INVALID_TYPE: return "Invalid argument format";
+	case SO_ARG_MISSING: return "Required argument is missing";
+	case SO_ARG_INVALID_DATA: return "Invalid argument data";
+	default: return "Unknown error";
+    }
+}
+
+//==================================================
+// FUNCTION USED TO DETERMINE IF A STRING IS FOUND AT THE END OF ANOTHER STRING    
+
+bool ends_with(const char* full, const char* ending)
+{      
+    size_t flen = strlen(full);
+    size_t elen = strlen(ending);
+    if (flen <= elen)
+        return false;
+    full += flen - elen;
+    while (*ending)
+    {
+        if (toupper((unsigned char)*full++) != toupper((unsigned char)*ending++))
+            return false;
+    }
+    return true;
+}
+
+//==================================================
+// FUNCTION TO LOOK UP AN IO_Header FIELD BY NAME, RETURNS 0 IF NOT FOUND
+
+const IO_Field* find_field(const char* name)
+{
+    for(unsigned int i=0; i<g_io_field_count; i++)
+    {
+        if(!strcmp(g_io_fields[i].name, name))
+            return &g_io_fields[i];
+    }
+    return 0;
+}
+
+//==================================================
+// FUNCTION TO COMPILE A RULE OF THE FORM <operation>:<field>=<value>
+
+bool compile_rule(const string& text, Rule& rule, string& error)
+{
+    string::size_type colon = text.find(':');
+    string::size_type equals = text.find('=');
+    if(colon == string::npos || equals == string::npos || equals < colon)
+    {
+        error = "Invalid rule: " + text;
+        return false;
+    }
+
+    string op = text.substr(0, colon);
+    string name = text.substr(colon + 1, equals - colon - 1);
+    const IO_Field* field = find_field(name.c_str());
+    if(!field)
+    {
+        error = "Unknown field in rule: " + text;
+        return false;
+    }
+
+    rule.offset = field->offset;
+    rule.size = field->size;
+    rule.value = text.substr(equals + 1);
+    rule.replacement = "";
+    rule.number = 0.0;
+
+    if(field->type != FIELD_STRING && field->type != FIELD_CHAR && op != "replace")
+    {
+        char* end;
+        rule.number = strtod(rule.value.c_str(), &end);
+        if(rule.value.empty() || *end)
+        {
+            error = "Invalid number in rule: " + text;
+            return false;
+        }
+    }
+
+    if(op == "set")
+    {
+        switch(field->type)
+        {
+            case FIELD_STRING: rule.apply = rule_set_string; break;
+            case FIELD_CHAR: rule.apply = rule_set_char; break;
+            case FIELD_SHORT: rule.apply = rule_set<short>; break;
+            case FIELD_INT: rule.apply = rule_set<int>; break;
+            default: rule.apply = rule_set<float>; break;
+        }
+    }
+    else if(op == "default")
+    {
+        switch(field->type)
+        {
+            case FIELD_STRING: rule.apply = rule_default_string; break;
+            case FIELD_CHAR: rule.apply = rule_default_char; break;
+            case FIELD_SHORT: rule.apply = rule_default<short>; break;
+            case FIELD_INT: rule.apply = rule_default<int>; break;
+            default: rule.apply = rule_default<float>; break;
+        }
+    }
+    else if(op == "replace")
+    {
+        string::size_type slash = rule.value.find('/');
+        if(field->type != FIELD_STRING || slash == string::npos || !slash)
+        {
+            error = "Invalid replace rule: " + text;
+            return false;
+        }
+        rule.replacement = rule.value.substr(slash + 1);
+        rule.value.erase(slash);
+        rule.apply = rule_replace_string;
+    }
+    else
+    {
+        error = "Unknown operation in rule: " + text;
+        return false;
+    }
+
+    return true;
+}
+
+//==================================================
+// FUNCTION TO READ RULES FROM A FILE, ONE RULE PER LINE
+
+bool load_rules(const char* filename, vector<Rule>& rules, string& error)
+{
+    ifstream in(filename);
+    if(!in.good())
+    {
+        error = string("Unable to open rules file: ") + filename;
+        return false;
+    }
+
+    string line;
+    Rule rule;
+    while(getline(in, line))
+    {
+        string::size_type first = line.find_first_not_of(" \t\r");
+        if(first == string::npos || line[first] == '#')
+            continue;
+        line.erase(0, first);
+        line.erase(line.find_last_not_of(" \t\r") + 1);
+
+        if(!compile_rule(line, rule, error))
+            return false;
+        rules.push_back(rule);
+    }
+
+    return true;
+}
+
+//==================================================
+// FUNCTION TO DUMP THE IO_Header DEBUG INFORMATION TO A BUFFER    
+
+void dump(const IO_Header& io, RecordBuffer& out)
+{        
+    DumpFormat format(out);
+#define DUMP_FIELD(name) format.field(#name, g_dump_label_##name, io.name);
+    DUMP_FIELDS(DUMP_FIELD)
+#undef DUMP_FIELD
+    out.append('\n');
+}
+
+//==================================================
+// FUNCTION TO WRITE THE IO_Header INFORMATION TO A BUFFER IN INP FORMAT    
+
+void generate_inp(const IO_Header& io, RecordBuffer& out)
+{                 
+    InpFormat format(out);
+    serialize(io, format);
+}
+
+//==================================================
+// FUNCTION TO READ THE IO_Header INFORMATION BACK FROM AN INP STREAM.
+// THIS IS THE INVERSE OF generate_inp, FIELDS ARE EXPECTED ONE PER LINE
+// IN THE SAME ORDER
+
+bool parse_inp(istream& in, IO_Header& io)
+{
+    string line;
+
+#define INP_STRING(field) \
+    if(!getline(in, line)) return false; \
+    if(!line.empty() && line[line.length() - 1] == '\r') line.erase(line.length() - 1); \
+    strncpy(io.field, line.c_str(), sizeof(io.field) - 1); \
+    io.field[sizeof(io.field) - 1] = 0;
+
+#define INP_CHAR(field) \
+    if(!getline(in, line)) return false; \
+    io.field = line.empty() ? 0 : line[0];
+
+#define INP_NUMBER(field, type) \
+    if(!getline(in, line)) return false; \
+    io.field = (type)strtod(line.c_str(), 0);
+
+#define INP_SHORT(field) INP_NUMBER(field, short)
+#define INP_INT(field) INP_NUMBER(field, int)
+#define INP_FLOAT(field) INP_NUMBER(field, float)
+#define INP_FIELD(name, type, label) INP_##type(name)
+
+    IO_HEADER_FIELDS(INP_FIELD)
+
+#undef INP_FIELD
+#undef INP_SHORT
+#undef INP_INT
+#undef INP_FLOAT
+#undef INP_STRING
+#undef INP_CHAR
+#undef INP_NUMBER
+
+    return true;
+}
+
+//==================================================
+// FUNCTION TO WRITE EACH INP FILE IN THE CURRENT DIRECTORY BACK INTO THE
+// DAT FILE WITH THE SAME NAME. THE PATCHED DAT IS WRITTEN UNDER A TEMPORARY
+// NAME AND RENAMED OVER THE ORIGINAL WHEN COMPLETE, SO A FAILED RUN NEVER
+// LEAVES A HALF WRITTEN DAT BEHIND. AN INP WITH A STRING LONGER THAN ITS DAT
+// FIELD IS AN ERROR AND ITS DAT FILE IS LEFT AS IS
+
+int patch_dat_files(const char* error_report)
+{
+    NamePool files;
+    ErrorReport errors;
+    unsigned int processed_files = 0;
+    char dname[MAX_PATH + 1], tname[MAX_PATH + 1];
+    vector<char> data;
+    WIN32_FIND_DATA FindFileData;
+    const char* dir = ".\\*.INP";
+
+    HANDLE hFind = FindFirstFile(dir, &FindFileData);
+    if (hFind == INVALID_HANDLE_VALUE)
+    {
+        clog << "No .INP files found in current directory. Exiting..." << endl;
+        return 0;
+    }
+
+    do
+    {
+        if(!files.add(0, FindFileData.cFileName))
+        {
+            FindClose(hFind);
+            cerr << "Failed to allocate memory for the file list" << endl;
+            return 1;
+        }
+    }
+    while (FindNextFile(hFind, &FindFileData) != 0);
+
+    DWORD dwError = GetLastError();
+    FindClose(hFind);
+    if (dwError != ERROR_NO_MORE_FILES)
+    {
+        cerr << "Failed reading directory " << dir << endl;
+        return 1;
+    }
+
+    for(unsigned int i=0; i<files.count(); i++)
+    {
+        IO_Header io;
+        memset((void*)&io, 0, sizeof(io));
+
+        ifstream fin(files.str(i), fstream::binary);
+        if(!fin.good() || !parse_inp(fin, io))
+        {
+            errors.add(ERROR_READ, "UNABLE TO READ FILE: ", files.str(i));
+            continue;
+        }
+        fin.close();
+
+        unsigned int len = files.length(i) - 4;
+        memcpy(dname, files.str(i), len);
+        memcpy(dname + len, ".DAT", 5);
+        memcpy(tname, files.str(i), len);
+        memcpy(tname + len, ".DA~", 5);
+
+        HANDLE hFile = CreateFile(dname, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if(hFile == INVALID_HANDLE_VALUE)
+        {
+            errors.add(ERROR_OPEN, "UNABLE TO OPEN FILE: ", dname);
+            continue;
+        }
+
+        DWORD size = GetFileSize(hFile, NULL);
+        if(size == INVALID_FILE_SIZE || size < DAT_HEADER_SIZE)
+        {
+            CloseHandle(hFile);
+            errors.add(ERROR_DECODE, "FILE TOO SHORT FOR A DAT HEADER: ", dname);
+            continue;
+        }
+
+        data.resize(size);
+        DWORD total = 0, got = 0;
+        while(total < size && ReadFile(hFile, &data[total], size - total, &got, NULL) && got)
+            total += got;
+        CloseHandle(hFile);
+        if(total < size)
+        {
+            errors.add(ERROR_READ, "UNABLE TO READ FILE: ", dname);
+            continue;
+        }
+
+        if(!encode_header(io, &data[0]))
+        {
+            errors.add(ERROR_DECODE, "STRING TOO LONG FOR ITS DAT FIELD IN FILE: ", files.str(i));
+            continue;
+        }
+
+        ofstream out(tname, fstream::binary);
+        if(!out.good())
+        {
+            errors.add(ERROR_WRITE, "FAILED TO OPEN FILE FOR WRITING: ", tname);
+            continue;
+        }
+        out.write(&data[0], size);
+        out.close();
+        if(out.fail())
+        {
+            DeleteFile(tname);
+            errors.add(ERROR_WRITE, "FAILED WRITING FILE: ", tname);
+            continue;
+        }
+
+        if(!MoveFileEx(tname, dname, MOVEFILE_REPLACE_EXISTING))
+        {
+            DeleteFile(tname);
+            errors.add(ERROR_WRITE, "FAILED TO RENAME TEMPORARY FILE TO: ", dname);
+            continue;
+        }
+
+        ++processed_files;
+        clog << dname << " patched successfully" << endl;
+    }
+
+    for(unsigned int i=0; i<errors.count(); i++)
+        cerr << errors.message(i) << endl;
+    if(error_report && !write_error_report(errors, error_report))
+    {
+        cerr << "Unable to write error report " << error_report << endl;
+        errors.add(ERROR_WRITE, "FAILED WRITING ERROR REPORT: ", error_report);
+    }
+
+    clog << "Of " << files.count() << " INP files, " << processed_files << " was successfully written back" << endl;
+
+    return errors.classes();
+}
+
+//==================================================
+// FUNCTIONS USED TO APPEND ESCAPED STRINGS TO A RECORD.
+// THE DAT FILES STORE 8 BIT TEXT, BYTES ABOVE 127 ARE WRITTEN AS LATIN-1
+// CODE POINTS SO THE JSON OUTPUT IS ALWAYS VALID
+
+void append_json_string(const char* str, RecordBuffer& out)
+{
+    static const char hex[] = "0123456789abcdef";
+    out.append('"');
+    for(const unsigned char* p = (const unsigned char*)str; *p; ++p)
+    {
+        if(*p == '"' || *p == '\\')
+        {
+            out.append('\\');
+            out.append((char)*p);
+        }
+        else if(*p < 0x20 || *p > 0x7e)
+        {
+            char esc[6] = { '\\', 'u', '0', '0', hex[*p >> 4], hex[*p & 15] };
+            out.append(esc, 6);
+        }
+        else out.append((char)*p);
+    }
+    out.append('"');
+}
+
+void append_csv_string(const char* str, RecordBuffer& out)
+{
+    if(!strpbrk(str, ",\"\r\n"))
+    {
+        out.append(str);
+        return;
+    }
+
+    out.append('"');
+    for(const char* p = str; *p; ++p)
+    {
+        if(*p == '"')
+            out.append('"');
+        out.append(*p);
+    }
+    out.append('"');
+}
+
+//==================================================
+// FUNCTION TO WRITE THE IO_Header INFORMATION AS ONE LINE OF JSON
+
+void format_ndjson(const char* file, const IO_Header& io, const SpectrumStats* stats, RecordBuffer& out)
+{
+    out.append("{\"file\":");
+    append_json_string(file, out);
+
+    NdjsonFormat format(out);
+    serialize(io, format);
+
+    if(stats)
+    {
+        char tmp[64];
+        out.append(tmp, sprintf(tmp, ",\"total_counts\":%llu", stats->total_counts));
+        out.append(tmp, sprintf(tmp, ",\"peak_channel\":%d", stats->peak_channel));
+        out.append(tmp, sprintf(tmp, ",\"peak_counts\":%d", stats->peak_counts));
+        out.append(tmp, sprintf(tmp, ",\"count_rate\":%.9g", stats->count_rate));
+        out.append(",\"roi_sums\":[");
+        for(size_t r = 0; r < stats->roi_sums.size(); r++)
+            out.append(tmp, sprintf(tmp, r ? ",%llu" : "%llu", stats->roi_sums[r]));
+        out.append("],\"preview\":[");
+        for(int b = 0; b < SPECTRUM_PREVIEW_BINS; b++)
+            out.append(tmp, sprintf(tmp, b ? ",%llu" : "%llu", stats->preview[b]));
+        out.append(']');
+    }
+
+    out.append("}\n", 2);
+}
+
+//==================================================
+// FUNCTION TO WRITE THE FAILURES OF A RUN AS ONE LINE OF JSON EACH, GIVING
+// THE FAILURE CLASS, THE FILE AND THE MESSAGE ALSO PRINTED TO STANDARD ERROR
+
+bool write_error_report(const ErrorReport& errors, const char* filename)
+{
+    FILE* f = fopen(filename, "wb");
+    if(!f)
+        return false;
+
+    RecordBuffer line;
+    bool ok = true;
+    for(unsigned int i = 0; i < errors.count() && ok; i++)
+    {
+        line.clear();
+        line.append("{\"class\":\"");
+        line.append(ErrorReport::name(errors.error(i)));
+        line.append("\",\"file\":");
+        append_json_string(errors.file(i), line);
+        line.append(",\"message\":");
+        append_json_string(errors.message(i), line);
+        line.append("}\n");
+        ok = fwrite(line.data(), 1, line.size(), f) == line.size();
+    }
+    return fclose(f) == 0 && ok;
+}
+
+//==================================================
+// FUNCTION CONVERTING ONE DAT FILE FOR THE --serve SERVER. THE RULES GIVEN
+// ON THE COMMAND LINE ARE THE CONTEXT, THEY ARE ONLY READ SO THE SERVER
+// THREADS SHARE THEM
+
+int serve_convert(const char* name, const char* data, unsigned int size, int reply, RecordBuffer& out, void* context)
+{
+    IO_Header io;
+    memset((void*)&io, 0, sizeof(io));
+    if(!decode_header(data, size, io))
+        return SERVE_DECODE_FAILED;
+
+    apply_rules(*(const vector<Rule>*)context, io);
+
+    if(reply == SERVE_FIELDS)
+        format_ndjson(name, io, 0, out);
+    else generate_inp(io, out);
+    return SERVE_OK;
+}
+
+//==================================================
+// FUNCTION SENDING EVERY DAT FILE IN THE CURRENT DIRECTORY TO A --serve
+// PROCESS AND WRITING THE REPLIES TO STANDARD OUTPUT IN DIRECTORY ORDER.
+// UP TO SERVE_WINDOW REQUESTS ARE SENT AHEAD OF THE REPLIES, SO THE SERVER
+// ALWAYS HAS WORK WAITING WHILE THE CLIENT WRITES
+
+#define SERVE_WINDOW	32
+
+int request_conversions(const char* pipe_name, int reply, const char* error_report)
+{
+    NamePool files;
+    ErrorReport errors;
+    WIN32_FIND_DATA FindFileData;
+    const char* dir = ".\\*.DAT";
+
+    HANDLE hFind = FindFirstFile(dir, &FindFileData);
+    if (hFind == INVALID_HANDLE_VALUE)
+    {
+        clog << "No .DAT files found in current directory. Exiting..." << endl;
+        return 0;
+    }
+
+    do
+    {
+        if(!(FindFileData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && !files.add(0, FindFileData.cFileName))
+        {
+            FindClose(hFind);
+            cerr << "Failed to allocate memory for the file list" << endl;
+            return 1;
+        }
+    }
+    while (FindNextFile(hFind, &FindFileData) != 0);
+    FindClose(hFind);
+
+    ServeClient client;
+    if(!client.connect(pipe_name))
+    {
+        cerr << "Unable to connect to " << pipe_name << endl;
+        return 1;
+    }
+
+    setvbuf(stdout, 0, _IOFBF, 1 << 20);
+    DWORD started = GetTickCount();
+    unsigned int sent = 0, received = 0, converted_files = 0;
+    char path[MAX_PATH + 1];
+    ServeResponse response;
+    RecordBuffer payload;
+
+    while(received < files.count())
+    {
+        for(; sent < files.count() && sent - received < SERVE_WINDOW; sent++)
+        {
+            // THE SERVER MAY RUN IN ANOTHER DIRECTORY, SO FULL PATHS ARE SENT
+
+            DWORD len = GetFullPathName(files.str(sent), sizeof(path), path, NULL);
+            if(len >= sizeof(path))
+                len = 0;
+            if(!client.send(sent, SERVE_PATH, reply, path, len))
+                break;
+        }
+
+        if(!client.receive(response, payload) || response.id != received)
+        {
+            cerr << "Lost the connection to " << pipe_name << endl;
+            return 1;
+        }
+
+        const char* name = files.str(received++);
+        switch(response.status)
+        {
+            case SERVE_OK:
+                fwrite(payload.data(), 1, payload.size(), stdout);
+                ++converted_files;
+                break;
+            case SERVE_OPEN_FAILED:
+                errors.add(ERROR_OPEN, "UNABLE TO OPEN FILE: ", name);
+                break;
+            case SERVE_READ_FAILED:
+                errors.add(ERROR_READ, "UNABLE TO READ FILE: ", name);
+                break;
+            case SERVE_DECODE_FAILED:
+                errors.add(ERROR_DECODE, "FILE TOO SHORT FOR A DAT HEADER: ", name);
+                break;
+            default:
+                errors.add(ERROR_READ, "REQUEST REFUSED BY THE SERVER FOR FILE: ", name);
+                break;
+        }
+    }
+    if(fflush(stdout) || ferror(stdout))
+        errors.add(ERROR_WRITE, "FAILED WRITING TO STANDARD OUTPUT", "");
+    DWORD elapsed = GetTickCount() - started;
+
+    for(unsigned int i=0; i<errors.count(); i++)
+        cerr << errors.message(i) << endl;
+    if(error_report && !write_error_report(errors, error_report))
+    {
+        cerr << "Unable to write error report " << error_report << endl;
+        errors.add(ERROR_WRITE, "FAILED WRITING ERROR REPORT: ", error_report);
+    }
+
+    clog << "Of " << files.count() << " DAT files, " << converted_files << " was converted by " << pipe_name << " in " << elapsed << " ms" << endl;
+
+    return errors.classes();
+}
+
+//==================================================
+// FUNCTIONS TO WRITE THE IO_Header INFORMATION AS ROWS OF CSV
 
-		++processed_files;
-		clog << files[i] << " converted successfully" << endl;
-    }   
+void format_csv_header(const vector<SpectrumROI>* rois, RecordBuffer& out)
+{
+    out.append("file", 4);
+    for(unsigned int i=0; i<g_io_field_count; i++)
+    {
+        out.append(',');
+        out.append(g_io_fields[i].name);
+    }
 
-	delete [] buffer;
-    
-    // PRINT STATUS INFORMATION
-    
-	for(vector<string>::iterator it = error_messages.begin(); it != error_messages.end(); ++it)
-		cerr << *it << endl;
+    if(rois)
+    {
+        char tmp[64];
+        out.append(",total_counts,peak_channel,peak_counts,count_rate");
+        for(size_t r = 0; r < rois->size(); r++)
+            out.append(tmp, sprintf(tmp, ",roi_%d_%d", (*rois)[r].first_channel, (*rois)[r].last_channel));
+        out.append(",preview");
+    }
+    out.append('\n');
+}
+
+void format_csv(const char* file, const IO_Header& io, const vector<SpectrumROI>* rois, const SpectrumStats* stats, RecordBuffer& out)
+{
+    append_csv_string(file, out);
+
+    CsvFormat format(out);
+    serialize(io, format);
+
+    // A FILE WITHOUT A SPECTRUM GETS EMPTY STATISTICS CELLS SO THE COLUMNS STAY ALIGNED
+
+    if(rois && !stats)
+    {
+        for(size_t n = 0; n < rois->size() + 5; n++)
+            out.append(',');
+    }
+    else if(rois)
+    {
+        char tmp[64];
+        out.append(tmp, sprintf(tmp, ",%llu,%d,%d,%.9g", stats->total_counts, stats->peak_channel, stats->peak_counts, stats->count_rate));
+        for(size_t r = 0; r < stats->roi_sums.size(); r++)
+            out.append(tmp, sprintf(tmp, ",%llu", stats->roi_sums[r]));
+        out.append(',');
+        for(int b = 0; b < SPECTRUM_PREVIEW_BINS; b++)
+            out.append(tmp, sprintf(tmp, b ? " %llu" : "%llu", stats->preview[b]));
+    }
+    out.append('\n');
+}
+
+//==================================================
+// FUNCTION TO PARSE A REGION OF INTEREST OF THE FORM <first>:<last>
+
+bool parse_roi(const char* text, SpectrumROI& roi)
+{
+    char* end;
+    roi.first_channel = (int)strtol(text, &end, 10);
+    if(end == text || *end != ':')
+        return false;
+    text = end + 1;
+    roi.last_channel = (int)strtol(text, &end, 10);
+    return end != text && !*end && roi.first_channel >= 0 && roi.first_channel <= roi.last_channel;
+}
+
+//==================================================
+// FUNCTION TO WRITE THE SPECTRUM STATISTICS TO A STREAM    
+
+void write_stats(const SpectrumStats& stats, RecordBuffer& out)
+{
+    char tmp[64];
+    out.append(tmp, sprintf(tmp, "total counts: %llu\n", stats.total_counts));
+    out.append(tmp, sprintf(tmp, "peak channel: %d\n", stats.peak_channel));
+    out.append(tmp, sprintf(tmp, "peak counts: %d\n", stats.peak_counts));
+    out.append(tmp, sprintf(tmp, "count rate: %g\n", stats.count_rate));
+    for(size_t r = 0; r < stats.roi_sums.size(); r++)
+        out.append(tmp, sprintf(tmp, "roi %u: %llu\n", (unsigned int)(r + 1), stats.roi_sums[r]));
+    out.append("preview:");
+    for(int b = 0; b < SPECTRUM_PREVIEW_BINS; b++)
+        out.append(tmp, sprintf(tmp, " %llu", stats.preview[b]));
+    out.append("\n\n", 2);
+}
+
+//==================================================
+// FUNCTION FORMATTING THE FILES OF A WRITE SLOT, CALLED BY THE WRITER THREADS
+
+void format_write_slot(const WriteSlot& slot, RecordBuffer& inp, RecordBuffer& sta)
+{
+    generate_inp(slot.io, inp);
+    if(slot.has_stats)
+        write_stats(slot.stats, sta);
+}
+
+//==================================================
+// FUNCTION RETURNING A STABLE HASH OF A FILE NAME (FNV-1a).
+// THE NAME IS UPPER CASED FIRST SINCE WINDOWS FILE NAMES ARE CASE INSENSITIVE
+
+unsigned int hash_name(const char* name)
+{
+    unsigned int hash = 2166136261u;
+    for(; *name; ++name)
+    {
+        hash ^= (unsigned char)toupper((unsigned char)*name);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+//==================================================
+// FUNCTION TO PARSE A SHARD OF THE FORM <index>/<count>
+
+bool parse_shard(const char* text, unsigned int& index, unsigned int& count)
+{
+    char* end;
+    index = (unsigned int)strtoul(text, &end, 10);
+    if(end == text || *end != '/')
+        return false;
+    text = end + 1;
+    count = (unsigned int)strtoul(text, &end, 10);
+    return end != text && !*end && count > 0 && index < count;
+}
+
+//==================================================
+// FUNCTION TO PARSE A RATE PER SECOND, WITH AN OPTIONAL K, M OR G SUFFIX
+// MULTIPLYING IT BY 1024, 1024^2 OR 1024^3
+
+bool parse_rate(const char* text, double& rate)
+{
+    char* end;
+    rate = strtod(text, &end);
+    if(end == text || rate <= 0.0)
+        return false;
+
+    switch(toupper((unsigned char)*end))
+    {
+        case 'G': rate *= 1024.0;
+        case 'M': rate *= 1024.0;
+        case 'K': rate *= 1024.0; ++end; break;
+    }
+    return !*end;
+}
+
+//==================================================
+// FUNCTION RETURNING A 64 BIT HASH OF A BLOCK OF MEMORY (FNV-1a)
+
+unsigned __int64 hash_bytes(const char* data, size_t size)
+{
+    unsigned __int64 hash = 14695981039346656037ULL;
+    for(size_t i = 0; i < size; i++)
+    {
+        hash ^= (unsigned char)data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+//==================================================
+// FUNCTION TO COMPARE A GENERATED INP WITH THE INP FILE ON DISK.
+// THE FILE IS MAPPED AND COMPARED AS A WHOLE FIRST, ONLY WHEN IT DIFFERS ARE
+// THE LINES COMPARED TO REPORT WHICH FIELDS CHANGED. RETURNS THE NUMBER OF
+// CHANGED FIELDS, DIFF_NEW_FILE IF THERE IS NO INP FILE TO COMPARE WITH, OR
+// DIFF_OPEN_FAILED / DIFF_READ_FAILED WHEN THE EXISTING FILE CAN NOT BE READ
+
+int diff_inp(const char* fname, const char* generated, size_t generated_size, ostream& report)
+{
+    HANDLE hFile = CreateFile(fname, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if(hFile == INVALID_HANDLE_VALUE)
+    {
+        DWORD error = GetLastError();
+        if(error != ERROR_FILE_NOT_FOUND && error != ERROR_PATH_NOT_FOUND)
+            return DIFF_OPEN_FAILED;
+        report << fname << ": new file\n";
+        return DIFF_NEW_FILE;
+    }
+
+    // AN EMPTY FILE CAN NOT BE MAPPED, IT IS COMPARED AS AN EMPTY STRING
+
+    DWORD size = GetFileSize(hFile, NULL);
+    HANDLE hMap = 0;
+    const char* view = "";
+    if(size)
+    {
+        hMap = size != INVALID_FILE_SIZE ? CreateFileMapping(hFile, NULL, PAGE_READONLY, 0, 0, NULL) : 0;
+        view = hMap ? (const char*)MapViewOfFile(hMap, FILE_MAP_READ, 0, 0, 0) : 0;
+        if(!view)
+        {
+            if(hMap)
+                CloseHandle(hMap);
+            CloseHandle(hFile);
+            return DIFF_READ_FAILED;
+        }
+    }
+
+    int changes = 0;
+    if(size != generated_size || memcmp(view, generated, size))
+    {
+        const char* old_pos = view;
+        const char* old_end = view + size;
+        const char* new_pos = generated;
+        const char* new_end = new_pos + generated_size;
+
+        for(unsigned int field = 0; old_pos < old_end || new_pos < new_end; field++)
+        {
+            const char* old_eol = (const char*)memchr(old_pos, '\n', old_end - old_pos);
+            const char* new_eol = (const char*)memchr(new_pos, '\n', new_end - new_pos);
+            if(!old_eol)
+                old_eol = old_end;
+            if(!new_eol)
+                new_eol = new_end;
+
+            if(old_eol - old_pos != new_eol - new_pos || memcmp(old_pos, new_pos, old_eol - old_pos))
+            {
+                report << fname << ": ";
+                if(field < g_io_field_count)
+                    report << g_io_fields[field].name;
+                else report << "line " << field + 1;
+                report << ": '";
+                report.write(old_pos, old_eol - old_pos);
+                report << "' -> '";
+                report.write(new_pos, new_eol - new_pos);
+                report << "'\n";
+                ++changes;
+            }
+
+            old_pos = old_eol < old_end ? old_eol + 1 : old_end;
+            new_pos = new_eol < new_end ? new_eol + 1 : new_end;
+        }
+    }
+
+    if(hMap)
+    {
+        UnmapViewOfFile(view);
+        CloseHandle(hMap);
+    }
+    CloseHandle(hFile);
+    return changes;
+}
+
+//==================================================
+// FUNCTION CHECKING THAT A DECODED HEADER SURVIVES BOTH WAYS BACK, ENCODED
+// INTO A DAT HEADER AND DECODED AGAIN, AND WRITTEN AS INP AND PARSED AGAIN.
+// RETURNS THE FIRST FIELD THAT CHANGED, OR 0 WHEN THE ROUND TRIPS ARE EXACT
+
+const IO_Field* verify_roundtrip(const char* buffer, const IO_Header& io)
+{
+    char header[DAT_HEADER_SIZE];
+    IO_Header from_dat, from_inp;
+    memset((void*)&from_dat, 0, sizeof(from_dat));
+    memset((void*)&from_inp, 0, sizeof(from_inp));
+
+    memcpy(header, buffer, DAT_HEADER_SIZE);
+    encode_header(io, header);
+    decode_header(header, DAT_HEADER_SIZE, from_dat);
+
+    RecordBuffer text;
+    generate_inp(io, text);
+    istringstream inp(string(text.data(), text.size()));
+    if(!parse_inp(inp, from_inp))
+        return &g_io_fields[0];
+
+    for(unsigned int i=0; i<g_io_field_count; i++)
+    {
+        const IO_Field& field = g_io_fields[i];
+        const char* value = (const char*)&io + field.offset;
+
+        for(int pass = 0; pass < 2; pass++)
+        {
+            const char* other = (const char*)(pass ? &from_inp : &from_dat) + field.offset;
+            bool same;
+            if(field.type == FIELD_STRING)
+                same = !strcmp(value, other);
+            else if(field.type == FIELD_FLOAT)
+            {
+                float a = convert<float>(value), b = convert<float>(other);
+                same = a == b || (a != a && b != b);
+            }
+            else same = !memcmp(value, other, field.size);
+
+            if(!same)
+                return &field;
+        }
+    }
 
-    clog << "Of " << files.size() << " DAT files, " << processed_files << " was successfully converted" << endl;	
-    
     return 0;
 }
 
 //==================================================
-// FUNCTION TO WRITE VERSION INFORMATION    
+// FUNCTION TO COMPILE AN --output-dir VALUE INTO LITERAL PARTS AND FIELDS.
+// A SEPARATOR IS ADDED AT THE END SO THE FILE NAME CAN BE APPENDED DIRECTLY
 
-void print_version(ostream& out)
-{        
-    out << PROG_VERSION_MAJOR << "." << PROG_VERSION_MINOR;        
+bool compile_output_dir(const char* text, OutputDir& output, string& error)
+{
+    PathPart part;
+    part.field = 0;
+    output.parts.clear();
+
+    for(const char* pos = text; *pos; )
+    {
+        if(*pos != '{')
+        {
+            part.text += *pos++;
+            continue;
+        }
+
+        const char* close = strchr(pos, '}');
+        if(!close)
+        {
+            error = string("Unterminated field in output directory: ") + text;
+            return false;
+        }
+
+        string name(pos + 1, close);
+        const IO_Field* field = find_field(name.c_str());
+        if(!field)
+        {
+            error = "Unknown field in output directory: " + name;
+            return false;
+        }
+
+        if(!part.text.empty())
+            output.parts.push_back(part);
+        part.text = "";
+        part.field = field;
+        output.parts.push_back(part);
+        part.field = 0;
+        pos = close + 1;
+    }
+
+    char last = *text ? text[strlen(text) - 1] : 0;
+    if(last != '\\' && last != '/')
+        part.text += '\\';
+    output.parts.push_back(part);
+    return true;
 }
 
 //==================================================
-// FUNCTION TO WRITE USAGE INFORMATION    
+// FUNCTION RETURNING THE VALUE OF A FIELD AS TEXT. STRINGS ARE RETURNED AS
+// THEY ARE, OTHER FIELDS ARE FORMATTED INTO number WHICH HOLDS 32 CHARACTERS
 
-void print_usage(ostream& out)
-{        
-    out << prog_name << " ";
-    print_version(out);
-    out << " - 2011 Dag Robole, Norwegian Radiation Protection Authority\n\n";
-    out << "This program is a utility program for gamma10.\n";
-    out << "It will convert any .DAT files in the current directory into .INP files.\n\n";        
-    out << "\t--version\n\t\tPrint version information and exit\n\n";
-    out << "\t--usage | --help\n\t\tPrint this message and exit\n\n";
-    out << "\t--stdout\n\t\tWrite results to standard output instead of .INP files\n\n";
-    out << "\t--dump\n\t\tWrite results to standard output instead of .INP files in debug friendly format\n\n";
-	out << "\t--default-detection-limit-library <filename>\n\t\tUse <filename> as the default detection limit library in DAT files\n";
-	out << "\t\twhere this field is empty.\n\t\tThe new version of gamma10 need a filename here so dont forget to supply it\n\n";
-    out << "Examples:\n\t" << prog_name << " --default-detection-limit-library mdalib01.lib\n\t" << prog_name << " --stdout\n" << endl;        
+const char* field_text(const IO_Field* field, const IO_Header& io, char* number)
+{
+    const char* src = (const char*)&io + field->offset;
+    switch(field->type)
+    {
+        case FIELD_STRING: return src;
+        case FIELD_CHAR: number[0] = *src; number[1] = 0; break;
+        case FIELD_SHORT: sprintf(number, "%d", (int)convert<short>(src)); break;
+        case FIELD_INT: sprintf(number, "%d", convert<int>(src)); break;
+        default: number[format_float(convert<float>(src), number)] = 0; break;
+    }
+    return number;
 }
 
 //==================================================
-// FUNCTION RETURNING A STRING REPRESENTATION OF A SinpleOpt ERROR    
+// FUNCTION TO FILL IN THE OUTPUT DIRECTORY FOR ONE HEADER.
+// CHARACTERS THAT CAN NOT BE USED IN A PATH ARE REPLACED BY '_', AS IS AN
+// EMPTY FIELD SO IT DOES NOT REMOVE A LEVEL. RETURNS 0 IF THE PATH IS TOO LONG
 
-string get_args_error(int error)
-{        
-    switch (error) 
+size_t expand_output_dir(const OutputDir& output, const IO_Header& io, char* path)
+{
+    size_t len = 0;
+    char number[32];
+
+    for(vector<PathPart>::const_iterator it = output.parts.begin(); it != output.parts.end(); ++it)
     {
-	case SO_SUCCESS: return "Success";
-	case SO_OPT_INVALID: return "Unrecognized option";
-	case SO_OPT_MULTIPLE: return "Option matched multiple strings";
-	case SO_ARG_INVALID: return "Option does not accept argument";
-	case SO_ARG_INVALID_TYPE: return "Invalid argument format";
-	case SO_ARG_MISSING: return "Required argument is missing";
-	case SO_ARG_INVALID_DATA: return "Invalid argument data";
-	default: return "Unknown error";
+        const char* value = it->text.c_str();
+        bool sanitize = false;
+
+        if(it->field)
+        {
+            value = field_text(it->field, io, number);
+            if(!*value)
+                value = "_";
+            sanitize = true;
+        }
+
+        for(; *value; ++value)
+        {
+            if(len >= MAX_PATH)
+                return 0;
+            char c = *value;
+            if(sanitize && ((unsigned char)c < 32 || strchr("\\/:*?\"<>|", c)))
+                c = '_';
+            path[len++] = c;
+        }
     }
+
+    path[len] = 0;
+    return len;
 }
 
 //==================================================
-// FUNCTION USED TO DETERMINE IF A STRING IS FOUND AT THE END OF ANOTHER STRING    
+// FUNCTION RETURNING THE LENGTH OF THE PART OF A PATH THAT CAN NOT BE CREATED,
+// A DRIVE ROOT LIKE X:\, A SHARE LIKE \\server\share\ OR EITHER BEHIND A
+// \\?\ PREFIX. A RELATIVE PATH HAS NO ROOT
 
-bool ends_with(const string& full, const string& ending)
-{      
-    string f = full;
-    string e = ending;
-    transform(f.begin(), f.end(), f.begin(), ::toupper);
-    transform(e.begin(), e.end(), e.begin(), ::toupper);
-    if (f.length() > e.length())     
-        return (0 == f.compare (f.length() - e.length(), e.length(), e));
-    else return false;    
+bool is_separator(char c)
+{
+    return c == '\\' || c == '/';
+}
+
+size_t path_root_length(const char* path, size_t len)
+{
+    size_t i = 0;
+    bool share = false;
+
+    if(len >= 4 && is_separator(path[0]) && is_separator(path[1]) && (path[2] == '?' || path[2] == '.') && is_separator(path[3]))
+    {
+        i = 4;
+        if(len >= i + 4 && toupper((unsigned char)path[i]) == 'U' && toupper((unsigned char)path[i + 1]) == 'N'
+            && toupper((unsigned char)path[i + 2]) == 'C' && is_separator(path[i + 3]))
+        {
+            i += 4;
+            share = true;
+        }
+    }
+    else if(len >= 2 && is_separator(path[0]) && is_separator(path[1]))
+    {
+        i = 2;
+        share = true;
+    }
+
+    if(share)
+    {
+        // Skip the server and the share name with the separators after them
+        for(int part = 0; part < 2; part++)
+        {
+            while(i < len && !is_separator(path[i]))
+                i++;
+            if(i < len)
+                i++;
+        }
+    }
+    else if(len >= i + 2 && path[i + 1] == ':')
+    {
+        i += 2;
+        if(i < len && is_separator(path[i]))
+            i++;
+    }
+    else if(!i && len && is_separator(path[0]))
+        i = 1;
+
+    return i;
 }
 
 //==================================================
-// FUNCTION USED TO EXTRACT AND TRIM A STRING FROM THE DAT BUFFER.
-// PASCAL STRINGS SEEMS TO STORE THE STRING LENGTH AT THE FIRST BYTES AND WITH
-// NO NULL TERMINATING CHARACTER, SO A WORKAROUND IS NEEDED    
-    
-void extract_string(const char* src, char* dest)
-{            
-    unsigned char len = (unsigned char)*src;	        
-    strncpy(dest, src + sizeof(unsigned char), len);
-    *(dest + len) = 0;
-    
-    // Trimming the end of the string
-    while(--len > 0)
+// FUNCTION TO CREATE AN OUTPUT DIRECTORY AND ANY MISSING PARENTS.
+// DIRECTORIES ALREADY SEEN ARE REMEMBERED, SO THE FILE SYSTEM IS ONLY ASKED
+// THE FIRST TIME A DIRECTORY COMES UP. THE ROOT OF THE PATH IS NOT CREATED
+
+bool make_output_dir(OutputDir& output, char* path, size_t len)
+{
+    string key(path, len);
+    if(output.created.count(key))
+        return true;
+
+    for(size_t i = path_root_length(path, len) + 1; i < len; i++)
     {
-		if(isspace(*(dest + len)) || !*(dest + len))
-			*(dest + len) = 0;
-		else break;		
+        char c = path[i];
+        if(!is_separator(c) || is_separator(path[i - 1]))
+            continue;
+
+        path[i] = 0;
+        if(!CreateDirectory(path, NULL))
+        {
+            DWORD attributes = GetFileAttributes(path);
+            if(attributes == INVALID_FILE_ATTRIBUTES || !(attributes & FILE_ATTRIBUTE_DIRECTORY))
+            {
+                path[i] = c;
+                return false;
+            }
+        }
+        path[i] = c;
     }
-    
-    if(!len && isspace(*dest))
-		*dest = 0;
+
+    output.created.insert(key);
+    return true;
 }
 
 //==================================================
-// FUNCTION TO DUMP THE IO_Header DEBUG INFORMATION TO A STREAM    
+// FUNCTION TELLING IF AN OUTPUT DIRECTORY OF len CHARACTERS, ENDING IN A
+// SEPARATOR, IS THE CURRENT DIRECTORY. THE VOLUME AND FILE INDEX ARE
+// COMPARED, SO IT DOES NOT MATTER HOW THE PATH IS SPELLED. A DIRECTORY THAT
+// CAN NOT BE OPENED IS NOT THE CURRENT ONE
 
-void dump(const IO_Header& io, ostream& out)
-{        
-    out << "spectrum identifier: " << io.spectrum_identifier << endl;
-    out << "sample identifier: " << io.sample_identifier << endl;
-    out << "project: " << io.project << endl;
-    out << "sample location: " << io.sample_location << endl;    
-    out << "latitude: " << io.latitude << endl;
-    out << "latitude unit: " << io.latitude_unit << endl;
-    out << "longitude: " << io.longitude << endl;
-    out << "longitude unit: " << io.longitude_unit << endl;
-    out << "sample height: " << io.sample_height << endl;
-    out << "sample weight: " << io.sample_weight << endl;
-    out << "sample density: " << io.sample_density << endl;
-    out << "sample volume: " << io.sample_volume << endl;		
-    out << "sample quantity: " << io.sample_quantity << endl;	
-    out << "sample uncertainty: " << io.sample_uncertainty << endl;	
-    out << "sampling start: " << io.sampling_start << endl;	
-    out << "sampling stop: " << io.sampling_stop << endl;	
-    out << "reference time: " << io.reference_time << endl;
-    out << "measurement start: " << io.measurement_start << endl;
-    out << "measurement stop: " << io.measurement_stop << endl;
-    out << "format: " << io.format << endl;
-    out << "FWHMPS: " << io.FWHMPS << endl;
-    out << "FWHMAN: " << io.FWHMAN << endl;
-    out << "THRESH: " << io.THRESH << endl;
-    out << "BSTF: " << io.BSTF << endl;
-    out << "ETOL: " << io.ETOL << endl;
-    out << "LOCH: " << io.LOCH << endl;
-    out << "ICA: " << io.ICA << endl;	
-    out << "live time: " << io.live_time << endl;
-    out << "real time: " << io.real_time << endl;	
-    out << "dead time: " << io.dead_time << endl;	
-    out << "measurement time: " << io.measurement_time << endl;	
-    out << "channel count: " << io.channel_count << endl;	
-    out << "record length: " << io.record_length << endl;	
-    out << "sample unit: " << io.sample_unit << endl;	
-    out << "detector id: " << io.detector_identifier << endl;	
-    out << "year: " << io.year << endl;	
-    out << "beaker id: " << io.beaker_identifier << endl;	
-    out << "nuclide library: " << io.nuclide_library << endl;
-    out << "energy file: " << io.energy_file << endl;
-    out << "pef file: " << io.pef_file << endl;
-    out << "tef file: " << io.tef_file << endl;
-    out << "background file: " << io.background_file << endl;
-    out << "LIM file: " << io.lim_file << endl << endl;
-}
-
-//==================================================
-// FUNCTION TO WRITE THE IO_Header INFORMATION TO A STREAM    
-
-void generate_inp(const IO_Header& io, ostream& out)
-{                 
-    out.setf(ios_base::scientific);
-    out.precision(14);
-    
-    out << io.spectrum_identifier << endl;
-    out << io.sample_identifier << endl;
-    out << io.project << endl;
-    out << io.sample_location << endl;    
-    out << io.latitude << endl;
-    out << io.latitude_unit << endl;
-    out << io.longitude << endl;
-    out << io.longitude_unit << endl;
-    out << io.sample_height << endl;
-    out << io.sample_weight << endl;
-    out << io.sample_density << endl;
-    out << io.sample_volume << endl;
-    out << io.sample_quantity << endl;
-	out << io.sample_uncertainty << endl;
-    out << io.sample_unit << endl;
-    out << io.detector_identifier << endl;
-    out << io.year << endl;
-    out << io.beaker_identifier << endl;
-    out << io.sampling_start << endl;
-    out << io.sampling_stop << endl;
-    out << io.reference_time << endl;
-    out << io.measurement_start << endl;
-    out << io.measurement_stop << endl;
-    out << io.real_time << endl;
-    out << io.live_time << endl;
-    out << io.measurement_time << endl;        
-    out << io.dead_time << endl;        
-    out << io.nuclide_library << endl;	
-    out << io.lim_file << endl;
-    out << io.channel_count << endl;
-    out << io.format << endl;
-    out << io.record_length << endl;                
-    out << io.FWHMPS << endl;
-    out << io.FWHMAN << endl;
-    out << io.THRESH << endl;
-    out << io.BSTF << endl;
-    out << io.ETOL << endl;
-    out << io.LOCH << endl;
-    out << io.ICA << endl;
-    out << io.energy_file << endl;
-    out << io.pef_file << endl;
-    out << io.tef_file << endl;
-    out << io.background_file << endl;
-    out << io.PA1 << endl;
-    out << io.PA2 << endl;
-    out << io.PA3 << endl;
-    out << io.PA4 << endl;
-    out << io.PA5 << endl;
-    out << io.PA6 << endl;
-    out << io.print_out << endl;
-    out << io.plot_out << endl;
-    out << io.disk_out << endl;
-    out << io.ex_print_out << endl;
-    out << io.ex_disk_out << endl;
-    out << io.PO1 << endl;
-    out << io.PO2 << endl;
-    out << io.PO3 << endl;
-    out << io.PO4 << endl;
-    out << io.PO5 << endl;
-    out << io.PO6 << endl;
-    out << io.complete << endl;
-    out << io.analysed << endl;
-    out << io.ST1 << endl;
-    out << io.ST2 << endl;
-    out << io.ST3 << endl;
-    out << io.ST4 << endl;
-    out << io.ST5 << endl;
-    out << io.ST6 << endl;
-    
-    out.unsetf(ios_base::scientific);
+bool is_input_dir(const char* path, size_t len)
+{
+    char dir[MAX_PATH + 1];
+    memcpy(dir, path, len);
+    if(len > path_root_length(path, len) + 1 && is_separator(dir[len - 1]))
+        --len;
+    dir[len] = 0;
+
+    BY_HANDLE_FILE_INFORMATION info[2];
+    const char* dirs[2] = { dir, "." };
+    for(int i = 0; i < 2; i++)
+    {
+        HANDLE hDir = CreateFile(dirs[i], 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, NULL);
+        if(hDir == INVALID_HANDLE_VALUE)
+            return false;
+        BOOL known = GetFileInformationByHandle(hDir, &info[i]);
+        CloseHandle(hDir);
+        if(!known)
+            return false;
+    }
+
+    return info[0].dwVolumeSerialNumber == info[1].dwVolumeSerialNumber
+        && info[0].nFileIndexHigh == info[1].nFileIndexHigh && info[0].nFileIndexLow == info[1].nFileIndexLow;
+}
+
+//==================================================
+// FUNCTION TO WRITE SINGLE INP FILES FROM A BUNDLE TO STANDARD OUTPUT.
+// EACH TEXT IS CHECKED AGAINST ITS HASH BEFORE IT IS WRITTEN
+
+int extract_inp(const char* bundle_file, const vector<const char*>& names)
+{
+    BundleReader bundle;
+    if(!bundle.open(bundle_file))
+    {
+        cerr << "Unable to open bundle " << bundle_file << endl;
+        return 1;
+    }
+
+    int result = 0;
+    for(vector<const char*>::const_iterator it = names.begin(); it != names.end(); ++it)
+    {
+        const BundleEntry* entry = bundle.find(*it);
+        if(!entry)
+        {
+            cerr << "NOT FOUND IN BUNDLE: " << *it << endl;
+            result = 1;
+            continue;
+        }
+
+        const char* data = bundle.data(*entry);
+        if(hash_bytes(data, entry->length) != entry->hash)
+        {
+            cerr << "CORRUPT ENTRY IN BUNDLE: " << *it << endl;
+            result = 1;
+            continue;
+        }
+        fwrite(data, 1, entry->length, stdout);
+    }
+
+    fflush(stdout);
+    return result;
+}
+
+//==================================================
+// FUNCTION TO CHECK THE FILES REFERENCED BY A HEADER AGAINST THE SEARCH PATH.
+// EMPTY FIELDS ARE NOT CHECKED. THE MISSING ONES ARE LISTED IN missing AS
+// <field>=<name> AND FALSE IS RETURNED
+
+bool check_references(const IO_Header& io, ReferenceCache& cache, string& missing)
+{
+    missing.clear();
+    for(unsigned int i=0; i<g_reference_field_count; i++)
+    {
+        const IO_Field* field = find_field(g_reference_fields[i]);
+        const char* value = (const char*)&io + field->offset;
+        if(!*value || cache.exists(value))
+            continue;
+
+        if(!missing.empty())
+            missing += ", ";
+        missing += field->name;
+        missing += '=';
+        missing += value;
+    }
+    return missing.empty();
+}
+
+//==================================================
+// FUNCTION TO PARSE A COMMA SEPARATED LIST OF FIELD NAMES FOR --merge-by
+
+bool parse_merge_fields(const char* text, vector<const IO_Field*>& fields, string& error)
+{
+    fields.clear();
+    string list(text);
+    string::size_type start = 0;
+
+    while(true)
+    {
+        string::size_type comma = list.find(',', start);
+        string name = list.substr(start, comma == string::npos ? string::npos : comma - start);
+        const IO_Field* field = find_field(name.c_str());
+        if(!field)
+        {
+            error = "Unknown field in merge fields: " + name;
+            return false;
+        }
+        fields.push_back(field);
+
+        if(comma == string::npos)
+            return true;
+        start = comma + 1;
+    }
+}
+
+//==================================================
+// FUNCTION TO ADD THE SPECTRUM OF ONE DAT FILE TO THE GROUP GIVEN BY ITS
+// --merge-by FIELDS. THE FIRST FILE OF A GROUP PROVIDES THE HEADER, EVERY
+// FILE ADDS ITS REAL TIME, LIVE TIME AND CHANNEL COUNTS TO 64 BIT SUMS
+
+int merge_spectrum(const vector<const IO_Field*>& fields, const char* name, const char* buffer, unsigned int size, const IO_Header& io, MergeGroups& groups)
+{
+    const char* channels = locate_spectrum(buffer, size, io);
+    if(!channels)
+        return MERGE_NO_SPECTRUM;
+
+    string key;
+    char number[32];
+    for(vector<const IO_Field*>::const_iterator it = fields.begin(); it != fields.end(); ++it)
+    {
+        if(it != fields.begin())
+            key += '\t';
+        key += field_text(*it, io, number);
+    }
+
+    MergeGroup& group = groups[key];
+    if(!group.files)
+    {
+        group.name = name;
+        group.io = io;
+        group.header.assign(buffer, channels);
+        group.sums.assign(io.channel_count, 0);
+    }
+    else
+    {
+        if(io.channel_count != group.io.channel_count)
+            return MERGE_CHANNELS_DIFFER;
+    }
+
+    group.real_time += io.real_time;
+    group.live_time += io.live_time;
+
+    accumulate_counts(channels, io.channel_count, &group.sums[0]);
+    ++group.files;
+    return MERGE_ADDED;
+}
+
+//==================================================
+// FUNCTION RETURNING A 64 BIT SUM CLIPPED TO THE int RANGE, clipped IS SET
+// WHEN IT DID NOT FIT AND LEFT AS IS OTHERWISE
+
+int clip_int(__int64 value, bool& clipped)
+{
+    if(value > INT_MAX || value < INT_MIN)
+    {
+        clipped = true;
+        return value > 0 ? INT_MAX : INT_MIN;
+    }
+    return (int)value;
+}
+
+//==================================================
+// FUNCTION TO WRITE A MERGE GROUP AS <path>.DAT AND <path>.INP, WHERE path
+// HOLDS len CHARACTERS. SUMS ABOVE THE LARGEST 32 BIT COUNT ARE CLIPPED AND
+// COUNTED IN clipped, clipped_times IS SET WHEN A TIME SUM DID NOT FIT.
+// BOTH FILES ARE WRITTEN UNDER TEMPORARY NAMES AND ONLY RENAMED WHEN BOTH ARE
+// COMPLETE, A FAILURE REMOVES WHAT WAS WRITTEN OF EITHER. path IS LEFT
+// HOLDING THE NAME OF THE MERGED DAT FILE
+
+bool write_merged(MergeGroup& group, char* path, size_t len, RecordBuffer& record, unsigned int& clipped, bool& clipped_times)
+{
+    clipped_times = false;
+    group.io.real_time = clip_int(group.real_time, clipped_times);
+    group.io.live_time = clip_int(group.live_time, clipped_times);
+    derive_dead_time(group.io);
+    encode_header(group.io, &group.header[0]);
+
+    vector<char> counts(group.sums.size() * sizeof(int));
+    clipped = 0;
+    for(size_t i = 0; i < group.sums.size(); i++)
+    {
+        int count = 0x7FFFFFFF;
+        if(group.sums[i] > 0x7FFFFFFFULL)
+            ++clipped;
+        else count = (int)group.sums[i];
+        insert<int>(count, &counts[i * sizeof(int)]);
+    }
+
+    record.clear();
+    generate_inp(group.io, record);
+
+    const char* extensions[] = { ".DAT", ".INP" };
+    const char* temporary[] = { ".DA~", ".IN~" };
+    char target[MAX_PATH + 1];
+    memcpy(target, path, len);
+
+    bool written = true;
+    for(int i = 0; i < 2 && written; i++)
+    {
+        memcpy(path + len, temporary[i], 5);
+        ofstream out(path, fstream::binary);
+        if(i == 0)
+        {
+            out.write(&group.header[0], group.header.size());
+            out.write(&counts[0], counts.size());
+        }
+        else out.write(record.data(), record.size());
+        out.close();
+        written = !out.fail();
+    }
+
+    // A FAILED RENAME OF THE INP ALSO REMOVES THE MERGED DAT IT BELONGS WITH
+
+    for(int i = 0; i < 2 && written; i++)
+    {
+        memcpy(path + len, temporary[i], 5);
+        memcpy(target + len, extensions[i], 5);
+        written = MoveFileEx(path, target, MOVEFILE_REPLACE_EXISTING) != 0;
+        if(!written && i == 1)
+        {
+            memcpy(target + len, extensions[0], 5);
+            DeleteFile(target);
+        }
+    }
+
+    for(int i = 0; i < 2 && !written; i++)
+    {
+        memcpy(path + len, temporary[i], 5);
+        DeleteFile(path);
+    }
+
+    memcpy(path + len, extensions[0], 5);
+    return written;
+}
+
+//==================================================
+// FUNCTION REPORTING EVERY SLOT THE WRITERS ARE DONE WITH. A WRITTEN FILE IS
+// COUNTED IN converted AND ADDED TO THE JOURNAL, A FAILED ONE TO THE ERRORS.
+// RETURNS THE NUMBER OF SLOTS REPORTED
+
+unsigned int report_written(WritePipeline& writer, ErrorReport& errors, Journal* journal, bool quiet, unsigned int& converted)
+{
+    unsigned int reported = 0;
+    const WriteSlot* slot;
+    while((slot = writer.finished()) != 0)
+    {
+        ++reported;
+        switch(slot->status)
+        {
+            case WRITE_OPEN_FAILED:
+                errors.add(ERROR_WRITE, "FAILED TO OPEN FILE FOR WRITING: ", slot->failed);
+                continue;
+            case WRITE_FAILED:
+                errors.add(ERROR_WRITE, "FAILED WRITING FILE: ", slot->failed);
+                continue;
+            case WRITE_RENAME_FAILED:
+                errors.add(ERROR_WRITE, "FAILED TO RENAME TEMPORARY FILE TO: ", slot->failed);
+                continue;
+        }
+
+        if(journal)
+            journal->add(slot->name, slot->size, slot->hash, slot->out_size);
+        ++converted;
+        if(!quiet)
+            clog << slot->name << " converted successfully" << endl;
+    }
+    return reported;
 }
 
 //==================================================
@@ -33,6 +33,10 @@
 
 //==================================================
 
+#define DAT_HEADER_SIZE		397
+
+//==================================================
+
 struct IO_Header
 {
     char spectrum_identifier[6];		// 4
@@ -105,6 +109,82 @@ struct IO_Header
     short ST6;    
 };
 
+//==================================================
+// THE IO_Header FIELDS IN INP FILE ORDER, AS X(name, type, dump label).
+// THE FIELD TABLE, THE INP READER AND ALL OUTPUT FORMATS ARE GENERATED FROM
+// THIS LIST. FIELDS WITHOUT A DUMP LABEL ARE LEFT OUT OF THE DUMP, WHICH
+// LISTS ITS FIELDS IN ITS OWN ORDER, SEE DUMP_FIELDS IN main.cpp
+
+#define IO_HEADER_FIELDS(X) \
+    X(spectrum_identifier, STRING, "spectrum identifier") \
+    X(sample_identifier, STRING, "sample identifier") \
+    X(project, STRING, "project") \
+    X(sample_location, STRING, "sample location") \
+    X(latitude, FLOAT, "latitude") \
+    X(latitude_unit, CHAR, "latitude unit") \
+    X(longitude, FLOAT, "longitude") \
+    X(longitude_unit, CHAR, "longitude unit") \
+    X(sample_height, FLOAT, "sample height") \
+    X(sample_weight, FLOAT, "sample weight") \
+    X(sample_density, FLOAT, "sample density") \
+    X(sample_volume, FLOAT, "sample volume") \
+    X(sample_quantity, FLOAT, "sample quantity") \
+    X(sample_uncertainty, FLOAT, "sample uncertainty") \
+    X(sample_unit, STRING, "sample unit") \
+    X(detector_identifier, STRING, "detector id") \
+    X(year, STRING, "year") \
+    X(beaker_identifier, STRING, "beaker id") \
+    X(sampling_start, STRING, "sampling start") \
+    X(sampling_stop, STRING, "sampling stop") \
+    X(reference_time, STRING, "reference time") \
+    X(measurement_start, STRING, "measurement start") \
+    X(measurement_stop, STRING, "measurement stop") \
+    X(real_time, INT, "real time") \
+    X(live_time, INT, "live time") \
+    X(measurement_time, INT, "measurement time") \
+    X(dead_time, FLOAT, "dead time") \
+    X(nuclide_library, STRING, "nuclide library") \
+    X(lim_file, STRING, "LIM file") \
+    X(channel_count, INT, "channel count") \
+    X(format, STRING, "format") \
+    X(record_length, SHORT, "record length") \
+    X(FWHMPS, FLOAT, "FWHMPS") \
+    X(FWHMAN, FLOAT, "FWHMAN") \
+    X(THRESH, FLOAT, "THRESH") \
+    X(BSTF, FLOAT, "BSTF") \
+    X(ETOL, FLOAT, "ETOL") \
+    X(LOCH, FLOAT, "LOCH") \
+    X(ICA, SHORT, "ICA") \
+    X(energy_file, STRING, "energy file") \
+    X(pef_file, STRING, "pef file") \
+    X(tef_file, STRING, "tef file") \
+    X(background_file, STRING, "background file") \
+    X(PA1, INT, 0) \
+    X(PA2, INT, 0) \
+    X(PA3, INT, 0) \
+    X(PA4, INT, 0) \
+    X(PA5, INT, 0) \
+    X(PA6, INT, 0) \
+    X(print_out, SHORT, 0) \
+    X(plot_out, SHORT, 0) \
+    X(disk_out, SHORT, 0) \
+    X(ex_print_out, SHORT, 0) \
+    X(ex_disk_out, SHORT, 0) \
+    X(PO1, INT, 0) \
+    X(PO2, INT, 0) \
+    X(PO3, INT, 0) \
+    X(PO4, INT, 0) \
+    X(PO5, INT, 0) \
+    X(PO6, INT, 0) \
+    X(complete, SHORT, 0) \
+    X(analysed, SHORT, 0) \
+    X(ST1, SHORT, 0) \
+    X(ST2, SHORT, 0) \
+    X(ST3, SHORT, 0) \
+    X(ST4, SHORT, 0) \
+    X(ST5, SHORT, 0) \
+    X(ST6, SHORT, 0)
+
 //==================================================
 
 #endif // MAIN_H
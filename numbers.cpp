@@ -0,0 +1,554 @@
+//==================================================
+// Copyright (C) 2011 by Norwegian Radiation Protection Authority
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// Authors: Dag Robøle,
+//
+//==================================================
+// HEADER INCLUDES
+
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include "numbers.h"
+
+//==================================================
+// SMALL FIXED SIZE UNSIGNED INTEGER FOR THE EXACT DIGIT GENERATION.
+// A float IS m * 2^e WITH m BELOW 2^24 AND e BETWEEN -149 AND 104, SCALED BY
+// AT MOST 10^46 NO VALUE BELOW NEEDS MORE THAN 200 BITS
+
+#define BIG_WORDS	8
+
+struct BigInt
+{
+    unsigned int word[BIG_WORDS];
+    int used;
+};
+
+void big_set(BigInt& a, unsigned int value)
+{
+    a.word[0] = value;
+    a.used = value ? 1 : 0;
+}
+
+void big_mul_small(BigInt& a, unsigned int factor)
+{
+    unsigned __int64 carry = 0;
+    for(int i = 0; i < a.used; i++)
+    {
+        carry += (unsigned __int64)a.word[i] * factor;
+        a.word[i] = (unsigned int)carry;
+        carry >>= 32;
+    }
+    if(carry)
+        a.word[a.used++] = (unsigned int)carry;
+}
+
+void big_mul_pow10(BigInt& a, int exponent)
+{
+    for(; exponent >= 9; exponent -= 9)
+        big_mul_small(a, 1000000000);
+    static const unsigned int small[9] = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000 };
+    if(exponent)
+        big_mul_small(a, small[exponent]);
+}
+
+void big_shift_left(BigInt& a, int bits)
+{
+    if(!a.used)
+        return;
+
+    int words = bits / 32;
+    bits %= 32;
+    if(bits)
+    {
+        unsigned int carry = 0;
+        for(int i = 0; i < a.used; i++)
+        {
+            unsigned int next = a.word[i] >> (32 - bits);
+            a.word[i] = (a.word[i] << bits) | carry;
+            carry = next;
+        }
+        if(carry)
+            a.word[a.used++] = carry;
+    }
+    if(words)
+    {
+        for(int i = a.used - 1; i >= 0; i--)
+            a.word[i + words] = a.word[i];
+        for(int i = 0; i < words; i++)
+            a.word[i] = 0;
+        a.used += words;
+    }
+}
+
+int big_compare(const BigInt& a, const BigInt& b)
+{
+    if(a.used != b.used)
+        return a.used < b.used ? -1 : 1;
+    for(int i = a.used - 1; i >= 0; i--)
+    {
+        if(a.word[i] != b.word[i])
+            return a.word[i] < b.word[i] ? -1 : 1;
+    }
+    return 0;
+}
+
+// a -= b, WHERE a >= b
+
+void big_subtract(BigInt& a, const BigInt& b)
+{
+    unsigned int borrow = 0;
+    for(int i = 0; i < a.used; i++)
+    {
+        unsigned __int64 sub = (unsigned __int64)(i < b.used ? b.word[i] : 0) + borrow;
+        borrow = a.word[i] < sub ? 1 : 0;
+        a.word[i] = (unsigned int)((unsigned __int64)a.word[i] - sub);
+    }
+    while(a.used && !a.word[a.used - 1])
+        --a.used;
+}
+
+//==================================================
+// FUNCTION TO WRITE THE DECIMAL DIGITS OF value, RETURNS THE LENGTH
+
+size_t format_unsigned(unsigned int value, char* dest)
+{
+    char tmp[10];
+    size_t n = 0;
+    do
+    {
+        tmp[n++] = (char)('0' + value % 10);
+        value /= 10;
+    }
+    while(value);
+
+    for(size_t i = 0; i < n; i++)
+        dest[i] = tmp[n - 1 - i];
+    return n;
+}
+
+size_t format_int(int val, char* dest)
+{
+    if(val >= 0)
+        return format_unsigned((unsigned int)val, dest);
+    *dest = '-';
+    return 1 + format_unsigned(0u - (unsigned int)val, dest + 1);
+}
+
+//==================================================
+// FUNCTIONS TAKING THE FIRST SCIENTIFIC_DIGITS DIGITS OF mantissa * 2^exponent,
+// GIVEN AN ESTIMATE OF ITS DECIMAL EXPONENT THAT IS CORRECTED IN PLACE. THE
+// VALUE IS HELD AS THE EXACT FRACTION r / s SCALED INTO [1, 10) AND A DIGIT
+// IS TAKEN OFF AT A TIME. THEY RETURN HOW TWICE THE REMAINDER COMPARES TO s,
+// WHICH DECIDES THE ROUNDING OF THE LAST DIGIT
+
+#define NATIVE_OVERFLOW		2
+
+// MOST VALUES FIT r AND s IN 64 BITS ONCE THE COMMON POWERS OF TWO ARE REMOVED
+
+int generate_digits_native(unsigned int mantissa, int exponent, int& decimal, char* digits)
+{
+    static const unsigned __int64 limit = 1ULL << 59;
+    int twos_r = exponent > 0 ? exponent : 0;
+    int twos_s = exponent < 0 ? -exponent : 0;
+    int fives_r = decimal < 0 ? -decimal : 0;
+    int fives_s = decimal > 0 ? decimal : 0;
+    twos_r += fives_r;
+    twos_s += fives_s;
+
+    int common = twos_r < twos_s ? twos_r : twos_s;
+    twos_r -= common;
+    twos_s -= common;
+    if(twos_r > 34 || twos_s > 58 || fives_r > 25 || fives_s > 25)
+        return NATIVE_OVERFLOW;
+
+    unsigned __int64 r = (unsigned __int64)mantissa << twos_r;
+    unsigned __int64 s = 1ULL << twos_s;
+    for(int i = 0; i < fives_r; i++)
+    {
+        if(r >= limit / 5)
+            return NATIVE_OVERFLOW;
+        r *= 5;
+    }
+    for(int i = 0; i < fives_s; i++)
+    {
+        if(s >= limit / 5)
+            return NATIVE_OVERFLOW;
+        s *= 5;
+    }
+    if(r >= limit || s >= limit / 10)
+        return NATIVE_OVERFLOW;
+
+    if(r < s)
+    {
+        r *= 10;
+        --decimal;
+    }
+    else if(r >= s * 10)
+    {
+        s *= 10;
+        ++decimal;
+    }
+
+    for(int i = 0; i < SCIENTIFIC_DIGITS; i++)
+    {
+        unsigned int digit = (unsigned int)(r / s);
+        r = (r - digit * s) * 10;
+        digits[i] = (char)('0' + digit);
+    }
+
+    r /= 5;
+    return r < s ? -1 : (r > s ? 1 : 0);
+}
+
+int generate_digits_big(unsigned int mantissa, int exponent, int& decimal, char* digits)
+{
+    BigInt r, s;
+    big_set(r, mantissa);
+    big_set(s, 1);
+    if(exponent > 0)
+        big_shift_left(r, exponent);
+    else big_shift_left(s, -exponent);
+    if(decimal > 0)
+        big_mul_pow10(s, decimal);
+    else big_mul_pow10(r, -decimal);
+
+    if(big_compare(r, s) < 0)
+    {
+        big_mul_small(r, 10);
+        --decimal;
+    }
+    else
+    {
+        BigInt ten_s = s;
+        big_mul_small(ten_s, 10);
+        if(big_compare(r, ten_s) >= 0)
+        {
+            s = ten_s;
+            ++decimal;
+        }
+    }
+
+    for(int i = 0; i < SCIENTIFIC_DIGITS; i++)
+    {
+        if(i)
+            big_mul_small(r, 10);
+        int digit = 0;
+        while(big_compare(r, s) >= 0)
+        {
+            big_subtract(r, s);
+            ++digit;
+        }
+        digits[i] = (char)('0' + digit);
+    }
+
+    big_shift_left(r, 1);
+    return big_compare(r, s);
+}
+
+//==================================================
+// FUNCTION TO FORMAT A float AS printf("%.14e") DOES.
+// THE VALUE IS WRITTEN AS THE EXACT FRACTION r / s SCALED INTO [1, 10), THE
+// DIGITS ARE THEN TAKEN OFF ONE AT A TIME AND THE REMAINDER DECIDES THE
+// ROUNDING OF THE LAST ONE. NAN AND INFINITY ARE LEFT TO THE RUNTIME
+
+size_t format_scientific(float val, char* dest)
+{
+    if(val != val || val - val != 0.0f)
+        return (size_t)sprintf(dest, "%.14e", (double)val);
+
+    unsigned int bits;
+    memcpy(&bits, &val, sizeof(bits));
+
+    size_t n = 0;
+    if(bits >> 31)
+        dest[n++] = '-';
+
+    unsigned int mantissa = bits & 0x7FFFFF;
+    int exponent = (int)((bits >> 23) & 0xFF);
+    if(exponent)
+        mantissa |= 0x800000;
+    else exponent = 1;
+    exponent -= 150;
+
+    char digits[SCIENTIFIC_DIGITS];
+    int decimal = 0;
+
+    if(!mantissa)
+        memset(digits, '0', sizeof(digits));
+    else
+    {
+        // ESTIMATE THE DECIMAL EXPONENT, THEN CORRECT IT EXACTLY BELOW
+
+        decimal = (int)floor(log10(fabs((double)val)));
+        int order = generate_digits_native(mantissa, exponent, decimal, digits);
+        if(order == NATIVE_OVERFLOW)
+            order = generate_digits_big(mantissa, exponent, decimal, digits);
+
+        // ROUND HALF TO EVEN ON THE EXACT REMAINDER
+
+        if(order > 0 || (order == 0 && (digits[SCIENTIFIC_DIGITS - 1] - '0') % 2))
+        {
+            int i = SCIENTIFIC_DIGITS - 1;
+            for(; i >= 0 && digits[i] == '9'; i--)
+                digits[i] = '0';
+            if(i >= 0)
+                ++digits[i];
+            else
+            {
+                digits[0] = '1';
+                ++decimal;
+            }
+        }
+    }
+
+    dest[n++] = digits[0];
+    dest[n++] = '.';
+    memcpy(dest + n, digits + 1, SCIENTIFIC_DIGITS - 1);
+    n += SCIENTIFIC_DIGITS - 1;
+
+    dest[n++] = 'e';
+    dest[n++] = decimal < 0 ? '-' : '+';
+    unsigned int magnitude = (unsigned int)(decimal < 0 ? -decimal : decimal);
+#if defined(_MSC_VER) && _MSC_VER < 1900
+    if(magnitude < 100)
+        dest[n++] = '0';
+#endif
+    if(magnitude < 10)
+        dest[n++] = '0';
+    n += format_unsigned(magnitude, dest + n);
+    return n;
+}
+
+//==================================================
+// FUNCTION TO CONVERT A FIELD OF 8 OR 4 ASCII DIGITS TO 2 DIGIT VALUES IN
+// EVERY OTHER BYTE. A NON DIGIT BYTE SETS A BIT IN invalid. THE BYTES ARE
+// TAKEN LOWEST ADDRESS FIRST, AS LOADED ON A LITTLE ENDIAN MACHINE
+
+unsigned __int64 parse_digit_pairs(unsigned __int64 chars, unsigned __int64 mask, unsigned __int64& invalid)
+{
+    // A DIGIT HAS 3 IN THE HIGH NIBBLE, ALSO AFTER 6 IS ADDED TO THE LOW ONE
+
+    invalid |= ((chars & 0xF0F0F0F0F0F0F0F0ULL) ^ (0x3030303030303030ULL & mask))
+        | ((((chars + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) ^ (0x3030303030303030ULL & mask)) & mask);
+    unsigned __int64 digits = (chars & mask) - (0x3030303030303030ULL & mask);
+    return (digits * 10 + (digits >> 8)) & 0x00FF00FF00FF00FFULL;
+}
+
+bool parse_timestamp(const char* text, __int64& seconds)
+{
+    unsigned __int64 date = 0, time = 0, invalid = 0;
+    memcpy(&date, text, 8);
+    memcpy(&time, text + 8, 4);
+
+    date = parse_digit_pairs(date, 0xFFFFFFFFFFFFFFFFULL, invalid);
+    time = parse_digit_pairs(time, 0x00000000FFFFFFFFULL, invalid);
+
+    unsigned int year = (unsigned int)(date & 0xFF);
+    unsigned int month = (unsigned int)((date >> 16) & 0xFF);
+    unsigned int day = (unsigned int)((date >> 32) & 0xFF);
+    unsigned int hour = (unsigned int)((date >> 48) & 0xFF);
+    unsigned int minute = (unsigned int)(time & 0xFF);
+    unsigned int second = (unsigned int)((time >> 16) & 0xFF);
+
+    year += year < 70 ? 2000 : 1900;
+    static const unsigned char month_days[13] = { 0, 31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+    bool leap = !(year % 4) && (year % 100 || !(year % 400));
+    bool valid = !invalid & (month - 1 < 12) & (hour < 24) & (minute < 60) & (second < 60);
+    if(!valid || day - 1 >= (unsigned int)(month_days[month] - (month == 2 && !leap)))
+        return false;
+
+    // DAYS SINCE 1970 BY THE USUAL MARCH BASED CIVIL CALENDAR FORMULA
+
+    unsigned int y = year - (month <= 2);
+    unsigned int era = y / 400;
+    unsigned int year_of_era = y - era * 400;
+    unsigned int day_of_year = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    unsigned int day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    __int64 days = (__int64)era * 146097 + day_of_era - 719468;
+
+    seconds = days * 86400 + hour * 3600 + minute * 60 + second;
+    return true;
+}
+
+//==================================================
+// THE SIGNIFICANT DIGITS AND DECIMAL EXPONENT OF A FLOAT PRINTED BY THE
+// RUNTIME WITH %e. NINE DIGITS ALWAYS READ BACK AS THE SAME FLOAT
+
+#define FLOAT_DIGITS	9
+
+struct FloatDigits
+{
+    char digits[FLOAT_DIGITS];
+    int exponent;
+};
+
+//==================================================
+// FUNCTION TO TAKE THE DIGITS AND EXPONENT OUT OF A NUMBER PRINTED WITH %e
+
+void parse_float_digits(const char* text, FloatDigits& out)
+{
+    if(*text == '-')
+        ++text;
+    int n = 0;
+    for(; *text != 'e'; ++text)
+        if(*text != '.')
+            out.digits[n++] = *text;
+    out.exponent = atoi(text + 1);
+}
+
+//==================================================
+// FUNCTION ROUNDING THE FLOAT_DIGITS DIGITS OF full TO precision DIGITS,
+// HALF UP. THIS IS THE SAME AS ROUNDING THE VALUE ITSELF UNLESS THE DROPPED
+// DIGITS ARE EXACTLY ONE HALF, WHEN THE DIGITS OF full MAY THEMSELVES BE
+// ROUNDED UP OR DOWN. FALSE IS RETURNED THEN AND THE RUNTIME MUST ROUND
+
+bool round_float_digits(const FloatDigits& full, int precision, FloatDigits& out)
+{
+    out = full;
+    if(precision == FLOAT_DIGITS || full.digits[precision] < '5')
+        return true;
+
+    bool half = full.digits[precision] == '5';
+    for(int i = precision + 1; i < FLOAT_DIGITS && half; i++)
+        half = full.digits[i] == '0';
+    if(half)
+        return false;
+
+    int i = precision - 1;
+    for(; i >= 0 && out.digits[i] == '9'; i--)
+        out.digits[i] = '0';
+    if(i >= 0)
+        ++out.digits[i];
+    else
+    {
+        out.digits[0] = '1';
+        ++out.exponent;
+    }
+    return true;
+}
+
+//==================================================
+// FUNCTION WRITING precision DIGITS AS printf("%.*g") DOES. TRAILING ZEROS
+// ARE DROPPED AND THE EXPONENT FORM IS USED BELOW 1E-4 AND FROM 10^precision
+
+size_t write_float_digits(bool negative, const FloatDigits& d, int precision, char* dest)
+{
+    int count = precision;
+    while(count > 1 && d.digits[count - 1] == '0')
+        --count;
+
+    size_t n = 0;
+    if(negative)
+        dest[n++] = '-';
+
+    int x = d.exponent;
+    if(x < -4 || x >= precision)
+    {
+        dest[n++] = d.digits[0];
+        if(count > 1)
+        {
+            dest[n++] = '.';
+            memcpy(dest + n, d.digits + 1, count - 1);
+            n += count - 1;
+        }
+        dest[n++] = 'e';
+        dest[n++] = x < 0 ? '-' : '+';
+        unsigned int magnitude = (unsigned int)(x < 0 ? -x : x);
+#if defined(_MSC_VER) && _MSC_VER < 1900
+        dest[n++] = '0';
+#endif
+        dest[n++] = (char)('0' + magnitude / 10);
+        dest[n++] = (char)('0' + magnitude % 10);
+    }
+    else if(x >= 0)
+    {
+        memcpy(dest + n, d.digits, x + 1);
+        n += x + 1;
+        if(count > x + 1)
+        {
+            dest[n++] = '.';
+            memcpy(dest + n, d.digits + x + 1, count - x - 1);
+            n += count - x - 1;
+        }
+    }
+    else
+    {
+        dest[n++] = '0';
+        dest[n++] = '.';
+        for(int i = -1; i > x; i--)
+            dest[n++] = '0';
+        memcpy(dest + n, d.digits, count);
+        n += count;
+    }
+    return n;
+}
+
+//==================================================
+// FUNCTION TO FORMAT A FLOAT WITH THE FEWEST DIGITS THAT STILL READ BACK
+// AS THE SAME FLOAT, AS printf("%.*g") WITH THAT PRECISION. THE VALUE IS
+// PRINTED ONCE WITH FLOAT_DIGITS DIGITS AND THE SHORTER CANDIDATES ARE
+// ROUNDED FROM THOSE. IF A CANDIDATE READS BACK SO DOES EVERY LONGER ONE,
+// SO THE SHORTEST IS FOUND BY BISECTION IN AT MOST FOUR READS. RETURNS THE
+// NUMBER OF CHARACTERS WRITTEN TO dest, WHICH MUST HOLD AT LEAST 32
+// CHARACTERS. NAN AND INFINITY GIVE 0
+
+size_t format_float(float val, char* dest)
+{
+    if(val != val || val - val != 0.0f)
+        return 0;
+
+    bool negative = val < 0.0f || (val == 0.0f && 1.0f / val < 0.0f);
+    if(val == 0.0f)
+        return (size_t)(negative ? sprintf(dest, "-0") : sprintf(dest, "0"));
+
+    char text[32];
+    FloatDigits full, d;
+    sprintf(text, "%.*e", FLOAT_DIGITS - 1, (double)val);
+    parse_float_digits(text, full);
+
+    int low = 1, high = FLOAT_DIGITS;
+    while(low < high)
+    {
+        int precision = (low + high) / 2;
+        if(!round_float_digits(full, precision, d))
+        {
+            sprintf(text, "%.*e", precision - 1, (double)val);
+            parse_float_digits(text, d);
+        }
+
+        size_t n = write_float_digits(negative, d, precision, text);
+        text[n] = 0;
+        if((float)strtod(text, 0) == val)
+            high = precision;
+        else low = precision + 1;
+    }
+
+    if(!round_float_digits(full, low, d))
+    {
+        sprintf(text, "%.*e", low - 1, (double)val);
+        parse_float_digits(text, d);
+    }
+    return write_float_digits(negative, d, low, dest);
+}
+
+//==================================================
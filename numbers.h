@@ -0,0 +1,69 @@
+//==================================================
+// Copyright (C) 2011 by Norwegian Radiation Protection Authority
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// Authors: Dag Robøle,
+//
+//==================================================
+
+#ifndef NUMBERS_H
+#define NUMBERS_H
+
+//==================================================
+
+#include <cstddef>
+
+//==================================================
+// LOCALE INDEPENDENT NUMBER FORMATTING FOR THE INP FILES.
+// format_scientific GIVES THE SAME TEXT AS printf("%.14e") IN THE C LOCALE,
+// WITH THE DIGITS COMPUTED EXACTLY FROM THE BINARY VALUE AND ROUNDED HALF TO
+// EVEN. THE EXPONENT HAS AT LEAST THREE DIGITS WITH THE OLD MICROSOFT RUNTIME,
+// LIKE ITS printf, AND TWO OTHERWISE. BOTH RETURN THE LENGTH WRITTEN, dest
+// MUST HOLD 32 CHARACTERS AND IS NOT NULL TERMINATED
+// THE FORMATTING HAS NO VECTOR VARIANTS SELECTED BY CPU LEVEL. EACH DIGIT
+// DEPENDS ON THE REMAINDER LEFT BY THE ONE BEFORE, SO THERE ARE NO
+// INDEPENDENT LANES TO SPREAD IT OVER
+
+#define SCIENTIFIC_DIGITS	15
+
+size_t format_scientific(float val, char* dest);
+size_t format_int(int val, char* dest);
+
+//==================================================
+// format_float GIVES THE FEWEST DIGITS THAT READ BACK AS THE SAME float, AS
+// printf("%.*g") WITH THE SMALLEST SUCH PRECISION. IT RETURNS THE LENGTH
+// WRITTEN, 0 FOR NAN AND INFINITY, dest MUST HOLD 32 CHARACTERS AND IS NOT
+// NULL TERMINATED
+
+size_t format_float(float val, char* dest);
+
+//==================================================
+// THE DAT TIME FIELDS ARE 12 DIGITS, YYMMDDhhmmss, WITH YEARS BELOW 70 IN THE
+// 2000s. parse_timestamp CHECKS AND CONVERTS ALL DIGITS AT ONCE IN 64 BIT
+// REGISTERS AND GIVES THE SECONDS SINCE 1970-01-01 00:00:00. text MUST HAVE
+// 12 READABLE BYTES, RETURNS FALSE IF IT IS NOT A VALID TIME
+
+bool parse_timestamp(const char* text, __int64& seconds);
+
+//==================================================
+
+#endif // NUMBERS_H
+
+//==================================================
@@ -0,0 +1,447 @@
+//==================================================
+// Copyright (C) 2011 by Norwegian Radiation Protection Authority
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// Authors: Dag Robøle,
+//
+//==================================================
+// HEADER INCLUDES
+
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <algorithm>
+#include <process.h>
+#include <winioctl.h>
+#include "pipeline.h"
+
+//==================================================
+// FUNCTION USED WHILE WAITING ON ANOTHER THREAD. YIELDS FOR A WHILE AND
+// THEN SLEEPS SO AN IDLE STAGE DOES NOT KEEP A CORE BUSY
+
+void backoff(unsigned int& spins)
+{
+    if(++spins < 64)
+        SwitchToThread();
+    else Sleep(1);
+}
+
+//==================================================
+// RING BUFFER SETUP. THE SLOT BUFFERS START EMPTY AND GROW TO THE LARGEST
+// FILE THE SLOT HAS HELD, SO NO PASS OVER THE DIRECTORY IS NEEDED TO SIZE THEM
+
+bool SlotRing::init(unsigned int capacity)
+{
+    m_slots = new (std::nothrow) ReadSlot[capacity];
+    if(!m_slots)
+        return false;
+    m_capacity = capacity;
+    m_head = m_tail = 0;
+    memset(m_slots, 0, capacity * sizeof(ReadSlot));
+    return true;
+}
+
+void SlotRing::destroy()
+{
+    if(!m_slots)
+        return;
+    for(unsigned int i = 0; i < m_capacity; i++)
+        free(m_slots[i].data);
+    delete [] m_slots;
+    m_slots = 0;
+    m_capacity = 0;
+}
+
+//==================================================
+// FUNCTION TO CLAIM A FILE IN A QUEUE DIRECTORY SHARED BY SEVERAL PROCESSES.
+// CREATING THE MARKER WITH CREATE_NEW IS ATOMIC, ALSO ON NETWORK SHARES,
+// SO EXACTLY ONE PROCESS SUCCEEDS. RETURNS FALSE IF THE FILE WAS ALREADY CLAIMED
+
+bool claim_file(const char* queue_dir, const char* name)
+{
+    char path[2 * MAX_PATH + 8];
+    size_t dlen = strlen(queue_dir);
+    size_t nlen = strlen(name);
+    if(dlen + nlen + 8 > sizeof(path))
+        return false;
+
+    memcpy(path, queue_dir, dlen);
+    path[dlen] = '\\';
+    memcpy(path + dlen + 1, name, nlen);
+    memcpy(path + dlen + 1 + nlen, ".claim", 7);
+
+    HANDLE hClaim = CreateFile(path, GENERIC_WRITE, 0, NULL, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(hClaim == INVALID_HANDLE_VALUE)
+        return false;
+    CloseHandle(hClaim);
+    return true;
+}
+
+//==================================================
+// PIPELINE
+
+#define READ_SLOTS_PER_READER	64
+
+ReadPipeline::ReadPipeline()
+    : m_find(INVALID_HANDLE_VALUE), m_have_entry(false), m_found(false), m_listing_failed(false), m_accepted(0),
+      m_filter(0), m_context(0), m_order(ORDER_LISTING), m_scheduled_next(0), m_queue_dir(0), m_limiter(0), m_readers(0), m_reader_count(0), m_started(0), m_current(0), m_pending(0),
+      m_pending_size(0), m_memory_budget(0), m_memory_used(0), m_finished(0), m_stop(0)
+{
+    InitializeCriticalSection(&m_listing_lock);
+}
+
+bool ReadPipeline::start(const char* pattern, unsigned int readers, size_t memory_budget, const char* queue_dir, FileFilter filter, void* context)
+{
+    m_queue_dir = queue_dir;
+    m_filter = filter;
+    m_context = context;
+    m_memory_budget = memory_budget;
+    m_reader_count = readers ? readers : 1;
+
+    // THE FIRST DIRECTORY READ HAPPENS HERE SO AN EMPTY DIRECTORY IS REPORTED AT ONCE
+
+    m_find = FindFirstFile(pattern, &m_find_data);
+    m_found = m_have_entry = m_find != INVALID_HANDLE_VALUE;
+    if(!m_found)
+        return true;
+
+    if(m_order != ORDER_LISTING && !schedule())
+        return false;
+
+    m_readers = new (std::nothrow) Reader[m_reader_count];
+    if(!m_readers)
+        return false;
+
+    for(unsigned int r = 0; r < m_reader_count; r++)
+    {
+        m_readers[r].pipeline = this;
+        m_readers[r].thread = 0;
+        if(!m_readers[r].ring.init(READ_SLOTS_PER_READER))
+            return false;
+    }
+
+    // THE READERS THAT DID START STILL COVER EVERY FILE. WITH NONE next READS
+    // THE FILES ONE AT A TIME INTO THE FIRST RING ON THE CONVERTING THREAD
+
+    unsigned int readers_wanted = m_reader_count;
+    for(unsigned int r = 0; r < readers_wanted; r++)
+    {
+        m_readers[m_started].thread = (HANDLE)_beginthreadex(NULL, 0, reader_main, &m_readers[m_started], 0, NULL);
+        if(m_readers[m_started].thread)
+            ++m_started;
+    }
+    m_reader_count = m_started ? m_started : 1;
+    return true;
+}
+
+unsigned __stdcall ReadPipeline::reader_main(void* arg)
+{
+    Reader* reader = (Reader*)arg;
+    reader->pipeline->read_files(reader->ring);
+    InterlockedIncrement(&reader->pipeline->m_finished);
+    return 0;
+}
+
+//==================================================
+// FUNCTION TAKING THE NEXT FILE TO READ, FROM THE SCHEDULE WHEN THE FILES
+// ARE ORDERED AND OTHERWISE STRAIGHT FROM THE DIRECTORY LISTING
+
+bool ReadPipeline::next_file(char* name, unsigned int& size)
+{
+    if(m_order == ORDER_LISTING)
+        return list_file(name, size);
+
+    size_t next = (size_t)(InterlockedIncrement(&m_scheduled_next) - 1);
+    if(next >= m_scheduled.size())
+        return false;
+
+    const ScheduledFile& file = m_scheduled[next];
+    strcpy(name, m_scheduled_names.str(file.name));
+    size = file.size;
+    return true;
+}
+
+//==================================================
+// FUNCTION TAKING THE NEXT ACCEPTED ENTRY FROM THE DIRECTORY LISTING.
+// THE LISTING IS SHARED BY ALL READERS, RETURNS FALSE AT THE END OF IT
+
+bool ReadPipeline::list_file(char* name, unsigned int& size)
+{
+    bool found = false;
+    EnterCriticalSection(&m_listing_lock);
+
+    while(m_have_entry && !found)
+    {
+        if(!(m_find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+            && (!m_filter || m_filter(m_find_data.cFileName, (unsigned int)m_find_data.nFileSizeLow, m_context)))
+        {
+            strcpy(name, m_find_data.cFileName);
+            size = (unsigned int)m_find_data.nFileSizeLow;
+            ++m_accepted;
+            found = true;
+        }
+
+        m_have_entry = FindNextFile(m_find, &m_find_data) != 0;
+        if(!m_have_entry)
+        {
+            m_listing_failed = GetLastError() != ERROR_NO_MORE_FILES;
+            FindClose(m_find);
+            m_find = INVALID_HANDLE_VALUE;
+        }
+    }
+
+    LeaveCriticalSection(&m_listing_lock);
+    return found;
+}
+
+//==================================================
+// FUNCTION FINDING THE KEY A FILE IS ORDERED BY. THE FILE INDEX IS THE NTFS
+// FILE REFERENCE NUMBER, SO FILES WITH CLOSE INDEXES HAVE CLOSE MFT RECORDS.
+// THE EXTENT IS THE FIRST LOGICAL CLUSTER OF THE FILE DATA, SMALL FILES KEPT
+// INSIDE THEIR MFT RECORD HAVE NONE AND ARE ORDERED BY FILE INDEX INSTEAD.
+// FILES WITHOUT ANY KEY, AS ON SOME NETWORK SHARES, KEEP THE LISTING ORDER
+
+enum { GROUP_KEYED, GROUP_INDEXED, GROUP_UNKEYED };
+
+static unsigned int schedule_key(const char* name, int order, unsigned __int64& key)
+{
+    HANDLE hFile = CreateFile(name, FILE_READ_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, 0, NULL);
+    if(hFile == INVALID_HANDLE_VALUE)
+        return GROUP_UNKEYED;
+
+    unsigned int group = GROUP_UNKEYED;
+    if(order == ORDER_EXTENT)
+    {
+        // ONLY THE FIRST EXTENT IS ASKED FOR, ERROR_MORE_DATA JUST SAYS THERE ARE MORE
+
+        STARTING_VCN_INPUT_BUFFER start;
+        start.StartingVcn.QuadPart = 0;
+        RETRIEVAL_POINTERS_BUFFER extents;
+        DWORD returned = 0;
+        if((DeviceIoControl(hFile, FSCTL_GET_RETRIEVAL_POINTERS, &start, sizeof(start), &extents, sizeof(extents), &returned, NULL)
+            || GetLastError() == ERROR_MORE_DATA) && extents.ExtentCount)
+        {
+            key = (unsigned __int64)extents.Extents[0].Lcn.QuadPart;
+            group = GROUP_KEYED;
+        }
+    }
+
+    BY_HANDLE_FILE_INFORMATION info;
+    if(group == GROUP_UNKEYED && GetFileInformationByHandle(hFile, &info))
+    {
+        key = ((unsigned __int64)info.nFileIndexHigh << 32) | info.nFileIndexLow;
+        group = order == ORDER_EXTENT ? GROUP_INDEXED : GROUP_KEYED;
+    }
+
+    CloseHandle(hFile);
+    return group;
+}
+
+//==================================================
+// FUNCTION LISTING THE WHOLE DIRECTORY BEFORE THE READERS START AND ORDERING
+// THE ACCEPTED FILES BY THEIR KEY. THE SORT IS STABLE SO FILES WITH EQUAL
+// OR NO KEYS KEEP THEIR LISTING ORDER. THE READERS THEN TAKE THE FILES IN
+// THIS ORDER, SO WITH SEVERAL READERS THE NEXT FILES ARE ALREADY BEING READ
+
+bool ReadPipeline::schedule()
+{
+    char name[MAX_PATH + 1];
+    unsigned int size;
+
+    while(list_file(name, size))
+    {
+        ScheduledFile file;
+        file.name = m_scheduled_names.count();
+        file.size = size;
+        file.key = 0;
+        file.group = schedule_key(name, m_order, file.key);
+        if(!m_scheduled_names.add(0, name))
+            return false;
+        m_scheduled.push_back(file);
+    }
+
+    std::stable_sort(m_scheduled.begin(), m_scheduled.end());
+    m_scheduled_next = 0;
+    return true;
+}
+
+//==================================================
+// FUNCTION WAITING UNTIL A FILE OF THE GIVEN SIZE FITS IN THE MEMORY BUDGET.
+// A FILE LARGER THAN THE WHOLE BUDGET IS STILL READ WHEN NOTHING ELSE IS HELD
+
+bool ReadPipeline::reserve_memory(unsigned int size)
+{
+    unsigned int spins = 0;
+    for(;;)
+    {
+        LONG used = m_memory_used;
+        if(!used || (size_t)used + size <= m_memory_budget)
+        {
+            if(InterlockedCompareExchange(&m_memory_used, used + (LONG)size, used) == used)
+                return true;
+            continue;
+        }
+        if(m_stop)
+            return false;
+        backoff(spins);
+    }
+}
+
+void ReadPipeline::read_files(SlotRing& ring)
+{
+    while(read_file(ring))
+        ;
+}
+
+//==================================================
+// FUNCTION READING THE NEXT FILE INTO THE RING. RETURNS FALSE AT THE END OF
+// THE FILES OR WHEN THE PIPELINE IS STOPPED
+
+bool ReadPipeline::read_file(SlotRing& ring)
+{
+    char name[MAX_PATH + 1];
+    unsigned int size;
+
+    if(!next_file(name, size))
+        return false;
+
+    ReadSlot* slot;
+    unsigned int spins = 0;
+    while((slot = ring.acquire_write()) == 0)
+    {
+        if(m_stop)
+            return false;
+        backoff(spins);
+    }
+
+    if(!reserve_memory(size))
+        return false;
+
+    strcpy(slot->name, name);
+    slot->size = size;
+    slot->status = READ_OK;
+
+    if(m_queue_dir && !claim_file(m_queue_dir, name))
+        slot->status = READ_CLAIMED;
+    else if(slot->capacity < size + 1)
+    {
+        char* data = (char*)realloc(slot->data, size + 1);
+        if(data)
+        {
+            slot->data = data;
+            slot->capacity = size + 1;
+        }
+        else slot->status = READ_NO_MEMORY;
+    }
+
+    // THE LIMITER, WHEN GIVEN, IS SHARED BY ALL READERS AND THE WRITES
+
+    if(slot->status == READ_OK)
+    {
+        __int64 started = m_limiter ? m_limiter->begin(size) : 0;
+        HANDLE hFile = CreateFile(name, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if(hFile == INVALID_HANDLE_VALUE)
+            slot->status = READ_OPEN_FAILED;
+        else
+        {
+            DWORD total = 0, got = 0;
+            while(total < size && ReadFile(hFile, slot->data + total, size - total, &got, NULL) && got)
+                total += got;
+            CloseHandle(hFile);
+            if(total < size)
+                slot->status = READ_SHORT;
+        }
+        if(m_limiter)
+            m_limiter->end(IO_READ, started);
+    }
+
+    ring.commit_write();
+    return true;
+}
+
+//==================================================
+// FUNCTION RETURNING THE NEXT FILLED SLOT, OR 0 WHEN ALL FILES HAVE BEEN READ.
+// THE SLOT RETURNED BY THE PREVIOUS CALL IS HANDED BACK TO ITS READER.
+// THE RINGS ARE VISITED ROUND ROBIN SO NO READER IS STARVED
+
+const ReadSlot* ReadPipeline::next()
+{
+    if(m_pending)
+    {
+        m_pending->commit_read();
+        InterlockedExchangeAdd(&m_memory_used, -(LONG)m_pending_size);
+        m_pending = 0;
+    }
+
+    if(!m_readers || (!m_started && !read_file(m_readers[0].ring)))
+        return 0;
+
+    unsigned int spins = 0;
+    for(;;)
+    {
+        // READ THE FINISHED COUNT BEFORE LOOKING AT THE RINGS, IF ALL READERS
+        // HAD FINISHED AND THE RINGS ARE STILL EMPTY THERE IS NOTHING MORE TO COME
+
+        LONG finished = m_finished;
+
+        for(unsigned int n = 0; n < m_reader_count; n++)
+        {
+            SlotRing& ring = m_readers[m_current].ring;
+            m_current = (m_current + 1) % m_reader_count;
+
+            ReadSlot* slot = ring.acquire_read();
+            if(slot)
+            {
+                m_pending = &ring;
+                m_pending_size = slot->size;
+                return slot;
+            }
+        }
+
+        if((unsigned int)finished == m_reader_count)
+            return 0;
+        backoff(spins);
+    }
+}
+
+void ReadPipeline::stop()
+{
+    if(m_readers)
+    {
+        InterlockedExchange(&m_stop, 1);
+        for(unsigned int r = 0; r < m_started; r++)
+        {
+            WaitForSingleObject(m_readers[r].thread, INFINITE);
+            CloseHandle(m_readers[r].thread);
+        }
+
+        delete [] m_readers;
+        m_readers = 0;
+        m_pending = 0;
+    }
+
+    if(m_find != INVALID_HANDLE_VALUE)
+    {
+        FindClose(m_find);
+        m_find = INVALID_HANDLE_VALUE;
+    }
+}
+
+//==================================================
@@ -0,0 +1,191 @@
+//==================================================
+// Copyright (C) 2011 by Norwegian Radiation Protection Authority
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// Authors: Dag Robøle,
+//
+//==================================================
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+//==================================================
+
+#include <vector>
+#include <Windows.h>
+#include "buffers.h"
+#include "limiter.h"
+
+//==================================================
+// THE READ STAGE OF THE CONVERSION PIPELINE.
+// ONE OR MORE READER THREADS TAKE THE NEXT ENTRY FROM THE DIRECTORY LISTING
+// AND READ THE FILE INTO A SLOT OF A BOUNDED RING BUFFER, ONE RING PER READER.
+// THE CONVERTING THREAD TAKES FILLED SLOTS FROM THE RINGS AND HANDS THEM BACK
+// WHEN DONE. THE DIRECTORY IS LISTED AS THE FILES ARE READ, SO CONVERSION OF
+// THE FIRST FILE STARTS AFTER THE FIRST DIRECTORY READ. A READER WAITS WHEN
+// ITS RING IS FULL OR THE BYTES HELD BY ALL RINGS WOULD EXCEED THE MEMORY BUDGET
+
+enum { READ_OK, READ_OPEN_FAILED, READ_SHORT, READ_CLAIMED, READ_NO_MEMORY };
+
+//==================================================
+// ORDER THE FILES ARE READ IN. LISTING IS THE ORDER OF THE DIRECTORY, INDEX
+// AND EXTENT LIST THE WHOLE DIRECTORY FIRST AND READ IN FILE INDEX ORDER OR
+// IN ORDER OF THE FIRST CLUSTER OF THE FILE DATA ON THE VOLUME, WHICH KEEPS
+// THE HEADS OF A ROTATING DISK MOVING ONE WAY
+
+enum { ORDER_LISTING, ORDER_INDEX, ORDER_EXTENT };
+
+struct ReadSlot
+{
+    char name[MAX_PATH + 1];
+    unsigned int size;
+    int status;
+    char* data;
+    unsigned int capacity;
+};
+
+//==================================================
+// FUNCTION DECIDING IF A LISTED FILE SHOULD BE READ. CALLED WITH THE
+// LISTING LOCKED SO IT NEEDS NO LOCKING OF ITS OWN
+
+typedef bool (*FileFilter)(const char* name, unsigned int size, void* context);
+
+//==================================================
+// SINGLE PRODUCER SINGLE CONSUMER RING OF SLOTS.
+// THE HEAD IS ONLY WRITTEN BY THE CONSUMER AND THE TAIL ONLY BY THE PRODUCER,
+// THE INTERLOCKED INCREMENTS PUBLISH THE SLOT CONTENTS TO THE OTHER THREAD
+
+class SlotRing
+{
+public:
+
+    SlotRing() : m_slots(0), m_capacity(0), m_head(0), m_tail(0) {}
+    ~SlotRing() { destroy(); }
+
+    bool init(unsigned int capacity);
+    void destroy();
+
+    ReadSlot* acquire_write() { return (unsigned int)(m_tail - m_head) < m_capacity ? &m_slots[(unsigned int)m_tail % m_capacity] : 0; }
+    void commit_write() { InterlockedIncrement(&m_tail); }
+    ReadSlot* acquire_read() { return m_head != m_tail ? &m_slots[(unsigned int)m_head % m_capacity] : 0; }
+    void commit_read() { InterlockedIncrement(&m_head); }
+
+private:
+
+    SlotRing(const SlotRing&);
+    SlotRing& operator=(const SlotRing&);
+
+    ReadSlot* m_slots;
+    unsigned int m_capacity;
+    volatile LONG m_head;
+    volatile LONG m_tail;
+};
+
+//==================================================
+
+class ReadPipeline
+{
+public:
+
+    ReadPipeline();
+    ~ReadPipeline() { stop(); DeleteCriticalSection(&m_listing_lock); }
+
+    void set_order(int order) { m_order = order; }
+    void set_limiter(IoLimiter* limiter) { m_limiter = limiter; }
+    bool start(const char* pattern, unsigned int readers, size_t memory_budget, const char* queue_dir, FileFilter filter, void* context);
+    const ReadSlot* next();
+    void stop();
+
+    bool found_files() const { return m_found; }
+    bool listing_failed() const { return m_listing_failed; }
+    unsigned int accepted_files() const { return m_accepted; }
+    unsigned int reader_threads() const { return m_started; }
+
+private:
+
+    ReadPipeline(const ReadPipeline&);
+    ReadPipeline& operator=(const ReadPipeline&);
+
+    struct Reader
+    {
+        ReadPipeline* pipeline;
+        SlotRing ring;
+        HANDLE thread;
+    };
+
+    struct ScheduledFile
+    {
+        unsigned int group;
+        unsigned __int64 key;
+        unsigned int name;
+        unsigned int size;
+        bool operator<(const ScheduledFile& other) const
+        {
+            return group != other.group ? group < other.group : key < other.key;
+        }
+    };
+
+    static unsigned __stdcall reader_main(void* arg);
+    void read_files(SlotRing& ring);
+    bool read_file(SlotRing& ring);
+    bool next_file(char* name, unsigned int& size);
+    bool list_file(char* name, unsigned int& size);
+    bool schedule();
+    bool reserve_memory(unsigned int size);
+
+    CRITICAL_SECTION m_listing_lock;
+    HANDLE m_find;
+    WIN32_FIND_DATA m_find_data;
+    bool m_have_entry;
+    bool m_found;
+    bool m_listing_failed;
+    unsigned int m_accepted;
+    FileFilter m_filter;
+    void* m_context;
+
+    int m_order;
+    NamePool m_scheduled_names;
+    std::vector<ScheduledFile> m_scheduled;
+    volatile LONG m_scheduled_next;
+
+    const char* m_queue_dir;
+    IoLimiter* m_limiter;
+    Reader* m_readers;
+    unsigned int m_reader_count;
+    unsigned int m_started;
+    unsigned int m_current;
+    SlotRing* m_pending;
+    unsigned int m_pending_size;
+    size_t m_memory_budget;
+    volatile LONG m_memory_used;
+    volatile LONG m_finished;
+    volatile LONG m_stop;
+};
+
+//==================================================
+
+bool claim_file(const char* queue_dir, const char* name);
+void backoff(unsigned int& spins);
+
+//==================================================
+
+#endif // PIPELINE_H
+
+//==================================================
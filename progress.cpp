@@ -0,0 +1,194 @@
+//==================================================
+// Copyright (C) 2011 by Norwegian Radiation Protection Authority
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// Authors: Dag Robøle,
+//
+//==================================================
+// HEADER INCLUDES
+
+#include <cstdio>
+#include <cstring>
+#include <process.h>
+#include "progress.h"
+
+//==================================================
+// MILLISECONDS BETWEEN REPORTS, LONGER WHEN STANDARD ERROR GOES TO A FILE
+// SO A LOG IS NOT FLOODED
+
+#define PROGRESS_INTERVAL_CONSOLE	250
+#define PROGRESS_INTERVAL_LOG		5000
+
+// DIRECTORY ENTRIES COUNTED BETWEEN LOOKS AT THE STOP EVENT
+
+#define PROGRESS_COUNT_BATCH		256
+
+//==================================================
+
+ProgressReporter::ProgressReporter()
+    : m_thread(0), m_stop(0), m_console(false), m_interval(PROGRESS_INTERVAL_LOG), m_started(0), m_pattern(0),
+      m_filter(0), m_context(0), m_total_files(0), m_total_bytes(0), m_totals_known(false), m_bytes(0), m_files(0), m_kilobytes(0), m_errors(0)
+{
+}
+
+bool ProgressReporter::start(const char* pattern, FileFilter filter, void* context)
+{
+    m_pattern = pattern;
+    m_filter = filter;
+    m_context = context;
+    m_console = GetFileType(GetStdHandle(STD_ERROR_HANDLE)) == FILE_TYPE_CHAR;
+    m_interval = m_console ? PROGRESS_INTERVAL_CONSOLE : PROGRESS_INTERVAL_LOG;
+    m_started = GetTickCount();
+
+    m_stop = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if(!m_stop)
+        return false;
+    m_thread = (HANDLE)_beginthreadex(NULL, 0, reporter_main, this, 0, NULL);
+    if(!m_thread)
+    {
+        CloseHandle(m_stop);
+        m_stop = 0;
+        return false;
+    }
+    return true;
+}
+
+//==================================================
+// FUNCTION STOPPING THE REPORTER AND WRITING THE LAST REPORT WITH THE TIME
+// THE RUN TOOK
+
+void ProgressReporter::stop()
+{
+    if(!m_thread)
+        return;
+
+    SetEvent(m_stop);
+    WaitForSingleObject(m_thread, INFINITE);
+    CloseHandle(m_thread);
+    CloseHandle(m_stop);
+    m_thread = m_stop = 0;
+    report(true);
+}
+
+unsigned __stdcall ProgressReporter::reporter_main(void* arg)
+{
+    ProgressReporter* progress = (ProgressReporter*)arg;
+    progress->count_files();
+    while(WaitForSingleObject(progress->m_stop, progress->m_interval) == WAIT_TIMEOUT)
+        progress->report(false);
+    return 0;
+}
+
+//==================================================
+// FUNCTION COUNTING THE FILES AND BYTES THE READERS WILL ACCEPT, WITH THE
+// SAME FILTER. ONLY NAMES AND SIZES ARE LOOKED AT, SO THIS PASS RUNS FAR
+// AHEAD OF THE READERS. THE REPORTS GO ON WHILE IT COUNTS, A STOPPED RUN OR
+// A FAILED LISTING LEAVES THE TOTALS UNKNOWN
+
+void ProgressReporter::count_files()
+{
+    WIN32_FIND_DATA data;
+    HANDLE hFind = FindFirstFile(m_pattern, &data);
+    if(hFind == INVALID_HANDLE_VALUE)
+        return;
+
+    DWORD reported = GetTickCount();
+    unsigned int entries = 0;
+    bool listed = true;
+    do
+    {
+        if(!(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+            && (!m_filter || m_filter(data.cFileName, (unsigned int)data.nFileSizeLow, m_context)))
+        {
+            ++m_total_files;
+            m_total_bytes += data.nFileSizeLow;
+        }
+
+        if(++entries % PROGRESS_COUNT_BATCH == 0)
+        {
+            if(WaitForSingleObject(m_stop, 0) != WAIT_TIMEOUT)
+            {
+                listed = false;
+                break;
+            }
+            if(GetTickCount() - reported >= m_interval)
+            {
+                report(false);
+                reported = GetTickCount();
+            }
+        }
+    }
+    while(FindNextFile(hFind, &data));
+
+    if(listed)
+        listed = GetLastError() == ERROR_NO_MORE_FILES;
+    FindClose(hFind);
+    m_totals_known = listed;
+}
+
+//==================================================
+// FUNCTION WRITING ONE REPORT. THE RATES ARE AVERAGES OVER THE WHOLE RUN,
+// THE TIME LEFT IS ESTIMATED FROM THE BYTES LEFT TO READ. UNTIL THE TOTALS
+// ARE KNOWN ONLY THE FILES DONE SO FAR ARE SHOWN
+
+void ProgressReporter::report(bool last)
+{
+    unsigned int files = (unsigned int)m_files;
+    unsigned __int64 bytes = (unsigned __int64)(unsigned long)m_kilobytes << 10;
+    unsigned int errors = (unsigned int)m_errors;
+    double seconds = (GetTickCount() - m_started) / 1000.0;
+
+    double files_rate = seconds > 0.0 ? files / seconds : 0.0;
+    double bytes_rate = seconds > 0.0 ? bytes / seconds : 0.0;
+    char count[40];
+    if(m_totals_known)
+    {
+        unsigned int percent = files < m_total_files ? (unsigned int)((unsigned __int64)files * 100 / m_total_files) : 100;
+        sprintf(count, "%u/%u files %3u%%", files, m_total_files, percent);
+    }
+    else sprintf(count, "%u files", files);
+
+    char left[40];
+    unsigned int time = (unsigned int)seconds;
+    if(last)
+        sprintf(left, "in %u:%02u:%02u", time / 3600, time / 60 % 60, time % 60);
+    else if(!m_totals_known)
+        strcpy(left, "counting files");
+    else
+    {
+        time = 0;
+        if(bytes_rate > 0.0 && m_total_bytes > bytes)
+            time = (unsigned int)((m_total_bytes - bytes) / bytes_rate);
+        sprintf(left, "ETA %u:%02u:%02u", time / 3600, time / 60 % 60, time % 60);
+    }
+
+    char line[160];
+    sprintf(line, "%s  %.1f files/s  %.1f MB/s  %u errors  %s", count, files_rate, bytes_rate / (1024 * 1024), errors, left);
+
+    // ON A CONSOLE EACH REPORT OVERWRITES THE LAST, THE TRAILING SPACES CLEAR
+    // WHAT IS LEFT OF A LONGER LINE
+
+    if(m_console)
+        fprintf(stderr, "\r%-78s%s", line, last ? "\n" : "");
+    else fprintf(stderr, "%s\n", line);
+    fflush(stderr);
+}
+
+//==================================================
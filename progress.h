@@ -0,0 +1,93 @@
+//==================================================
+// Copyright (C) 2011 by Norwegian Radiation Protection Authority
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// Authors: Dag Robøle,
+//
+//==================================================
+
+#ifndef PROGRESS_H
+#define PROGRESS_H
+
+//==================================================
+
+#include <Windows.h>
+#include "pipeline.h"
+
+//==================================================
+// REPORTS THE PROGRESS OF A RUN FROM A THREAD OF ITS OWN.
+// ONLY THE CONVERTING THREAD WRITES THE COUNTERS, SO PLAIN STORES TO THE
+// ALIGNED VOLATILE LONGS ARE ENOUGH AND A FILE COSTS NO LOCKED INSTRUCTION.
+// THE REPORTER MAY READ A COUNT ONE FILE LATE BUT NEVER TORN. IT WRITES THE
+// FILES AND MEGABYTES PER SECOND AND THE ERRORS TO STANDARD ERROR A FEW TIMES
+// PER SECOND, OVER ONE LINE WHEN IT IS A CONSOLE. THE REPORTER THREAD FIRST
+// COUNTS THE FILES THE READERS WILL ACCEPT IN A PASS OF ITS OWN OVER THE
+// DIRECTORY, WHILE THE READERS ALREADY LIST AND READ THEM, AND FROM THEN ON
+// THE TIME LEFT IS SHOWN TOO. ONLY THE REPORTER THREAD TOUCHES THE TOTALS
+
+class ProgressReporter
+{
+public:
+
+    ProgressReporter();
+    ~ProgressReporter() { stop(); }
+
+    bool start(const char* pattern, FileFilter filter, void* context);
+    void file_done(unsigned int size, unsigned int errors)
+    {
+        m_bytes += size;
+        m_kilobytes = (LONG)(m_bytes >> 10);
+        m_errors = (LONG)errors;
+        m_files = m_files + 1;
+    }
+    void set_errors(unsigned int errors) { m_errors = (LONG)errors; }
+    void stop();
+
+private:
+
+    ProgressReporter(const ProgressReporter&);
+    ProgressReporter& operator=(const ProgressReporter&);
+
+    static unsigned __stdcall reporter_main(void* arg);
+    void count_files();
+    void report(bool last);
+
+    HANDLE m_thread;
+    HANDLE m_stop;
+    bool m_console;
+    DWORD m_interval;
+    DWORD m_started;
+    const char* m_pattern;
+    FileFilter m_filter;
+    void* m_context;
+    unsigned int m_total_files;
+    unsigned __int64 m_total_bytes;
+    bool m_totals_known;
+    unsigned __int64 m_bytes;
+    volatile LONG m_files;
+    volatile LONG m_kilobytes;
+    volatile LONG m_errors;
+};
+
+//==================================================
+
+#endif // PROGRESS_H
+
+//==================================================
@@ -0,0 +1,221 @@
+//==================================================
+// Copyright (C) 2011 by Norwegian Radiation Protection Authority
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// Authors: Dag Robøle,
+//
+//==================================================
+// HEADER INCLUDES
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <vector>
+#include "dat2inp.h"
+
+//==================================================
+// PYTHON MODULE dat2inp._decoder, A THIN LAYER OVER THE C API.
+// THE OUTPUT ARRAYS ARE TAKEN THROUGH THE BUFFER PROTOCOL AND THE DECODER
+// WRITES STRAIGHT INTO THEM, SO NUMPY ARRAYS ARE FILLED WITHOUT A COPY AND
+// WITHOUT A BUILD DEPENDENCY ON NUMPY. THE GIL IS RELEASED WHILE DECODING
+
+static PyObject* header_fields(PyObject*, PyObject*)
+{
+    static const char* types[] = { "string", "char", "short", "int", "float" };
+
+    size_t count = 0;
+    const dat2inp_field* fields = dat2inp_header_fields(&count);
+    PyObject* list = PyList_New((Py_ssize_t)count);
+    if(!list)
+        return 0;
+
+    for(size_t i = 0; i < count; i++)
+    {
+        PyObject* item = Py_BuildValue("(ssnn)", fields[i].name, types[fields[i].type], (Py_ssize_t)fields[i].offset, (Py_ssize_t)fields[i].size);
+        if(!item)
+        {
+            Py_DECREF(list);
+            return 0;
+        }
+        PyList_SET_ITEM(list, (Py_ssize_t)i, item);
+    }
+    return list;
+}
+
+static PyObject* header_size(PyObject*, PyObject*)
+{
+    return PyLong_FromSize_t(dat2inp_header_size());
+}
+
+//==================================================
+// THE SOURCES OF ONE BATCH. PATHS ARE HELD AS ENCODED BYTES AND BUFFERS
+// STAY ACQUIRED UNTIL THE BATCH IS DONE, SO THE POINTERS HANDED TO THE
+// DECODER STAY VALID WHILE THE GIL IS RELEASED
+
+class BatchSources
+{
+public:
+
+    ~BatchSources()
+    {
+        for(size_t i = 0; i < m_views.size(); i++)
+            PyBuffer_Release(&m_views[i]);
+        for(size_t i = 0; i < m_paths.size(); i++)
+            Py_DECREF(m_paths[i]);
+    }
+
+    bool add(PyObject* item)
+    {
+        dat2inp_source source;
+        source.path = 0;
+        source.data = 0;
+        source.size = 0;
+
+        if(PyUnicode_Check(item) || PyObject_HasAttrString(item, "__fspath__"))
+        {
+            PyObject* path = 0;
+            if(!PyUnicode_FSConverter(item, &path))
+                return false;
+            m_paths.push_back(path);
+            source.path = PyBytes_AS_STRING(path);
+        }
+        else
+        {
+            Py_buffer view;
+            if(PyObject_GetBuffer(item, &view, PyBUF_SIMPLE) < 0)
+                return false;
+            m_views.push_back(view);
+            source.data = view.len ? (const char*)view.buf : "";
+            source.size = (size_t)view.len;
+        }
+        m_sources.push_back(source);
+        return true;
+    }
+
+    size_t count() const { return m_sources.size(); }
+    const dat2inp_source* sources() const { return m_sources.empty() ? 0 : &m_sources[0]; }
+
+private:
+
+    std::vector<dat2inp_source> m_sources;
+    std::vector<PyObject*> m_paths;
+    std::vector<Py_buffer> m_views;
+};
+
+//==================================================
+// decode_into(sources, headers, status, counts=None, threads=0)
+// sources IS A SEQUENCE OF PATHS OR BYTES-LIKE DAT FILES. headers MUST BE A
+// WRITABLE CONTIGUOUS BUFFER OF len(sources) * header_size() BYTES, status
+// ONE OF len(sources) 32 BIT INTS AND counts ONE OF len(sources) ROWS OF
+// 32 BIT COUNTS. RETURNS THE NUMBER OF SOURCES DECODED
+
+static bool writable_buffer(PyObject* object, Py_buffer& view, const char* name)
+{
+    if(PyObject_GetBuffer(object, &view, PyBUF_WRITABLE | PyBUF_C_CONTIGUOUS) < 0)
+        return false;
+    if(view.len % view.itemsize == 0)
+        return true;
+    PyBuffer_Release(&view);
+    PyErr_Format(PyExc_ValueError, "%s has a partial item", name);
+    return false;
+}
+
+static PyObject* decode_into(PyObject*, PyObject* args, PyObject* kwargs)
+{
+    static const char* keywords[] = { "sources", "headers", "status", "counts", "threads", 0 };
+    PyObject *sequence, *headers_object, *status_object, *counts_object = Py_None;
+    unsigned int threads = 0;
+    if(!PyArg_ParseTupleAndKeywords(args, kwargs, "OOO|OI", (char**)keywords, &sequence, &headers_object, &status_object, &counts_object, &threads))
+        return 0;
+
+    BatchSources sources;
+    PyObject* items = PySequence_Fast(sequence, "sources must be a sequence");
+    if(!items)
+        return 0;
+    for(Py_ssize_t i = 0; i < PySequence_Fast_GET_SIZE(items); i++)
+    {
+        if(!sources.add(PySequence_Fast_GET_ITEM(items, i)))
+        {
+            Py_DECREF(items);
+            return 0;
+        }
+    }
+    Py_DECREF(items);
+
+    size_t count = sources.count();
+    Py_buffer headers, status, counts;
+    bool have_counts = counts_object != Py_None;
+    if(!writable_buffer(headers_object, headers, "headers"))
+        return 0;
+    if(!writable_buffer(status_object, status, "status"))
+    {
+        PyBuffer_Release(&headers);
+        return 0;
+    }
+    if(have_counts && !writable_buffer(counts_object, counts, "counts"))
+    {
+        PyBuffer_Release(&headers);
+        PyBuffer_Release(&status);
+        return 0;
+    }
+
+    size_t max_channels = have_counts && count ? (size_t)counts.len / sizeof(unsigned int) / count : 0;
+    size_t decoded = 0;
+    if((size_t)headers.len != count * dat2inp_header_size())
+        PyErr_SetString(PyExc_ValueError, "headers must hold one header per source");
+    else if((size_t)status.len != count * sizeof(int) || status.itemsize != sizeof(int))
+        PyErr_SetString(PyExc_ValueError, "status must hold one 32 bit int per source");
+    else if(have_counts && ((size_t)counts.len != count * max_channels * sizeof(unsigned int) || counts.itemsize != sizeof(unsigned int)))
+        PyErr_SetString(PyExc_ValueError, "counts must hold one row of 32 bit counts per source");
+    else
+    {
+        Py_BEGIN_ALLOW_THREADS
+        decoded = dat2inp_decode_batch(sources.sources(), count, (IO_Header*)headers.buf, have_counts ? (unsigned int*)counts.buf : 0,
+                                       max_channels, (int*)status.buf, threads);
+        Py_END_ALLOW_THREADS
+    }
+
+    PyBuffer_Release(&headers);
+    PyBuffer_Release(&status);
+    if(have_counts)
+        PyBuffer_Release(&counts);
+    return PyErr_Occurred() ? 0 : PyLong_FromSize_t(decoded);
+}
+
+//==================================================
+
+static PyMethodDef g_methods[] =
+{
+    { "header_fields", header_fields, METH_NOARGS, "List the IO_Header fields as (name, type, offset, size)" },
+    { "header_size", header_size, METH_NOARGS, "Size in bytes of one decoded header" },
+    { "decode_into", (PyCFunction)decode_into, METH_VARARGS | METH_KEYWORDS, "Decode DAT files into caller supplied buffers" },
+    { 0, 0, 0, 0 }
+};
+
+static PyModuleDef g_module =
+{
+    PyModuleDef_HEAD_INIT, "dat2inp._decoder", "DAT file decoder of dat2inp", -1, g_methods
+};
+
+PyMODINIT_FUNC PyInit__decoder(void)
+{
+    return PyModule_Create(&g_module);
+}
+
+//==================================================
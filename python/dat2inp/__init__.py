@@ -0,0 +1,49 @@
+"""Decode gamma10 DAT files in process with the dat2inp decoder.
+
+decode() takes a list of DAT paths or bytes-like DAT files and returns the
+headers as a NumPy structured array, one field per IO_Header field, the
+status of each file and optionally the spectra as a channel matrix. The
+files are decoded on several threads with the GIL released, straight into
+the returned arrays.
+"""
+
+import numpy
+
+from ._decoder import decode_into, header_fields, header_size
+
+OK, OPEN_FAILED, READ_FAILED, TOO_SHORT, NO_SPECTRUM = range(5)
+
+_FORMATS = {"string": "S%d", "char": "S1", "short": "<i2", "int": "<i4", "float": "<f4"}
+
+
+def header_dtype():
+    """Return the NumPy dtype laid out exactly like the decoder's IO_Header."""
+    names, formats, offsets = [], [], []
+    for name, kind, offset, size in header_fields():
+        names.append(name)
+        formats.append(_FORMATS[kind] % size if kind == "string" else _FORMATS[kind])
+        offsets.append(offset)
+    return numpy.dtype({"names": names, "formats": formats, "offsets": offsets, "itemsize": header_size()})
+
+
+HEADER_DTYPE = header_dtype()
+
+
+def decode(sources, channels=0, threads=0):
+    """Decode a list of DAT files.
+
+    Returns (headers, status) or, when channels is above 0, (headers, status,
+    counts) where counts is a len(sources) by channels uint32 matrix holding
+    the first channels counts of each spectrum, padded with zeros. threads
+    is the number of decoding threads, 0 for one per processor.
+    """
+    sources = list(sources)
+    headers = numpy.zeros(len(sources), dtype=HEADER_DTYPE)
+    status = numpy.zeros(len(sources), dtype=numpy.int32)
+    if channels <= 0:
+        decode_into(sources, headers, status, None, threads)
+        return headers, status
+
+    counts = numpy.zeros((len(sources), channels), dtype=numpy.uint32)
+    decode_into(sources, headers, status, counts, threads)
+    return headers, status, counts
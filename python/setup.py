@@ -0,0 +1,23 @@
+# Builds the dat2inp Python package with its decoder extension:
+#
+#     python setup.py build_ext --inplace
+#
+# The extension compiles the decoder sources of dat2inp itself, so it always
+# decodes exactly like the program.
+
+from setuptools import setup, Extension
+
+decoder = Extension(
+    "dat2inp._decoder",
+    sources=["_decoder.cpp", "../api.cpp", "../header.cpp", "../spectrum.cpp"],
+    include_dirs=[".."],
+)
+
+setup(
+    name="dat2inp",
+    version="1.2",
+    description="Decode gamma10 DAT files into NumPy arrays",
+    packages=["dat2inp"],
+    ext_modules=[decoder],
+    install_requires=["numpy"],
+)
@@ -0,0 +1,445 @@
+//==================================================
+// Copyright (C) 2011 by Norwegian Radiation Protection Authority
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// Authors: Dag Robøle,
+//
+//==================================================
+// HEADER INCLUDES
+
+#include <cstring>
+#include <new>
+#include <process.h>
+#include "server.h"
+
+//==================================================
+// FUNCTION HANDLING ONE REQUEST, THE CONVERTED TEXT IS LEFT IN worker.record.
+// A PATH IS READ INTO THE BUFFER OF THE WORKER, DAT BYTES ARE CONVERTED
+// STRAIGHT FROM THE REQUEST
+
+static int serve_request(const ServeRequest& request, const char* payload, ServeConverter converter, void* context, ServeWorker& worker)
+{
+    if(request.reply != SERVE_INP && request.reply != SERVE_FIELDS)
+        return SERVE_BAD_REQUEST;
+
+    if(request.kind == SERVE_DATA)
+        return converter("", payload, request.length, request.reply, worker.record, context);
+
+    if(request.kind != SERVE_PATH || !request.length || request.length > MAX_PATH)
+        return SERVE_BAD_REQUEST;
+
+    char path[MAX_PATH + 1];
+    memcpy(path, payload, request.length);
+    path[request.length] = 0;
+
+    HANDLE hFile = CreateFile(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if(hFile == INVALID_HANDLE_VALUE)
+        return SERVE_OPEN_FAILED;
+
+    DWORD size = GetFileSize(hFile, NULL);
+    if(size == INVALID_FILE_SIZE || size > SERVE_MAX_REQUEST)
+    {
+        CloseHandle(hFile);
+        return SERVE_READ_FAILED;
+    }
+
+    if(worker.file.size() < size + 1)
+        worker.file.resize(size + 1);
+
+    DWORD total = 0, got = 0;
+    while(total < size && ReadFile(hFile, &worker.file[total], size - total, &got, NULL) && got)
+        total += got;
+    CloseHandle(hFile);
+    if(total < size)
+        return SERVE_READ_FAILED;
+
+    return converter(path, &worker.file[0], size, request.reply, worker.record, context);
+}
+
+//==================================================
+// FUNCTION ANSWERING UP TO max_requests COMPLETE REQUESTS IN input, THE
+// RESPONSES ARE APPENDED TO output AND COUNTED IN answered. RETURNS THE
+// NUMBER OF BYTES USED, A REQUEST NOT YET READ IN FULL OR BEYOND THE LIMIT IS
+// LEFT FOR THE NEXT CALL. A LENGTH ABOVE SERVE_MAX_REQUEST MEANS THE CLIENT
+// IS OUT OF STEP, IT IS ANSWERED WITH SERVE_BAD_REQUEST AND bad_request IS
+// SET SO THE CONNECTION IS CLOSED
+
+size_t serve_requests(const char* input, size_t size, unsigned int max_requests, ServeConverter converter, void* context, ServeWorker& worker,
+                      RecordBuffer& output, unsigned int& answered, bool& bad_request)
+{
+    size_t used = 0;
+    while(!bad_request && answered < max_requests && size - used >= sizeof(ServeRequest))
+    {
+        ServeRequest request;
+        memcpy(&request, input + used, sizeof(request));
+
+        ServeResponse response;
+        response.id = request.id;
+        response.length = 0;
+        worker.record.clear();
+
+        if(request.length > SERVE_MAX_REQUEST)
+        {
+            response.status = SERVE_BAD_REQUEST;
+            bad_request = true;
+            used = size;
+        }
+        else
+        {
+            if(size - used - sizeof(request) < request.length)
+                break;
+
+            response.status = serve_request(request, input + used + sizeof(request), converter, context, worker);
+            if(response.status == SERVE_OK)
+                response.length = (unsigned int)worker.record.size();
+            used += sizeof(request) + request.length;
+        }
+
+        output.append((const char*)&response, sizeof(response));
+        output.append(worker.record.data(), response.length);
+        ++answered;
+    }
+    return used;
+}
+
+//==================================================
+// SERVER
+
+#define SERVE_CHUNK	(64 * 1024)
+
+// A READ OR WRITE OF A CONNECTION. THE COMPLETION PORT HANDS BACK THE
+// OVERLAPPED, WHICH LEADS TO THE OPERATION AND ITS CONNECTION
+
+struct ConversionServer::Operation
+{
+    OVERLAPPED overlapped;
+    Connection* connection;
+};
+
+// THE CONNECT IS POSTED AS THE READ. THE REPLIES CONVERTED WHILE A WRITE IS
+// OUTSTANDING WAIT IN queued AND GO OUT IN THE NEXT WRITE. closing STOPS THE
+// ANSWERING AND READING BUT LETS THE REPLIES OUT, broken DROPS THEM AS WELL
+
+struct ConversionServer::Connection
+{
+    Operation reader;
+    Operation writer;
+    CRITICAL_SECTION lock;
+    HANDLE pipe;
+    bool connecting;
+    bool reading;
+    bool writing;
+    bool closing;
+    bool broken;
+    unsigned int queued_replies;
+    unsigned int written_replies;
+    std::vector<char> input;
+    RecordBuffer queued;
+    RecordBuffer output;
+    char chunk[SERVE_CHUNK];
+};
+
+bool ConversionServer::run(const char* pipe_name, unsigned int threads, ServeConverter converter, void* context)
+{
+    m_pipe_name = pipe_name;
+    m_converter = converter;
+    m_context = context;
+    if(!threads)
+        threads = 1;
+
+    m_port = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, threads);
+    if(!m_port || !listen())
+        return false;
+
+    // THE CALLING THREAD IS ONE OF THE SERVER THREADS
+
+    std::vector<HANDLE> started;
+    for(unsigned int t = 1; t < threads; t++)
+    {
+        HANDLE thread = (HANDLE)_beginthreadex(NULL, 0, thread_main, this, 0, NULL);
+        if(thread)
+            started.push_back(thread);
+    }
+
+    ServeWorker worker;
+    serve(worker);
+
+    for(size_t t = 0; t < started.size(); t++)
+    {
+        WaitForSingleObject(started[t], INFINITE);
+        CloseHandle(started[t]);
+    }
+    return true;
+}
+
+unsigned __stdcall ConversionServer::thread_main(void* arg)
+{
+    ServeWorker worker;
+    ((ConversionServer*)arg)->serve(worker);
+    return 0;
+}
+
+//==================================================
+// FUNCTION TAKING COMPLETIONS FROM THE PORT UNTIL IT IS CLOSED. A FAILED
+// OPERATION STILL RETURNS ITS OVERLAPPED, ONLY A FAILURE OF THE PORT ITSELF
+// RETURNS NONE
+
+void ConversionServer::serve(ServeWorker& worker)
+{
+    for(;;)
+    {
+        DWORD bytes = 0;
+        ULONG_PTR key = 0;
+        OVERLAPPED* overlapped = 0;
+        BOOL ok = GetQueuedCompletionStatus(m_port, &bytes, &key, &overlapped, INFINITE);
+        if(!overlapped)
+            return;
+        completed((Operation*)overlapped, bytes, ok != 0, worker);
+    }
+}
+
+//==================================================
+// FUNCTION OPENING A NEW PIPE INSTANCE AND WAITING FOR A CLIENT ON IT.
+// A NEW INSTANCE IS OPENED EACH TIME A CLIENT CONNECTS, SO THERE IS ALWAYS
+// ONE WAITING FOR THE NEXT CLIENT
+
+bool ConversionServer::listen()
+{
+    Connection* connection = new (std::nothrow) Connection;
+    if(!connection)
+        return false;
+
+    connection->pipe = CreateNamedPipe(m_pipe_name, PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED, PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT,
+                                       PIPE_UNLIMITED_INSTANCES, SERVE_CHUNK, SERVE_CHUNK, 0, NULL);
+    if(connection->pipe == INVALID_HANDLE_VALUE)
+    {
+        delete connection;
+        return false;
+    }
+
+    if(!CreateIoCompletionPort(connection->pipe, m_port, 0, 0))
+    {
+        CloseHandle(connection->pipe);
+        delete connection;
+        return false;
+    }
+
+    memset(&connection->reader.overlapped, 0, sizeof(connection->reader.overlapped));
+    connection->reader.connection = connection;
+    connection->writer.connection = connection;
+    connection->connecting = connection->reading = true;
+    connection->writing = connection->closing = connection->broken = false;
+    connection->queued_replies = connection->written_replies = 0;
+    InitializeCriticalSection(&connection->lock);
+
+    if(!ConnectNamedPipe(connection->pipe, &connection->reader.overlapped))
+    {
+        // A CLIENT CONNECTING BEFORE THE CALL GIVES NO COMPLETION, SO ONE IS POSTED
+
+        DWORD error = GetLastError();
+        if(error == ERROR_PIPE_CONNECTED)
+            PostQueuedCompletionStatus(m_port, 0, 0, &connection->reader.overlapped);
+        else if(error != ERROR_IO_PENDING)
+        {
+            DeleteCriticalSection(&connection->lock);
+            CloseHandle(connection->pipe);
+            delete connection;
+            return false;
+        }
+    }
+    return true;
+}
+
+//==================================================
+// FUNCTION RECORDING THE READ, WRITE OR CONNECT THAT COMPLETED AND MOVING THE
+// CONNECTION ON. THE CONNECTION IS DELETED HERE ONCE IT IS CLOSED AND NO
+// OPERATION OF IT IS OUTSTANDING
+
+void ConversionServer::completed(Operation* operation, DWORD bytes, bool ok, ServeWorker& worker)
+{
+    Connection* connection = operation->connection;
+    EnterCriticalSection(&connection->lock);
+
+    if(operation == &connection->writer)
+    {
+        connection->writing = false;
+        if(!ok || bytes != connection->output.size())
+            connection->broken = true;
+        connection->output.clear();
+        connection->written_replies = 0;
+    }
+    else if(connection->connecting)
+    {
+        connection->reading = connection->connecting = false;
+        listen();
+        if(!ok)
+            connection->broken = true;
+    }
+    else
+    {
+        // A FAILED OR EMPTY READ MEANS THE CLIENT HAS GONE
+        connection->reading = false;
+        if(!ok || !bytes)
+            connection->closing = true;
+        else connection->input.insert(connection->input.end(), connection->chunk, connection->chunk + bytes);
+    }
+
+    bool finished = advance(connection, worker);
+    LeaveCriticalSection(&connection->lock);
+
+    if(finished)
+    {
+        DeleteCriticalSection(&connection->lock);
+        delete connection;
+    }
+}
+
+//==================================================
+// FUNCTION ANSWERING THE COMPLETE REQUESTS READ SO FAR WHILE FEWER THAN
+// SERVE_MAX_PENDING REPLIES ARE WAITING, STARTING THE NEXT WRITE AND KEEPING
+// A READ POSTED. A CLIENT STILL SENDING IS NEVER HELD UP BY REPLIES IT HAS NOT
+// READ YET. THE REST OF A REQUEST SPLIT OVER TWO READS STAYS IN THE INPUT.
+// RETURNS TRUE WHEN THE CONNECTION IS CLOSED AND CAN BE DELETED
+
+bool ConversionServer::advance(Connection* connection, ServeWorker& worker)
+{
+    std::vector<char>& input = connection->input;
+    unsigned int pending = connection->queued_replies + connection->written_replies;
+    if(!connection->closing && !connection->broken && pending < SERVE_MAX_PENDING && !input.empty())
+    {
+        unsigned int answered = 0;
+        size_t used = serve_requests(&input[0], input.size(), SERVE_MAX_PENDING - pending, m_converter, m_context, worker,
+                                     connection->queued, answered, connection->closing);
+        input.erase(input.begin(), input.begin() + used);
+        connection->queued_replies += answered;
+    }
+    if(input.size() > SERVE_MAX_INPUT)
+        connection->closing = true;
+
+    if(!connection->writing && !connection->broken && connection->queued.size())
+    {
+        connection->output.swap(connection->queued);
+        connection->written_replies = connection->queued_replies;
+        connection->queued_replies = 0;
+        write(connection);
+    }
+
+    if(!connection->reading && !connection->closing && !connection->broken)
+        read(connection);
+
+    // ONCE ITS REPLIES ARE OUT A CLOSING CONNECTION IS CLOSED, WHICH COMPLETES
+    // A READ STILL POSTED. IT IS DELETED WHEN THAT COMPLETION HAS COME IN
+
+    if((connection->closing || connection->broken) && !connection->writing && connection->pipe != INVALID_HANDLE_VALUE)
+    {
+        DisconnectNamedPipe(connection->pipe);
+        CloseHandle(connection->pipe);
+        connection->pipe = INVALID_HANDLE_VALUE;
+    }
+    return connection->pipe == INVALID_HANDLE_VALUE && !connection->reading && !connection->writing;
+}
+
+void ConversionServer::read(Connection* connection)
+{
+    memset(&connection->reader.overlapped, 0, sizeof(connection->reader.overlapped));
+    connection->reading = ReadFile(connection->pipe, connection->chunk, SERVE_CHUNK, NULL, &connection->reader.overlapped)
+        || GetLastError() == ERROR_IO_PENDING;
+    if(!connection->reading)
+        connection->closing = true;
+}
+
+void ConversionServer::write(Connection* connection)
+{
+    memset(&connection->writer.overlapped, 0, sizeof(connection->writer.overlapped));
+    connection->writing = WriteFile(connection->pipe, connection->output.data(), (DWORD)connection->output.size(), NULL, &connection->writer.overlapped)
+        || GetLastError() == ERROR_IO_PENDING;
+    if(!connection->writing)
+        connection->broken = true;
+}
+
+//==================================================
+// CLIENT. WHEN ALL PIPE INSTANCES ARE BUSY connect WAITS FOR THE SERVER TO
+// OPEN THE NEXT ONE
+
+bool ServeClient::connect(const char* pipe_name)
+{
+    for(;;)
+    {
+        m_pipe = CreateFile(pipe_name, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL);
+        if(m_pipe != INVALID_HANDLE_VALUE)
+            return true;
+        if(GetLastError() != ERROR_PIPE_BUSY || !WaitNamedPipe(pipe_name, 5000))
+            return false;
+    }
+}
+
+bool ServeClient::send(unsigned int id, int kind, int reply, const char* data, unsigned int size)
+{
+    ServeRequest request;
+    request.id = id;
+    request.kind = (unsigned short)kind;
+    request.reply = (unsigned short)reply;
+    request.length = size;
+
+    DWORD written = 0;
+    if(!WriteFile(m_pipe, &request, sizeof(request), &written, NULL) || written != sizeof(request))
+        return false;
+    while(size)
+    {
+        if(!WriteFile(m_pipe, data, size, &written, NULL) || !written)
+            return false;
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+bool ServeClient::receive(ServeResponse& response, RecordBuffer& payload)
+{
+    if(!read_bytes((char*)&response, sizeof(response)))
+        return false;
+
+    payload.clear();
+    char chunk[4096];
+    for(unsigned int left = response.length; left; )
+    {
+        unsigned int n = left < sizeof(chunk) ? left : (unsigned int)sizeof(chunk);
+        if(!read_bytes(chunk, n))
+            return false;
+        payload.append(chunk, n);
+        left -= n;
+    }
+    return true;
+}
+
+bool ServeClient::read_bytes(char* dest, unsigned int size)
+{
+    DWORD got = 0;
+    while(size)
+    {
+        if(!ReadFile(m_pipe, dest, size, &got, NULL) || !got)
+            return false;
+        dest += got;
+        size -= got;
+    }
+    return true;
+}
+
+//==================================================
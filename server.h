@@ -0,0 +1,156 @@
+//==================================================
+// Copyright (C) 2011 by Norwegian Radiation Protection Authority
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// Authors: Dag Robøle,
+//
+//==================================================
+
+#ifndef SERVER_H
+#define SERVER_H
+
+//==================================================
+
+#include <vector>
+#include <Windows.h>
+#include "buffers.h"
+
+//==================================================
+// CONVERSION SERVICE ON A NAMED PIPE.
+// A CLIENT WRITES REQUESTS AND READS ONE RESPONSE PER REQUEST, IN THE ORDER
+// THE REQUESTS WERE SENT. REQUESTS CAN BE PIPELINED, THE SERVER KEEPS READING
+// WHILE IT WRITES RESPONSES AND CONVERTS UP TO SERVE_MAX_PENDING REQUESTS
+// AHEAD OF THE CLIENT READING THEIR RESPONSES. FURTHER REQUESTS WAIT UNTIL
+// IT DOES, AND A CLIENT WITH MORE THAN SERVE_MAX_INPUT BYTES OF REQUESTS
+// WAITING LIKE THIS IS DISCONNECTED.
+// EACH REQUEST IS A ServeRequest FOLLOWED BY length BYTES HOLDING EITHER THE
+// PATH OF A DAT FILE OR THE DAT FILE ITSELF. EACH RESPONSE IS A ServeResponse
+// FOLLOWED BY length BYTES OF INP TEXT OR ONE LINE OF JSON WITH THE FIELDS.
+// ALL NUMBERS ARE LITTLE ENDIAN
+
+enum { SERVE_PATH = 1, SERVE_DATA = 2 };
+enum { SERVE_INP = 1, SERVE_FIELDS = 2 };
+enum { SERVE_OK, SERVE_OPEN_FAILED, SERVE_READ_FAILED, SERVE_DECODE_FAILED, SERVE_BAD_REQUEST };
+
+#define SERVE_MAX_REQUEST	(16 * 1024 * 1024)
+#define SERVE_MAX_PENDING	64
+#define SERVE_MAX_INPUT		(4 * SERVE_MAX_REQUEST)
+
+struct ServeRequest
+{
+    unsigned int id;
+    unsigned short kind;
+    unsigned short reply;
+    unsigned int length;
+};
+
+struct ServeResponse
+{
+    unsigned int id;
+    unsigned int status;
+    unsigned int length;
+};
+
+//==================================================
+// FUNCTION CONVERTING ONE DAT FILE INTO out IN THE REQUESTED REPLY FORMAT.
+// CALLED BY SEVERAL SERVER THREADS AT ONCE, RETURNS A SERVE_ STATUS
+
+typedef int (*ServeConverter)(const char* name, const char* data, unsigned int size, int reply, RecordBuffer& out, void* context);
+
+//==================================================
+// THE SCRATCH BUFFERS OF ONE SERVER THREAD, KEPT FOR THE LIFE OF THE SERVER
+// SO A WARM SERVER CONVERTS WITHOUT ALLOCATING
+
+struct ServeWorker
+{
+    std::vector<char> file;
+    RecordBuffer record;
+};
+
+size_t serve_requests(const char* input, size_t size, unsigned int max_requests, ServeConverter converter, void* context, ServeWorker& worker,
+                      RecordBuffer& output, unsigned int& answered, bool& bad_request);
+
+//==================================================
+// THE SERVER. EVERY PIPE INSTANCE IS OPENED FOR OVERLAPPED I/O AND BOUND TO
+// ONE COMPLETION PORT, THE SERVER THREADS TAKE THE COMPLETIONS OF ALL
+// CONNECTIONS FROM THE PORT. A CONNECTION KEEPS A READ POSTED WHILE ITS
+// RESPONSES ARE WRITTEN, SO ITS READ AND WRITE CAN COMPLETE ON TWO THREADS
+// AT ONCE. EACH CONNECTION HAS A LOCK HELD WHILE A THREAD WORKS ON IT
+
+class ConversionServer
+{
+public:
+
+    ConversionServer() : m_port(0), m_pipe_name(0), m_converter(0), m_context(0) {}
+    ~ConversionServer() { if(m_port) CloseHandle(m_port); }
+
+    bool run(const char* pipe_name, unsigned int threads, ServeConverter converter, void* context);
+
+private:
+
+    ConversionServer(const ConversionServer&);
+    ConversionServer& operator=(const ConversionServer&);
+
+    struct Connection;
+    struct Operation;
+
+    static unsigned __stdcall thread_main(void* arg);
+    void serve(ServeWorker& worker);
+    bool listen();
+    void completed(Operation* operation, DWORD bytes, bool ok, ServeWorker& worker);
+    bool advance(Connection* connection, ServeWorker& worker);
+    void read(Connection* connection);
+    void write(Connection* connection);
+
+    HANDLE m_port;
+    const char* m_pipe_name;
+    ServeConverter m_converter;
+    void* m_context;
+};
+
+//==================================================
+// CLIENT SIDE OF THE SERVICE, USING A BLOCKING PIPE HANDLE
+
+class ServeClient
+{
+public:
+
+    ServeClient() : m_pipe(INVALID_HANDLE_VALUE) {}
+    ~ServeClient() { if(m_pipe != INVALID_HANDLE_VALUE) CloseHandle(m_pipe); }
+
+    bool connect(const char* pipe_name);
+    bool send(unsigned int id, int kind, int reply, const char* data, unsigned int size);
+    bool receive(ServeResponse& response, RecordBuffer& payload);
+
+private:
+
+    ServeClient(const ServeClient&);
+    ServeClient& operator=(const ServeClient&);
+
+    bool read_bytes(char* dest, unsigned int size);
+
+    HANDLE m_pipe;
+};
+
+//==================================================
+
+#endif // SERVER_H
+
+//==================================================
@@ -0,0 +1,272 @@
+//==================================================
+// Copyright (C) 2011 by Norwegian Radiation Protection Authority
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// Authors: Dag Robøle,
+//
+//==================================================
+// HEADER INCLUDES
+
+#include <algorithm>
+#include <queue>
+#include <Windows.h>
+#include "sorter.h"
+
+//==================================================
+// A SPILLED RUN IS A SEQUENCE OF RECORDS, EACH A RecordHeader FOLLOWED BY
+// length BYTES, IN SORTED ORDER
+
+struct RecordHeader
+{
+    __int64 key;
+    unsigned int sequence;
+    unsigned int length;
+};
+
+//==================================================
+// FUNCTION TO CREATE AN EMPTY TEMPORARY FILE FOR A RUN
+
+static FILE* create_run(std::string& path)
+{
+    char dir[MAX_PATH + 1], name[MAX_PATH + 1];
+    if(!GetTempPath(sizeof(dir), dir) || !GetTempFileName(dir, "d2i", 0, name))
+        return 0;
+
+    FILE* file = fopen(name, "wb");
+    if(!file)
+        DeleteFile(name);
+    else path = name;
+    return file;
+}
+
+//==================================================
+
+bool RecordSorter::add(__int64 key, const char* data, size_t size)
+{
+    if(m_failed)
+        return false;
+    if(m_data.size() && m_data.size() + size + (m_entries.size() + 1) * sizeof(Entry) > m_budget && !spill())
+    {
+        m_failed = true;
+        return false;
+    }
+
+    Entry entry;
+    entry.key = key;
+    entry.sequence = m_sequence++;
+    entry.length = (unsigned int)size;
+    entry.offset = m_data.size();
+    m_data.append(data, size);
+    m_entries.push_back(entry);
+    return true;
+}
+
+//==================================================
+// FUNCTION TO SORT THE RECORDS IN MEMORY AND WRITE THEM AS A NEW RUN. A RUN
+// THAT CAN NOT BE WRITTEN IN FULL IS DELETED AND NEVER TAKES PART IN THE
+// MERGE, THE RECORDS THEN STAY IN MEMORY
+
+bool RecordSorter::spill()
+{
+    std::string path;
+    FILE* file = create_run(path);
+    if(!file)
+        return false;
+
+    std::sort(m_entries.begin(), m_entries.end());
+    bool written = true;
+    for(std::vector<Entry>::const_iterator it = m_entries.begin(); written && it != m_entries.end(); ++it)
+    {
+        RecordHeader header = { it->key, it->sequence, it->length };
+        written = fwrite(&header, sizeof(header), 1, file) == 1
+            && fwrite(m_data.data() + it->offset, 1, it->length, file) == it->length;
+    }
+
+    if(fclose(file) || !written)
+    {
+        DeleteFile(path.c_str());
+        return false;
+    }
+    m_runs.push_back(path);
+
+    m_data.clear();
+    m_entries.clear();
+    return true;
+}
+
+//==================================================
+// ONE INPUT OF THE MERGE, A SPILLED RUN OR THE RECORDS STILL IN MEMORY
+
+struct MergeSource
+{
+    RecordHeader header;
+    FILE* file;
+    const char* memory;
+    size_t next;
+};
+
+struct MergeLater
+{
+    const std::vector<MergeSource>* sources;
+    explicit MergeLater(const std::vector<MergeSource>* s) : sources(s) {}
+    bool operator()(size_t a, size_t b) const
+    {
+        const RecordHeader& x = (*sources)[a].header;
+        const RecordHeader& y = (*sources)[b].header;
+        return x.key != y.key ? x.key > y.key : x.sequence > y.sequence;
+    }
+};
+
+//==================================================
+// FUNCTION MERGING THE FIRST count RUNS AND, WHEN with_memory IS SET, THE
+// SORTED RECORDS IN MEMORY. WITH keep_headers THE RECORDS ARE WRITTEN WITH
+// THEIR HEADERS SO out IS A NEW RUN, OTHERWISE THEY ARE THE FINAL OUTPUT.
+// THE RUNS ARE OPENED HERE, SO AT MOST count + 1 FILES ARE OPEN AT A TIME
+
+bool RecordSorter::merge(size_t count, bool with_memory, FILE* out, bool keep_headers)
+{
+    std::vector<MergeSource> sources(count + 1);
+    std::priority_queue<size_t, std::vector<size_t>, MergeLater> queue((MergeLater(&sources)));
+    std::vector<char> record;
+    bool merged = true;
+
+    for(size_t i = 0; i < sources.size(); i++)
+    {
+        MergeSource& source = sources[i];
+        source.file = 0;
+        source.memory = 0;
+        source.next = 0;
+        if(i < count)
+        {
+            source.file = fopen(m_runs[i].c_str(), "rb");
+            if(!source.file)
+                merged = false;
+            else if(fread(&source.header, sizeof(source.header), 1, source.file) == 1)
+                queue.push(i);
+        }
+        else if(with_memory && !m_entries.empty())
+        {
+            source.header.key = m_entries[0].key;
+            source.header.sequence = m_entries[0].sequence;
+            source.header.length = m_entries[0].length;
+            source.memory = m_data.data() + m_entries[0].offset;
+            queue.push(i);
+        }
+    }
+
+    while(merged && !queue.empty())
+    {
+        size_t i = queue.top();
+        queue.pop();
+        MergeSource& source = sources[i];
+
+        const char* data = source.memory;
+        if(source.file)
+        {
+            record.resize(source.header.length + 1);
+            if(fread(&record[0], 1, source.header.length, source.file) != source.header.length)
+            {
+                merged = false;
+                break;
+            }
+            data = &record[0];
+        }
+        if((keep_headers && fwrite(&source.header, sizeof(source.header), 1, out) != 1)
+            || fwrite(data, 1, source.header.length, out) != source.header.length)
+        {
+            merged = false;
+            break;
+        }
+
+        if(source.file)
+        {
+            if(fread(&source.header, sizeof(source.header), 1, source.file) == 1)
+                queue.push(i);
+        }
+        else if(++source.next < m_entries.size())
+        {
+            const Entry& entry = m_entries[source.next];
+            source.header.key = entry.key;
+            source.header.sequence = entry.sequence;
+            source.header.length = entry.length;
+            source.memory = m_data.data() + entry.offset;
+            queue.push(i);
+        }
+    }
+
+    for(size_t i = 0; i < count; i++)
+    {
+        if(sources[i].file)
+            fclose(sources[i].file);
+    }
+    return merged;
+}
+
+//==================================================
+// FUNCTION WRITING ALL RECORDS IN ORDER. WITHOUT SPILLED RUNS THE RECORDS
+// ARE SORTED AND WRITTEN STRAIGHT FROM MEMORY. THE RUNS ARE MERGED INTO NEW
+// ONES, OLDEST FIRST, UNTIL ONE MERGE TAKES THE REST WITH THE RECORDS IN
+// MEMORY. SINCE EVERY RECORD CARRIES ITS SEQUENCE NUMBER THE GROUPING OF THE
+// RUNS DOES NOT CHANGE THE ORDER OF EQUAL KEYS
+
+bool RecordSorter::finish(FILE* out)
+{
+    std::sort(m_entries.begin(), m_entries.end());
+    if(m_runs.empty())
+    {
+        for(std::vector<Entry>::const_iterator it = m_entries.begin(); it != m_entries.end(); ++it)
+        {
+            if(fwrite(m_data.data() + it->offset, 1, it->length, out) != it->length)
+                return false;
+        }
+        return !m_failed;
+    }
+
+    while(m_runs.size() >= SORT_MAX_FAN_IN)
+    {
+        std::string path;
+        FILE* file = create_run(path);
+        if(!file)
+            return false;
+
+        bool merged = merge(SORT_MAX_FAN_IN, false, file, true);
+        if(fclose(file) || !merged)
+        {
+            DeleteFile(path.c_str());
+            return false;
+        }
+
+        for(size_t i = 0; i < SORT_MAX_FAN_IN; i++)
+            DeleteFile(m_runs[i].c_str());
+        m_runs.erase(m_runs.begin(), m_runs.begin() + SORT_MAX_FAN_IN);
+        m_runs.push_back(path);
+    }
+
+    return merge(m_runs.size(), true, out, false) && !m_failed;
+}
+
+void RecordSorter::remove_runs()
+{
+    for(size_t i = 0; i < m_runs.size(); i++)
+        DeleteFile(m_runs[i].c_str());
+    m_runs.clear();
+}
+
+//==================================================
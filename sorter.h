@@ -0,0 +1,91 @@
+//==================================================
+// Copyright (C) 2011 by Norwegian Radiation Protection Authority
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// Authors: Dag Robøle,
+//
+//==================================================
+
+#ifndef SORTER_H
+#define SORTER_H
+
+//==================================================
+
+#include <cstdio>
+#include <vector>
+#include <string>
+#include "buffers.h"
+
+//==================================================
+// ORDERS OUTPUT RECORDS BY A 64 BIT KEY BEFORE THEY ARE WRITTEN.
+// RECORDS ARE COLLECTED IN MEMORY UNTIL THE BUDGET, WHICH ALSO COVERS THE
+// INDEX OF THE RECORDS, IS REACHED, THEN THE RUN IS SORTED AND SPILLED TO A
+// TEMPORARY FILE AND CLOSED. finish MERGES AT MOST SORT_MAX_FAN_IN RUNS AT A
+// TIME INTO A NEW RUN UNTIL THE REST FIT ONE MERGE WITH THE RECORDS IN
+// MEMORY, SO ANY NUMBER OF RECORDS IS SORTED IN BOUNDED MEMORY WITH A BOUNDED
+// NUMBER OF OPEN FILES. RECORDS WITH THE SAME KEY KEEP THE ORDER THEY WERE
+// ADDED IN. ONCE A SPILL FAILS NO MORE RECORDS ARE TAKEN, finish STILL
+// WRITES THE RECORDS ADDED BEFORE IT AND RETURNS FALSE
+
+#define SORT_MAX_FAN_IN	64
+
+class RecordSorter
+{
+public:
+
+    RecordSorter() : m_budget(0), m_sequence(0), m_failed(false) {}
+    ~RecordSorter() { remove_runs(); }
+
+    void init(size_t memory_budget) { m_budget = memory_budget; }
+    bool add(__int64 key, const char* data, size_t size);
+    bool finish(FILE* out);
+
+private:
+
+    RecordSorter(const RecordSorter&);
+    RecordSorter& operator=(const RecordSorter&);
+
+    struct Entry
+    {
+        __int64 key;
+        unsigned int sequence;
+        unsigned int length;
+        size_t offset;
+
+        bool operator<(const Entry& other) const { return key != other.key ? key < other.key : sequence < other.sequence; }
+    };
+
+    bool spill();
+    bool merge(size_t count, bool with_memory, FILE* out, bool keep_headers);
+    void remove_runs();
+
+    size_t m_budget;
+    unsigned int m_sequence;
+    bool m_failed;
+    RecordBuffer m_data;
+    std::vector<Entry> m_entries;
+    std::vector<std::string> m_runs;
+};
+
+//==================================================
+
+#endif // SORTER_H
+
+//==================================================
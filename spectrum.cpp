@@ -0,0 +1,365 @@
+//==================================================
+// Copyright (C) 2011 by Norwegian Radiation Protection Authority
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// Authors: Dag Robøle,
+//
+//==================================================
+// HEADER INCLUDES
+
+#include <cstring>
+#include "spectrum.h"
+
+// THE VECTOR VARIANTS ARE COMPILED WHEREVER THE COMPILER ALLOWS IT AND ONLY
+// RUN WHEN THE CPU SUPPORTS THEM. THE MICROSOFT COMPILER ACCEPTS ANY
+// INTRINSIC ON X86, OTHER COMPILERS ONLY THOSE ENABLED BY THEIR FLAGS
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define SPECTRUM_SSE2
+#include <emmintrin.h>
+#endif
+
+#if (defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))) || defined(__SSE4_1__)
+#define SPECTRUM_SSE41
+#include <smmintrin.h>
+#endif
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#elif defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#include <cpuid.h>
+#endif
+
+//==================================================
+// NAMES OF THE CPU LEVELS, AS GIVEN TO --cpu
+
+static const char* g_cpu_level_names[CPU_LEVEL_COUNT] = { "scalar", "sse2", "sse4.1", "sse4.2" };
+
+//==================================================
+// FUNCTION RETURNING A POINTER TO THE FIRST CHANNEL OF THE SPECTRUM IN A
+// DAT BUFFER, OR 0 IF THE CHANNEL COUNT DOES NOT FIT BEHIND THE HEADER
+
+const char* locate_spectrum(const char* buffer, unsigned int size, const IO_Header& io)
+{
+    if(io.channel_count <= 0 || size < DAT_HEADER_SIZE)
+        return 0;
+    if((unsigned int)io.channel_count > (size - DAT_HEADER_SIZE) / sizeof(int))
+        return 0;
+    return buffer + size - io.channel_count * sizeof(int);
+}
+
+//==================================================
+// SCALAR KERNELS. THE CHANNELS MAY BE UNALIGNED SINCE THEY ARE READ STRAIGHT
+// FROM THE FILE. THE VECTOR VARIANTS BELOW FINISH THEIR LAST CHANNELS WITH
+// THESE AND MUST GIVE THE SAME RESULTS
+
+static unsigned __int64 sum_counts_scalar(const char* channels, int count)
+{
+    unsigned __int64 total = 0;
+    for(int i = 0; i < count; i++)
+    {
+        unsigned int c;
+        memcpy(&c, channels + i * sizeof(int), sizeof(int));
+        total += c;
+    }
+    return total;
+}
+
+static void accumulate_counts_scalar(const char* channels, int count, unsigned __int64* sums)
+{
+    for(int i = 0; i < count; i++)
+    {
+        unsigned int c;
+        memcpy(&c, channels + i * sizeof(int), sizeof(int));
+        sums[i] += c;
+    }
+}
+
+static int max_counts_scalar(const char* channels, int count)
+{
+    int result = 0;
+    for(int i = 0; i < count; i++)
+    {
+        int c;
+        memcpy(&c, channels + i * sizeof(int), sizeof(int));
+        if(!i || c > result)
+            result = c;
+    }
+    return result;
+}
+
+//==================================================
+// SSE2 KERNELS, WIDENING FOUR CHANNELS AT A TIME BY UNPACKING WITH ZERO.
+// SSE2 HAS NO SIGNED 32 BIT MAXIMUM, SO IT IS BUILT FROM A COMPARE AND MASKS
+
+#ifdef SPECTRUM_SSE2
+
+static unsigned __int64 sum_counts_sse2(const char* channels, int count)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i acc = _mm_setzero_si128();
+    int i = 0;
+    for(; i + 4 <= count; i += 4)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)(channels + i * sizeof(int)));
+        acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(v, zero));
+        acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(v, zero));
+    }
+    unsigned __int64 lanes[2];
+    _mm_storeu_si128((__m128i*)lanes, acc);
+    return lanes[0] + lanes[1] + sum_counts_scalar(channels + i * sizeof(int), count - i);
+}
+
+static void accumulate_counts_sse2(const char* channels, int count, unsigned __int64* sums)
+{
+    __m128i zero = _mm_setzero_si128();
+    int i = 0;
+    for(; i + 4 <= count; i += 4)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)(channels + i * sizeof(int)));
+        __m128i* low = (__m128i*)(sums + i);
+        __m128i* high = (__m128i*)(sums + i + 2);
+        _mm_storeu_si128(low, _mm_add_epi64(_mm_loadu_si128(low), _mm_unpacklo_epi32(v, zero)));
+        _mm_storeu_si128(high, _mm_add_epi64(_mm_loadu_si128(high), _mm_unpackhi_epi32(v, zero)));
+    }
+    accumulate_counts_scalar(channels + i * sizeof(int), count - i, sums + i);
+}
+
+static int max_counts_sse2(const char* channels, int count)
+{
+    if(count < 4)
+        return max_counts_scalar(channels, count);
+
+    __m128i best = _mm_loadu_si128((const __m128i*)channels);
+    int i = 4;
+    for(; i + 4 <= count; i += 4)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)(channels + i * sizeof(int)));
+        __m128i gt = _mm_cmpgt_epi32(v, best);
+        best = _mm_or_si128(_mm_and_si128(gt, v), _mm_andnot_si128(gt, best));
+    }
+    int lanes[4];
+    _mm_storeu_si128((__m128i*)lanes, best);
+    int result = lanes[0];
+    for(int k = 1; k < 4; k++)
+        result = lanes[k] > result ? lanes[k] : result;
+    if(i < count)
+    {
+        int tail = max_counts_scalar(channels + i * sizeof(int), count - i);
+        result = tail > result ? tail : result;
+    }
+    return result;
+}
+
+#endif
+
+//==================================================
+// SSE4.1 KERNELS, WIDENING WITH pmovzxdq AND TAKING THE MAXIMUM WITH pmaxsd.
+// EIGHT CHANNELS ARE HANDLED PER ROUND WITH TWO ACCUMULATORS
+
+#ifdef SPECTRUM_SSE41
+
+static unsigned __int64 sum_counts_sse41(const char* channels, int count)
+{
+    __m128i acc0 = _mm_setzero_si128();
+    __m128i acc1 = _mm_setzero_si128();
+    int i = 0;
+    for(; i + 8 <= count; i += 8)
+    {
+        __m128i v0 = _mm_loadu_si128((const __m128i*)(channels + i * sizeof(int)));
+        __m128i v1 = _mm_loadu_si128((const __m128i*)(channels + (i + 4) * sizeof(int)));
+        acc0 = _mm_add_epi64(acc0, _mm_cvtepu32_epi64(v0));
+        acc1 = _mm_add_epi64(acc1, _mm_cvtepu32_epi64(_mm_srli_si128(v0, 8)));
+        acc0 = _mm_add_epi64(acc0, _mm_cvtepu32_epi64(v1));
+        acc1 = _mm_add_epi64(acc1, _mm_cvtepu32_epi64(_mm_srli_si128(v1, 8)));
+    }
+    unsigned __int64 lanes[2];
+    _mm_storeu_si128((__m128i*)lanes, _mm_add_epi64(acc0, acc1));
+    return lanes[0] + lanes[1] + sum_counts_scalar(channels + i * sizeof(int), count - i);
+}
+
+static void accumulate_counts_sse41(const char* channels, int count, unsigned __int64* sums)
+{
+    int i = 0;
+    for(; i + 4 <= count; i += 4)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)(channels + i * sizeof(int)));
+        __m128i* low = (__m128i*)(sums + i);
+        __m128i* high = (__m128i*)(sums + i + 2);
+        _mm_storeu_si128(low, _mm_add_epi64(_mm_loadu_si128(low), _mm_cvtepu32_epi64(v)));
+        _mm_storeu_si128(high, _mm_add_epi64(_mm_loadu_si128(high), _mm_cvtepu32_epi64(_mm_srli_si128(v, 8))));
+    }
+    accumulate_counts_scalar(channels + i * sizeof(int), count - i, sums + i);
+}
+
+static int max_counts_sse41(const char* channels, int count)
+{
+    if(count < 8)
+        return max_counts_scalar(channels, count);
+
+    __m128i best0 = _mm_loadu_si128((const __m128i*)channels);
+    __m128i best1 = _mm_loadu_si128((const __m128i*)(channels + 4 * sizeof(int)));
+    int i = 8;
+    for(; i + 8 <= count; i += 8)
+    {
+        best0 = _mm_max_epi32(best0, _mm_loadu_si128((const __m128i*)(channels + i * sizeof(int))));
+        best1 = _mm_max_epi32(best1, _mm_loadu_si128((const __m128i*)(channels + (i + 4) * sizeof(int))));
+    }
+    best0 = _mm_max_epi32(best0, best1);
+    best0 = _mm_max_epi32(best0, _mm_srli_si128(best0, 8));
+    best0 = _mm_max_epi32(best0, _mm_srli_si128(best0, 4));
+    int result = _mm_cvtsi128_si32(best0);
+    if(i < count)
+    {
+        int tail = max_counts_scalar(channels + i * sizeof(int), count - i);
+        result = tail > result ? tail : result;
+    }
+    return result;
+}
+
+#endif
+
+//==================================================
+// THE KERNELS IN USE. THEY START OUT SCALAR UNTIL select_spectrum_kernels
+// INSTALLS THE VARIANTS FOR A CPU LEVEL
+
+unsigned __int64 (*sum_counts)(const char* channels, int count) = sum_counts_scalar;
+void (*accumulate_counts)(const char* channels, int count, unsigned __int64* sums) = accumulate_counts_scalar;
+int (*max_counts)(const char* channels, int count) = max_counts_scalar;
+
+//==================================================
+// FUNCTION RETURNING THE HIGHEST CPU LEVEL SUPPORTED BY THE PROCESSOR,
+// FROM THE FEATURE FLAGS OF cpuid LEAF 1
+
+int detect_cpu_level()
+{
+    unsigned int ecx = 0, edx = 0;
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    int info[4];
+    __cpuid(info, 1);
+    ecx = (unsigned int)info[2];
+    edx = (unsigned int)info[3];
+#elif defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+    unsigned int eax, ebx;
+    if(!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+        ecx = edx = 0;
+#endif
+
+    if(ecx & (1 << 20))
+        return CPU_SSE42;
+    if(ecx & (1 << 19))
+        return CPU_SSE41;
+    if(edx & (1 << 26))
+        return CPU_SSE2;
+    return CPU_SCALAR;
+}
+
+//==================================================
+// FUNCTION TO INSTALL THE KERNELS FOR A CPU LEVEL. A LEVEL THAT WAS NOT
+// COMPILED IN FALLS BACK TO THE NEXT LOWER ONE, THE LEVEL INSTALLED IS RETURNED.
+// THE SSE4.2 LEVEL INSTALLS THE SSE4.1 KERNELS
+
+int select_spectrum_kernels(int level)
+{
+#ifdef SPECTRUM_SSE41
+    if(level >= CPU_SSE41)
+    {
+        sum_counts = sum_counts_sse41;
+        accumulate_counts = accumulate_counts_sse41;
+        max_counts = max_counts_sse41;
+        return level >= CPU_SSE42 ? CPU_SSE42 : CPU_SSE41;
+    }
+#endif
+
+#ifdef SPECTRUM_SSE2
+    if(level >= CPU_SSE2)
+    {
+        sum_counts = sum_counts_sse2;
+        accumulate_counts = accumulate_counts_sse2;
+        max_counts = max_counts_sse2;
+        return CPU_SSE2;
+    }
+#endif
+
+    sum_counts = sum_counts_scalar;
+    accumulate_counts = accumulate_counts_scalar;
+    max_counts = max_counts_scalar;
+    return CPU_SCALAR;
+}
+
+//==================================================
+// FUNCTIONS TO CONVERT BETWEEN CPU LEVELS AND THEIR NAMES.
+// find_cpu_level RETURNS -1 FOR AN UNKNOWN NAME
+
+int find_cpu_level(const char* name)
+{
+    for(int i = 0; i < CPU_LEVEL_COUNT; i++)
+        if(!strcmp(name, g_cpu_level_names[i]))
+            return i;
+    return -1;
+}
+
+const char* cpu_level_name(int level)
+{
+    return g_cpu_level_names[level];
+}
+
+//==================================================
+// FUNCTION TO COMPUTE THE SPECTRUM STATISTICS.
+// THE PEAK IS THE FIRST CHANNEL HOLDING THE LARGEST COUNT AND THE PREVIEW
+// REBINS THE SPECTRUM INTO SPECTRUM_PREVIEW_BINS EQUALLY WIDE BINS
+
+void compute_stats(const char* channels, const IO_Header& io, const std::vector<SpectrumROI>& rois, SpectrumStats& stats)
+{
+    int count = io.channel_count;
+
+    stats.total_counts = sum_counts(channels, count);
+    stats.peak_counts = max_counts(channels, count);
+    stats.peak_channel = 0;
+    for(int i = 0; i < count; i++)
+    {
+        int c;
+        memcpy(&c, channels + i * sizeof(int), sizeof(int));
+        if(c == stats.peak_counts)
+        {
+            stats.peak_channel = i;
+            break;
+        }
+    }
+    stats.count_rate = io.live_time > 0 ? (double)stats.total_counts / io.live_time : 0.0;
+
+    stats.roi_sums.resize(rois.size());
+    for(size_t r = 0; r < rois.size(); r++)
+    {
+        int first = rois[r].first_channel < 0 ? 0 : rois[r].first_channel;
+        int last = rois[r].last_channel >= count ? count - 1 : rois[r].last_channel;
+        stats.roi_sums[r] = first <= last ? sum_counts(channels + first * sizeof(int), last - first + 1) : 0;
+    }
+
+    for(int b = 0; b < SPECTRUM_PREVIEW_BINS; b++)
+    {
+        int first = (int)((__int64)count * b / SPECTRUM_PREVIEW_BINS);
+        int last = (int)((__int64)count * (b + 1) / SPECTRUM_PREVIEW_BINS);
+        stats.preview[b] = sum_counts(channels + first * sizeof(int), last - first);
+    }
+}
+
+//==================================================
@@ -0,0 +1,83 @@
+//==================================================
+// Copyright (C) 2011 by Norwegian Radiation Protection Authority
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// Authors: Dag Robøle,
+//
+//==================================================
+
+#ifndef SPECTRUM_H
+#define SPECTRUM_H
+
+//==================================================
+
+#include <vector>
+#include "main.h"
+
+//==================================================
+// THE SPECTRUM IS STORED AS channel_count 32 BIT COUNTS AT THE END OF THE
+// DAT FILE, AFTER THE HEADER AND ITS PADDING RECORD
+
+#define SPECTRUM_PREVIEW_BINS	64
+
+struct SpectrumROI
+{
+    int first_channel;
+    int last_channel;
+};
+
+struct SpectrumStats
+{
+    unsigned __int64 total_counts;
+    int peak_channel;
+    int peak_counts;
+    double count_rate;
+    std::vector<unsigned __int64> roi_sums;
+    unsigned __int64 preview[SPECTRUM_PREVIEW_BINS];
+};
+
+//==================================================
+// THE CHANNEL KERNELS ARE FUNCTION POINTERS, SET BY select_spectrum_kernels
+// TO THE SCALAR, SSE2 OR SSE4.1 VARIANTS. ALL VARIANTS GIVE THE SAME RESULTS.
+// SSE4.2 ONLY ADDS STRING INSTRUCTIONS, USED BY THE HEADER KERNELS IN
+// header.h, AND ITS LEVEL USES THE SSE4.1 CHANNEL KERNELS. THE MICROSOFT
+// COMPILER THE PROGRAM IS BUILT WITH HAS NO AVX INTRINSICS, SO SSE4.2 IS THE
+// HIGHEST LEVEL
+
+enum { CPU_SCALAR, CPU_SSE2, CPU_SSE41, CPU_SSE42, CPU_LEVEL_COUNT };
+
+int detect_cpu_level();
+int select_spectrum_kernels(int level);
+int find_cpu_level(const char* name);
+const char* cpu_level_name(int level);
+
+//==================================================
+
+const char* locate_spectrum(const char* buffer, unsigned int size, const IO_Header& io);
+extern unsigned __int64 (*sum_counts)(const char* channels, int count);
+extern int (*max_counts)(const char* channels, int count);
+extern void (*accumulate_counts)(const char* channels, int count, unsigned __int64* sums);
+void compute_stats(const char* channels, const IO_Header& io, const std::vector<SpectrumROI>& rois, SpectrumStats& stats);
+
+//==================================================
+
+#endif // SPECTRUM_H
+
+//==================================================
@@ -0,0 +1,136 @@
+//==================================================
+// Copyright (C) 2011 by Norwegian Radiation Protection Authority
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// Authors: Dag Robøle,
+//
+//==================================================
+//
+// TEST THAT format_float WRITES THE SAME TEXT AS THE PLAIN LOOP IT REPLACES,
+// printf("%.*g") WITH PRECISION 1, 2 AND UP UNTIL THE TEXT READS BACK AS THE
+// SAME float. THE BIT PATTERNS ARE RANDOM, DENORMAL, AROUND THE POWERS OF
+// TEN, SHORT DECIMALS, ZEROS, INFINITIES AND NANS
+//
+//==================================================
+// HEADER INCLUDES
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "../numbers.h"
+
+//==================================================
+
+#define TEST_RANDOM_PATTERNS	300000
+#define TEST_DENORMALS			100000
+#define TEST_DECIMALS			200000
+
+static unsigned int next_random(unsigned int& state)
+{
+    state = state * 1103515245 + 12345;
+    return (state >> 16) | (state << 16);
+}
+
+static unsigned int float_bits(float val)
+{
+    unsigned int bits;
+    memcpy(&bits, &val, sizeof(bits));
+    return bits;
+}
+
+//==================================================
+// FUNCTION COMPARING format_float WITH THE LOOP FOR ONE BIT PATTERN, RETURNS
+// FALSE AND PRINTS BOTH WHEN THEY DIFFER. NAN AND INFINITY MUST GIVE NOTHING
+
+static bool same_text(unsigned int bits)
+{
+    float val;
+    memcpy(&val, &bits, sizeof(val));
+
+    char expected[64], text[64];
+    expected[0] = 0;
+    if(val == val && val - val == 0.0f)
+    {
+        for(int precision = 1; precision <= 9; precision++)
+        {
+            sprintf(expected, "%.*g", precision, (double)val);
+            if((float)strtod(expected, 0) == val)
+                break;
+        }
+    }
+
+    text[format_float(val, text)] = 0;
+    if(!strcmp(expected, text))
+        return true;
+
+    fprintf(stderr, "format_float: %08x gives '%s', the printf loop gives '%s'\n", bits, text, expected);
+    return false;
+}
+
+int main()
+{
+    unsigned int state = 1, cases = 0, failures = 0;
+
+    static const unsigned int edges[] = {
+        0x00000000, 0x80000000, 0x7F800000, 0xFF800000, 0x7FC00000, 0xFFC00000, 0x7F800001, 0x7FFFFFFF,
+        0x00000001, 0x80000001, 0x007FFFFF, 0x807FFFFF, 0x00800000, 0x80800000, 0x7F7FFFFF, 0xFF7FFFFF,
+        0x3F800000, 0xBF800000, 0x3F7FFFFF, 0x3F800001 };
+    for(size_t i = 0; i < sizeof(edges) / sizeof(edges[0]); i++, cases++)
+        failures += !same_text(edges[i]);
+
+    for(int i = 0; i < TEST_RANDOM_PATTERNS; i++, cases++)
+        failures += !same_text(next_random(state));
+
+    for(int i = 0; i < TEST_DENORMALS; i++, cases++)
+        failures += !same_text((next_random(state) & 0x807FFFFF) | 1);
+
+    // EVERY POWER OF TEN IN RANGE AND THE FLOATS NEXT TO IT, WHERE THE
+    // SHORTEST TEXT CHANGES LENGTH AND THE %g FORM SWITCHES TO AN EXPONENT
+
+    for(int p = -45; p <= 38; p++)
+    {
+        char power[16];
+        sprintf(power, "1e%d", p);
+        unsigned int bits = float_bits((float)strtod(power, 0));
+        for(int d = -2; d <= 2; d++, cases += 2)
+        {
+            failures += !same_text(bits + d);
+            failures += !same_text((bits + d) | 0x80000000);
+        }
+    }
+
+    // SHORT DECIMALS AS TYPED IN THE HEADERS, SUCH AS 0.25 OR 1460.8. MANY
+    // OF THEM ARE AN EXACT HALF AT A SHORTER PRECISION, WHICH ONLY THE
+    // RUNTIME CAN ROUND
+
+    for(int i = 0; i < TEST_DECIMALS; i++, cases++)
+    {
+        char decimal[32];
+        sprintf(decimal, "%ue%d", next_random(state) % 100000, (int)(next_random(state) % 30) - 15);
+        failures += !same_text(float_bits((float)strtod(decimal, 0)));
+    }
+
+    if(failures)
+        return 1;
+    printf("format_float: %u bit patterns passed\n", cases);
+    return 0;
+}
+
+//==================================================
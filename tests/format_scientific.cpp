@@ -0,0 +1,137 @@
+//==================================================
+// Copyright (C) 2011 by Norwegian Radiation Protection Authority
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// Authors: Dag Robøle,
+//
+//==================================================
+//
+// TEST THAT format_scientific WRITES THE SAME TEXT AS printf("%.14e") IN THE
+// C LOCALE. THE BIT PATTERNS ARE RANDOM, DENORMAL, AROUND THE POWERS OF TEN,
+// EXACT TIES AT THE FIFTEENTH DIGIT, ZEROS, INFINITIES AND NANS
+//
+//==================================================
+// HEADER INCLUDES
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include "../numbers.h"
+
+//==================================================
+
+#define TEST_RANDOM_PATTERNS	1000000
+#define TEST_DENORMALS			200000
+#define TEST_TIES_PER_DECADE	2000
+
+static unsigned int next_random(unsigned int& state)
+{
+    state = state * 1103515245 + 12345;
+    return (state >> 16) | (state << 16);
+}
+
+//==================================================
+// FUNCTION COMPARING format_scientific WITH THE RUNTIME FOR ONE BIT PATTERN,
+// RETURNS FALSE AND PRINTS BOTH WHEN THEY DIFFER
+
+static bool same_text(unsigned int bits)
+{
+    float val;
+    memcpy(&val, &bits, sizeof(val));
+
+    char expected[64], text[64];
+    sprintf(expected, "%.14e", (double)val);
+    text[format_scientific(val, text)] = 0;
+    if(!strcmp(expected, text))
+        return true;
+
+    fprintf(stderr, "format_scientific: %08x gives %s, printf gives %s\n", bits, text, expected);
+    return false;
+}
+
+static unsigned int float_bits(float val)
+{
+    unsigned int bits;
+    memcpy(&bits, &val, sizeof(bits));
+    return bits;
+}
+
+int main()
+{
+    unsigned int state = 1, cases = 0, failures = 0;
+
+    // ZEROS, INFINITIES, NANS AND THE ENDS OF THE NORMAL AND DENORMAL RANGES
+
+    static const unsigned int edges[] = {
+        0x00000000, 0x80000000, 0x7F800000, 0xFF800000, 0x7FC00000, 0xFFC00000, 0x7F800001, 0x7FFFFFFF,
+        0x00000001, 0x80000001, 0x007FFFFF, 0x807FFFFF, 0x00800000, 0x80800000, 0x7F7FFFFF, 0xFF7FFFFF,
+        0x3F800000, 0xBF800000, 0x3F7FFFFF, 0x3F800001 };
+    for(size_t i = 0; i < sizeof(edges) / sizeof(edges[0]); i++, cases++)
+        failures += !same_text(edges[i]);
+
+    for(int i = 0; i < TEST_RANDOM_PATTERNS; i++, cases++)
+        failures += !same_text(next_random(state));
+
+    for(int i = 0; i < TEST_DENORMALS; i++, cases++)
+        failures += !same_text((next_random(state) & 0x807FFFFF) | 1);
+
+    // EVERY POWER OF TEN IN RANGE AND THE FLOATS NEXT TO IT
+
+    for(int p = -45; p <= 38; p++)
+    {
+        char power[16];
+        sprintf(power, "1e%d", p);
+        unsigned int bits = float_bits((float)strtod(power, 0));
+        for(int d = -2; d <= 2; d++, cases += 2)
+        {
+            failures += !same_text(bits + d);
+            failures += !same_text((bits + d) | 0x80000000);
+        }
+    }
+
+    // AN ODD MULTIPLE OF 2^-k BETWEEN 10^j AND 10^(j+1) HAS j+1+k SIGNIFICANT
+    // DIGITS AND ENDS IN 5, SO WITH k = 15-j IT IS AN EXACT TIE AT THE
+    // FIFTEENTH DIGIT. THE MANTISSA MUST FIT 24 BITS, WHICH HOLDS FOR j FROM
+    // -7 TO 3
+
+    for(int j = -7; j <= 3; j++)
+    {
+        int k = 15 - j;
+        double low = ldexp(pow(10.0, j), k), high = ldexp(pow(10.0, j + 1), k);
+        if(high > 16777216.0)
+            high = 16777216.0;
+        unsigned int first = (unsigned int)ceil(low) | 1, range = (unsigned int)(high - first);
+        for(int i = 0; i < TEST_TIES_PER_DECADE && range; i++, cases++)
+        {
+            unsigned int m = (first + next_random(state) % range) | 1;
+            if(m >= high)
+                m -= 2;
+            failures += !same_text(float_bits((float)ldexp((double)m, -k)));
+        }
+    }
+
+    if(failures)
+        return 1;
+    printf("format_scientific: %u bit patterns passed\n", cases);
+    return 0;
+}
+
+//==================================================
@@ -0,0 +1,183 @@
+//==================================================
+// Copyright (C) 2011 by Norwegian Radiation Protection Authority
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// Authors: Dag Robøle,
+//
+//==================================================
+//
+// FUZZ HARNESS FOR decode_header AND encode_header. BUILT WITH
+// -DHEADER_LIBFUZZER IT IS A libFuzzer TARGET, OTHERWISE main BELOW FEEDS
+// IT RANDOM AND MUTATED HEADERS. EVERY INPUT MUST DECODE WITHOUT READING
+// PAST ITS SIZE, GIVE TERMINATED STRINGS, AND ENCODE BACK TO THE SAME BYTES
+//
+//==================================================
+// HEADER INCLUDES
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "../header.h"
+#include "header_fields.h"
+
+using namespace std;
+
+//==================================================
+// FUNCTION STOPPING THE RUN ON A FAILED CHECK, abort LETS libFuzzer SAVE THE INPUT
+
+static void fail(const char* what, const char* field)
+{
+    fprintf(stderr, "fuzz_header: %s%s\n", what, field ? field : "");
+    abort();
+}
+
+//==================================================
+// THE FUZZ TARGET
+
+extern "C" int LLVMFuzzerTestOneInput(const unsigned char* data, size_t size)
+{
+    IO_Header io, again;
+    memset((void*)&io, 0, sizeof(io));
+    memset((void*)&again, 0, sizeof(again));
+
+    if(!decode_header((const char*)data, size, io))
+    {
+        if(size >= DAT_HEADER_SIZE)
+            fail("decode refused a full header", 0);
+        return 0;
+    }
+    if(size < DAT_HEADER_SIZE)
+        fail("decode accepted a short header", 0);
+
+    const TestField* field = unterminated_string(io);
+    if(field)
+        fail("unterminated string in field ", field->name);
+
+    // A decoded header is written back untouched, so the bytes must not change
+
+    vector<char> buffer(data, data + DAT_HEADER_SIZE);
+    if(!encode_header(io, &buffer[0]))
+        fail("encode cut off a decoded string", 0);
+    if(memcmp(&buffer[0], data, DAT_HEADER_SIZE))
+        fail("encode changed the bytes of a decoded header", 0);
+
+    decode_header(&buffer[0], buffer.size(), again);
+    field = first_difference(io, again);
+    if(field)
+        fail("re-decoded header differs in field ", field->name);
+    return 0;
+}
+
+#ifndef HEADER_LIBFUZZER
+
+//==================================================
+// THE STANDALONE DRIVER. HALF OF THE INPUTS ARE RANDOM BYTES, THE OTHER HALF
+// A VALID HEADER WITH SOME BYTES, LENGTH BYTES OR THE SIZE MUTATED. EACH INPUT
+// IS COPIED INTO A BUFFER OF EXACTLY ITS SIZE SO A SANITIZER CATCHES OVERREADS
+
+#define FUZZ_SIZE	512
+
+static unsigned int random_below(unsigned int n)
+{
+    return (unsigned int)(((unsigned int)rand() << 15 ^ (unsigned int)rand()) % n);
+}
+
+static void make_seed(unsigned char* seed)
+{
+    static const char* const strings[] = { "S001", "SAMPLE FROM THE NORTH FIELD", "PRJ", "OSTERAS" };
+    static const size_t offsets[] = { 0, 5, 46, 51 };
+
+    memset(seed, 0, FUZZ_SIZE);
+    for(unsigned int i=0; i<sizeof(offsets) / sizeof(offsets[0]); i++)
+    {
+        seed[offsets[i]] = (unsigned char)strlen(strings[i]);
+        memcpy(seed + offsets[i] + 1, strings[i], strlen(strings[i]));
+    }
+    int real_time = 3600, live_time = 3550;
+    memcpy(seed + 193, &real_time, sizeof(int));
+    memcpy(seed + 197, &live_time, sizeof(int));
+}
+
+static void mutate(unsigned char* input, size_t& size)
+{
+    static const unsigned char lengths[] = { 0, 1, 2, 3, 4, 12, 13, 30, 40, 41, 127, 128, 255 };
+    static const size_t strings[] = { 0, 5, 46, 51, 116, 119, 122, 125, 128, 141, 154, 167, 180, 209, 222, 239, 271, 284, 297, 310 };
+
+    unsigned int changes = 1 + random_below(8);
+    for(unsigned int i=0; i<changes; i++)
+    {
+        switch(random_below(4))
+        {
+            case 0:
+                input[random_below(FUZZ_SIZE)] ^= (unsigned char)(1 << random_below(8));
+                break;
+            case 1:
+                input[random_below(FUZZ_SIZE)] = (unsigned char)random_below(256);
+                break;
+            case 2:
+                input[strings[random_below(sizeof(strings) / sizeof(strings[0]))]] = lengths[random_below(sizeof(lengths))];
+                break;
+            default:
+                memset(input + strings[random_below(sizeof(strings) / sizeof(strings[0]))] + 1, random_below(2) ? ' ' : 0, 2);
+                break;
+        }
+    }
+    if(!random_below(4))
+        size = random_below(FUZZ_SIZE + 1);
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned int iterations = argc > 1 ? (unsigned int)atoi(argv[1]) : 200000;
+    srand(argc > 2 ? (unsigned int)atoi(argv[2]) : 1);
+
+    unsigned char seed[FUZZ_SIZE], input[FUZZ_SIZE];
+    make_seed(seed);
+
+    for(unsigned int i=0; i<iterations; i++)
+    {
+        size_t size = FUZZ_SIZE;
+        if(i & 1)
+        {
+            memcpy(input, seed, FUZZ_SIZE);
+            mutate(input, size);
+        }
+        else
+        {
+            for(size_t j=0; j<FUZZ_SIZE; j++)
+                input[j] = (unsigned char)random_below(256);
+            if(!random_below(8))
+                size = random_below(FUZZ_SIZE + 1);
+        }
+
+        unsigned char* exact = new unsigned char[size ? size : 1];
+        memcpy(exact, input, size);
+        LLVMFuzzerTestOneInput(exact, size);
+        delete[] exact;
+    }
+
+    printf("fuzz_header: %u headers passed\n", iterations);
+    return 0;
+}
+
+#endif // HEADER_LIBFUZZER
+
+//==================================================
@@ -0,0 +1,92 @@
+//==================================================
+// Copyright (C) 2011 by Norwegian Radiation Protection Authority
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// Authors: Dag Robøle,
+//
+//==================================================
+
+#ifndef HEADER_FIELDS_H
+#define HEADER_FIELDS_H
+
+//==================================================
+
+#include <cstddef>
+#include <cstring>
+#include "../main.h"
+
+//==================================================
+// THE IO_Header FIELDS AS A TABLE FOR THE TESTS, GENERATED FROM THE SAME
+// IO_HEADER_FIELDS LIST AS THE PROGRAM SO A NEW FIELD IS TESTED AS WELL
+
+enum { TEST_STRING, TEST_CHAR, TEST_SHORT, TEST_INT, TEST_FLOAT };
+
+struct TestField
+{
+    const char* name;
+    size_t offset;
+    int type;
+    size_t size;
+};
+
+#define TEST_FIELD(name, type, label) { #name, offsetof(IO_Header, name), TEST_##type, sizeof(((IO_Header*)0)->name) },
+
+static const TestField g_test_fields[] = { IO_HEADER_FIELDS(TEST_FIELD) };
+static const unsigned int g_test_field_count = sizeof(g_test_fields) / sizeof(g_test_fields[0]);
+
+#undef TEST_FIELD
+
+//==================================================
+// FUNCTION RETURNING THE FIRST FIELD THAT DIFFERS BETWEEN TWO HEADERS, OR 0.
+// STRINGS ARE COMPARED UP TO THEIR TERMINATOR, NUMBERS BY THEIR BYTES SO A
+// NaN COMPARES EQUAL TO ITSELF
+
+inline const TestField* first_difference(const IO_Header& a, const IO_Header& b)
+{
+    for(unsigned int i=0; i<g_test_field_count; i++)
+    {
+        const TestField& field = g_test_fields[i];
+        const char* pa = (const char*)&a + field.offset;
+        const char* pb = (const char*)&b + field.offset;
+        if(field.type == TEST_STRING ? strcmp(pa, pb) != 0 : memcmp(pa, pb, field.size) != 0)
+            return &field;
+    }
+    return 0;
+}
+
+//==================================================
+// FUNCTION RETURNING THE FIRST STRING FIELD WITHOUT A TERMINATOR INSIDE ITS ARRAY, OR 0
+
+inline const TestField* unterminated_string(const IO_Header& io)
+{
+    for(unsigned int i=0; i<g_test_field_count; i++)
+    {
+        const TestField& field = g_test_fields[i];
+        if(field.type == TEST_STRING && !memchr((const char*)&io + field.offset, 0, field.size))
+            return &field;
+    }
+    return 0;
+}
+
+//==================================================
+
+#endif // HEADER_FIELDS_H
+
+//==================================================
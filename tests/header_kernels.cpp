@@ -0,0 +1,190 @@
+//==================================================
+// Copyright (C) 2011 by Norwegian Radiation Protection Authority
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// Authors: Dag Robøle,
+//
+//==================================================
+//
+// TEST THAT EVERY HEADER KERNEL LEVEL THE PROCESSOR SUPPORTS TRIMS STRINGS
+// EXACTLY LIKE THE SCALAR KERNEL, AND THAT extract_string GIVES THE SAME
+// BYTES AS THE strncpy AND isspace LOOP IT REPLACED. THE STRINGS MIX WHITE
+// SPACE, NULL CHARACTERS, CONTROL CHARACTERS NEXT TO THE WHITE SPACE RANGE
+// AND BYTES ABOVE 127, AT EVERY LENGTH UP TO A FEW VECTORS AND EVERY ALIGNMENT
+//
+//==================================================
+// HEADER INCLUDES
+
+#include <cstdio>
+#include <cstring>
+#include <cctype>
+#include <vector>
+#include "../header.h"
+#include "../spectrum.h"
+
+using namespace std;
+
+//==================================================
+
+#define TEST_MAX_LENGTH		80
+#define TEST_RANDOM_RUNS	200000
+
+enum { FILL_BLANK, FILL_MIXED, FILL_TEXT, FILL_COUNT };
+
+static const char* const g_fill_names[FILL_COUNT] = { "blank", "mixed", "text" };
+
+// THE WHITE SPACE, THE NULL CHARACTER AND THE BYTES AROUND THEM
+
+static const unsigned char g_blanks[] = { ' ', '\t', '\n', '\v', '\f', '\r' };
+static const unsigned char g_others[] = { 0, 'A', 'z', 0x08, 0x0E, 0x1F, 0x21, 0x7F, 0x80, 0x85, 0xA0, 0xFF };
+
+static unsigned int next_random(unsigned int& state)
+{
+    state = state * 1103515245 + 12345;
+    return (state >> 16) | (state << 16);
+}
+
+//==================================================
+// FUNCTION FILLING len CHARACTERS AT field. THE BLANK FILL IS ONLY WHITE
+// SPACE, THE MIXED FILL ANY OF THE TEST BYTES AND THE TEXT FILL A RUN OF
+// OTHER BYTES FOLLOWED BY A RUN OF WHITE SPACE
+
+static void fill_field(int fill, char* field, int len, unsigned int& state)
+{
+    int text = fill == FILL_TEXT && len ? (int)(next_random(state) % (len + 1)) : 0;
+    for(int i = 0; i < len; i++)
+    {
+        bool blank = fill == FILL_BLANK || (fill == FILL_TEXT && i >= text) || (fill == FILL_MIXED && next_random(state) % 2);
+        if(blank)
+            field[i] = (char)g_blanks[next_random(state) % sizeof(g_blanks)];
+        else field[i] = (char)g_others[next_random(state) % sizeof(g_others)];
+    }
+}
+
+//==================================================
+// extract_string AS IT WAS BEFORE THE TRIM KERNELS
+
+static void extract_string_reference(const char* src, char* dest, unsigned char capacity)
+{
+    unsigned char len = (unsigned char)*src;
+    len = len < capacity ? len : capacity;
+    strncpy(dest, src + sizeof(unsigned char), len);
+    *(dest + len) = 0;
+    while(len > 0 && (isspace((unsigned char)*(dest + len - 1)) || !*(dest + len - 1)))
+        *(dest + --len) = 0;
+}
+
+//==================================================
+// FUNCTION RUNNING THE TRIM KERNEL OF level AND THE SCALAR KERNEL ON ONE
+// FIELD, RETURNS FALSE AND PRINTS THE CASE WHEN THEY DIFFER
+
+static bool same_trim(int level, int fill, const char* field, int len, unsigned int offset)
+{
+    size_t n[2];
+    int levels[2] = { CPU_SCALAR, level };
+    for(int k = 0; k < 2; k++)
+    {
+        select_header_kernels(levels[k]);
+        n[k] = trim_field(field, len);
+    }
+
+    if(n[0] == n[1])
+        return true;
+
+    fprintf(stderr, "header_kernels: %s trims %s field of length %d at offset %u to %u, scalar to %u\n",
+        cpu_level_name(level), g_fill_names[fill], len, offset, (unsigned int)n[1], (unsigned int)n[0]);
+    return false;
+}
+
+//==================================================
+// FUNCTION COMPARING extract_string AT level WITH THE REFERENCE ON ONE
+// PASCAL STRING. THE DESTINATIONS START OUT EQUAL AND MUST END EQUAL
+
+static bool same_extract(int level, const char* src, unsigned char capacity)
+{
+    char dest[2][256 + 16];
+    memset(dest, 0x55, sizeof(dest));
+    select_header_kernels(level);
+    extract_string(src, dest[0], capacity);
+    extract_string_reference(src, dest[1], capacity);
+
+    if(!memcmp(dest[0], dest[1], sizeof(dest[0])))
+        return true;
+
+    fprintf(stderr, "header_kernels: %s extract_string differs from the reference for length byte %u, capacity %u\n",
+        cpu_level_name(level), (unsigned char)*src, capacity);
+    return false;
+}
+
+int main()
+{
+    vector<char> buffer(256 + 64);
+    int supported = detect_cpu_level();
+    unsigned int state = 1, cases = 0, failures = 0;
+
+    for(int level = CPU_SCALAR; level < CPU_LEVEL_COUNT; level++)
+    {
+        if(level > supported || select_header_kernels(level) != level)
+        {
+            printf("header_kernels: %s not available, skipped\n", cpu_level_name(level));
+            continue;
+        }
+
+        // EVERY LENGTH AT EVERY ALIGNMENT, WITH A NULL CHARACTER OR WHITE
+        // SPACE IN THE PADDING SO THE KERNELS MUST STOP AT THE LENGTH
+
+        for(int fill = 0; level != CPU_SCALAR && fill < FILL_COUNT; fill++)
+        {
+            for(int len = 0; len <= TEST_MAX_LENGTH; len++)
+            {
+                for(unsigned int offset = 0; offset < 16; offset++)
+                {
+                    for(int round = 0; round < 8; round++)
+                    {
+                        fill_field(fill, &buffer[offset], len, state);
+                        fill_field(FILL_MIXED, &buffer[offset + len], 16, state);
+                        failures += !same_trim(level, fill, &buffer[offset], len, offset);
+                        ++cases;
+                    }
+                }
+            }
+        }
+
+        // PASCAL STRINGS WITH ANY LENGTH BYTE AND CAPACITY
+
+        for(int run = 0; run < TEST_RANDOM_RUNS; run++)
+        {
+            unsigned char capacity = (unsigned char)(next_random(state) % 2 ? next_random(state) % 44 : next_random(state) % 256);
+            int fill = (int)(next_random(state) % FILL_COUNT);
+            buffer[0] = (char)(next_random(state) % 2 ? capacity : next_random(state) % 256);
+            fill_field(fill, &buffer[1], 255, state);
+            failures += !same_extract(level, &buffer[0], capacity);
+            ++cases;
+        }
+    }
+
+    select_header_kernels(supported);
+    if(failures)
+        return 1;
+    printf("header_kernels: %u cases passed up to %s\n", cases, cpu_level_name(supported));
+    return 0;
+}
+
+//==================================================
@@ -0,0 +1,163 @@
+//==================================================
+// Copyright (C) 2011 by Norwegian Radiation Protection Authority
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// Authors: Dag Robøle,
+//
+//==================================================
+//
+// TEST THAT parse_timestamp AGREES WITH A PLAIN CIVIL CALENDAR THAT COUNTS
+// THE DAYS OF EACH YEAR AND MONTH SINCE 1970. EVERY MONTH AND DAY AROUND THE
+// BOUNDS OF EVERY YEAR IS TRIED, AS ARE TIMES PAST THEIR LIMITS, RANDOM
+// DIGITS AND EVERY BYTE VALUE IN PLACE OF EACH DIGIT
+//
+//==================================================
+// HEADER INCLUDES
+
+#include <cstdio>
+#include <cstring>
+#include "../numbers.h"
+
+//==================================================
+
+#define TEST_RANDOM_TEXTS	1000000
+
+static unsigned int next_random(unsigned int& state)
+{
+    state = state * 1103515245 + 12345;
+    return (state >> 16) | (state << 16);
+}
+
+//==================================================
+// FUNCTION GIVING THE EXPECTED RESULT FOR ONE YYMMDDhhmmss TEXT
+
+static bool is_leap(int year)
+{
+    return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+}
+
+static bool reference_timestamp(const char* text, __int64& seconds)
+{
+    int value[6];
+    for(int i = 0; i < 6; i++)
+    {
+        if(text[2 * i] < '0' || text[2 * i] > '9' || text[2 * i + 1] < '0' || text[2 * i + 1] > '9')
+            return false;
+        value[i] = (text[2 * i] - '0') * 10 + text[2 * i + 1] - '0';
+    }
+
+    int year = value[0] < 70 ? 2000 + value[0] : 1900 + value[0];
+    int month = value[1], day = value[2];
+    static const int month_days[12] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+    if(month < 1 || month > 12 || value[3] > 23 || value[4] > 59 || value[5] > 59)
+        return false;
+    if(day < 1 || day > month_days[month - 1] + (month == 2 && is_leap(year)))
+        return false;
+
+    __int64 days = 0;
+    for(int y = 1970; y < year; y++)
+        days += is_leap(y) ? 366 : 365;
+    for(int m = 1; m < month; m++)
+        days += month_days[m - 1] + (m == 2 && is_leap(year));
+    days += day - 1;
+
+    seconds = days * 86400 + value[3] * 3600 + value[4] * 60 + value[5];
+    return true;
+}
+
+//==================================================
+// FUNCTION COMPARING parse_timestamp WITH THE REFERENCE FOR ONE TEXT,
+// RETURNS FALSE AND PRINTS THE TEXT WHEN THEY DIFFER
+
+static bool same_result(const char* text)
+{
+    __int64 expected = -1, seconds = -1;
+    bool expected_valid = reference_timestamp(text, expected);
+    bool valid = parse_timestamp(text, seconds);
+    if(valid == expected_valid && (!valid || seconds == expected))
+        return true;
+
+    char shown[13];
+    for(int i = 0; i < 12; i++)
+        shown[i] = text[i] >= ' ' && text[i] < 127 ? text[i] : '?';
+    shown[12] = 0;
+    fprintf(stderr, "parse_timestamp: '%s' gives %s %lld, expected %s %lld\n", shown,
+        valid ? "valid" : "invalid", (long long)seconds, expected_valid ? "valid" : "invalid", (long long)expected);
+    return false;
+}
+
+int main()
+{
+    unsigned int state = 1, cases = 0, failures = 0;
+    char text[13];
+
+    // EVERY YEAR WITH MONTHS 0 TO 13 AND DAYS 0 TO 32, AT THE START AND END
+    // OF THE DAY AND ONE SECOND, MINUTE AND HOUR PAST THE END
+
+    static const char* const times[] = { "000000", "235959", "235960", "236059", "240000", "995999" };
+    for(int year = 0; year < 100; year++)
+    {
+        for(int month = 0; month <= 13; month++)
+        {
+            for(int day = 0; day <= 32; day++)
+            {
+                for(size_t t = 0; t < sizeof(times) / sizeof(times[0]); t++, cases++)
+                {
+                    sprintf(text, "%02d%02d%02d%s", year, month, day, times[t]);
+                    failures += !same_result(text);
+                }
+            }
+        }
+    }
+
+    // RANDOM DIGITS, MOSTLY INVALID, AND RANDOM VALID TIMES
+
+    for(int i = 0; i < TEST_RANDOM_TEXTS; i++, cases++)
+    {
+        for(int c = 0; c < 12; c++)
+            text[c] = (char)('0' + next_random(state) % 10);
+        if(i % 2)
+        {
+            sprintf(text, "%02u%02u%02u%02u%02u%02u", next_random(state) % 100, next_random(state) % 12 + 1, next_random(state) % 28 + 1,
+                next_random(state) % 24, next_random(state) % 60, next_random(state) % 60);
+        }
+        failures += !same_result(text);
+    }
+
+    // EVERY BYTE VALUE IN PLACE OF EACH DIGIT OF A VALID TIME, WHICH CATCHES
+    // BYTES THAT ONLY LOOK LIKE DIGITS IN ONE NIBBLE SUCH AS ':' AND 0xB5
+
+    for(int c = 0; c < 12; c++)
+    {
+        for(int byte = 0; byte < 256; byte++, cases++)
+        {
+            strcpy(text, "960229235959");
+            text[c] = (char)byte;
+            failures += !same_result(text);
+        }
+    }
+
+    if(failures)
+        return 1;
+    printf("parse_timestamp: %u texts passed\n", cases);
+    return 0;
+}
+
+//==================================================
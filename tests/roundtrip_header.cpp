@@ -0,0 +1,133 @@
+//==================================================
+// Copyright (C) 2011 by Norwegian Radiation Protection Authority
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// Authors: Dag Robøle,
+//
+//==================================================
+//
+// TEST THAT EVERY FIELD OF IO_HEADER_FIELDS SURVIVES decode_header,
+// encode_header AND decode_header AGAIN. EACH FIELD IN TURN IS GIVEN A NEW
+// VALUE, AND AFTER THE ROUND TRIP THAT FIELD MUST HOLD IT AND ALL OTHERS
+// MUST BE UNCHANGED. dead_time IS NOT STORED AND IS DERIVED AGAIN
+//
+//==================================================
+// HEADER INCLUDES
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "../header.h"
+#include "header_fields.h"
+
+//==================================================
+// FUNCTION GIVING A FIELD A VALUE THAT DIFFERS FROM ITS CURRENT ONE. STRINGS
+// GET TWO CHARACTERS LESS THAN THEIR ARRAY, WHICH FITS EVERY DAT FIELD
+
+static void change_field(const TestField& field, unsigned int index, IO_Header& io)
+{
+    char* dest = (char*)&io + field.offset;
+    switch(field.type)
+    {
+        case TEST_STRING:
+        {
+            size_t len = field.size - 2;
+            for(size_t i=0; i<len; i++)
+                dest[i] = (char)('A' + (index + i) % 26);
+            dest[len] = 0;
+            break;
+        }
+        case TEST_CHAR: *dest = (char)(*dest == 'Q' ? 'R' : 'Q'); break;
+        case TEST_SHORT: { short value = (short)(12345 + index); memcpy(dest, &value, sizeof(value)); break; }
+        case TEST_INT: { int value = 0x12345678 + (int)index; memcpy(dest, &value, sizeof(value)); break; }
+        case TEST_FLOAT: { float value = 1234.5f + (float)index; memcpy(dest, &value, sizeof(value)); break; }
+    }
+}
+
+//==================================================
+// FUNCTION BUILDING THE DAT HEADER EVERY FIELD IS CHANGED IN
+
+static void make_header(char* buffer)
+{
+    IO_Header io;
+    memset((void*)&io, 0, sizeof(io));
+    strcpy(io.spectrum_identifier, "S001");
+    strcpy(io.sample_identifier, "GRASS");
+    strcpy(io.sample_location, "OSTERAS");
+    strcpy(io.measurement_start, "010111120000");
+    strcpy(io.format, "I");
+    io.real_time = 3600;
+    io.live_time = 3550;
+    io.channel_count = 8192;
+    io.latitude = 59.9f;
+
+    memset(buffer, 0, DAT_HEADER_SIZE);
+    encode_header(io, buffer);
+}
+
+int main()
+{
+    char base[DAT_HEADER_SIZE], buffer[DAT_HEADER_SIZE];
+    make_header(base);
+
+    IO_Header original;
+    if(!decode_header(base, sizeof(base), original))
+    {
+        fprintf(stderr, "roundtrip_header: the base header does not decode\n");
+        return 1;
+    }
+
+    unsigned int failures = 0;
+    for(unsigned int i=0; i<g_test_field_count; i++)
+    {
+        const TestField& field = g_test_fields[i];
+
+        IO_Header expected = original, decoded;
+        change_field(field, i, expected);
+
+        memcpy(buffer, base, sizeof(base));
+        bool fits = encode_header(expected, buffer);
+        derive_dead_time(expected);
+
+        memset((void*)&decoded, 0, sizeof(decoded));
+        decode_header(buffer, sizeof(buffer), decoded);
+
+        const TestField* differs = first_difference(expected, decoded);
+        if(!fits || differs)
+        {
+            if(!fits)
+                fprintf(stderr, "roundtrip_header: changing %s cut off a string\n", field.name);
+            else fprintf(stderr, "roundtrip_header: after changing %s the field %s differs\n", field.name, differs->name);
+            ++failures;
+        }
+        else if(strcmp(field.name, "dead_time") && !first_difference(original, decoded))
+        {
+            fprintf(stderr, "roundtrip_header: changing %s did not reach the DAT header\n", field.name);
+            ++failures;
+        }
+    }
+
+    if(failures)
+        return 1;
+    printf("roundtrip_header: %u fields passed\n", g_test_field_count);
+    return 0;
+}
+
+//==================================================
@@ -0,0 +1,197 @@
+//==================================================
+// Copyright (C) 2011 by Norwegian Radiation Protection Authority
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// Authors: Dag Robøle,
+//
+//==================================================
+//
+// TEST OF THE CONVERSION SERVER WITH SEVERAL CLIENTS PIPELINING REQUESTS.
+// EACH CLIENT SENDS ALL ITS REQUESTS BEFORE IT READS A REPLY, FIRST LARGE
+// SERVE_DATA REQUESTS WITH LARGER REPLIES, THEN MORE SMALL REQUESTS THAN
+// SERVE_MAX_PENDING. EVERY REPLY MUST COME BACK IN ORDER AND MATCH, A
+// SERVER THAT STOPS READING WHILE IT WRITES HANGS AND TIMES OUT INSTEAD.
+// THE SERVER RUNS ON A NAMED PIPE, SO THIS TEST NEEDS WINDOWS
+//
+//==================================================
+// HEADER INCLUDES
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <process.h>
+#include "../server.h"
+
+//==================================================
+
+#define TEST_PIPE		"\\\\.\\pipe\\dat2inp_serve_test"
+#define TEST_CLIENTS	8
+#define TEST_THREADS	4
+#define TEST_TIMEOUT	120000
+
+struct TestRound
+{
+    unsigned int requests;
+    unsigned int max_size;
+};
+
+static const TestRound g_rounds[] = { { 40, 256 * 1024 }, { 3 * SERVE_MAX_PENDING, 2 * 1024 } };
+
+static volatile LONG g_failures = 0;
+
+//==================================================
+// THE REPLY FOR size BYTES OF data IS EVERY BYTE TWICE WITH ITS BITS FLIPPED,
+// SO A REPLY IS TWICE AS LARGE AS ITS REQUEST AND DEPENDS ON EVERY BYTE
+
+static void make_reply(const char* data, unsigned int size, RecordBuffer& out)
+{
+    for(unsigned int i = 0; i < size; i++)
+    {
+        out.append((char)~data[i]);
+        out.append((char)~data[i]);
+    }
+}
+
+static int test_converter(const char*, const char* data, unsigned int size, int, RecordBuffer& out, void*)
+{
+    make_reply(data, size, out);
+    return SERVE_OK;
+}
+
+//==================================================
+// REQUEST CONTENTS DERIVED FROM THE CLIENT AND THE REQUEST ID, SO THE CLIENT
+// CAN CHECK A REPLY WITHOUT KEEPING ITS REQUESTS
+
+static unsigned int next_random(unsigned int& state)
+{
+    state = state * 1103515245 + 12345;
+    return state >> 8;
+}
+
+static void make_request(unsigned int client, unsigned int id, unsigned int max_size, std::vector<char>& data)
+{
+    unsigned int state = client * 7919 + id * 104729 + 1;
+    data.resize(next_random(state) % (max_size + 1));
+    for(size_t i = 0; i < data.size(); i++)
+        data[i] = (char)next_random(state);
+}
+
+//==================================================
+
+static unsigned __stdcall server_main(void*)
+{
+    ConversionServer server;
+    if(!server.run(TEST_PIPE, TEST_THREADS, test_converter, 0))
+        fprintf(stderr, "serve_test: the server did not start\n");
+    return 0;
+}
+
+static unsigned __stdcall client_main(void* arg)
+{
+    unsigned int client = (unsigned int)(size_t)arg;
+
+    ServeClient connection;
+    bool connected = false;
+    for(int attempt = 0; attempt < 500 && !connected; attempt++)
+    {
+        connected = connection.connect(TEST_PIPE);
+        if(!connected)
+            Sleep(10);
+    }
+    if(!connected)
+    {
+        fprintf(stderr, "serve_test: client %u could not connect\n", client);
+        InterlockedIncrement(&g_failures);
+        return 0;
+    }
+
+    std::vector<char> data;
+    RecordBuffer payload, expected;
+    ServeResponse response;
+    unsigned int id = 0;
+
+    for(size_t r = 0; r < sizeof(g_rounds) / sizeof(g_rounds[0]); r++)
+    {
+        const TestRound& round = g_rounds[r];
+        unsigned int first = id;
+        for(unsigned int n = 0; n < round.requests; n++, id++)
+        {
+            make_request(client, id, round.max_size, data);
+            if(!connection.send(id, SERVE_DATA, SERVE_INP, data.empty() ? "" : &data[0], (unsigned int)data.size()))
+            {
+                fprintf(stderr, "serve_test: client %u failed sending request %u\n", client, id);
+                InterlockedIncrement(&g_failures);
+                return 0;
+            }
+        }
+
+        for(unsigned int n = first; n < id; n++)
+        {
+            if(!connection.receive(response, payload))
+            {
+                fprintf(stderr, "serve_test: client %u lost the connection at reply %u\n", client, n);
+                InterlockedIncrement(&g_failures);
+                return 0;
+            }
+
+            make_request(client, n, round.max_size, data);
+            expected.clear();
+            make_reply(data.empty() ? "" : &data[0], (unsigned int)data.size(), expected);
+            if(response.id != n || response.status != SERVE_OK || response.length != expected.size()
+                || memcmp(payload.data(), expected.data(), expected.size()))
+            {
+                fprintf(stderr, "serve_test: client %u got a wrong reply for request %u\n", client, n);
+                InterlockedIncrement(&g_failures);
+            }
+        }
+    }
+    return 0;
+}
+
+int main()
+{
+    HANDLE server = (HANDLE)_beginthreadex(NULL, 0, server_main, 0, 0, NULL);
+    if(!server)
+        return 1;
+
+    HANDLE clients[TEST_CLIENTS];
+    for(unsigned int c = 0; c < TEST_CLIENTS; c++)
+        clients[c] = (HANDLE)_beginthreadex(NULL, 0, client_main, (void*)(size_t)c, 0, NULL);
+
+    // THE SERVER RUNS UNTIL THE PROCESS ENDS, ONLY THE CLIENTS ARE WAITED FOR
+
+    DWORD started = GetTickCount();
+    for(unsigned int c = 0; c < TEST_CLIENTS; c++)
+    {
+        DWORD waited = GetTickCount() - started;
+        if(!clients[c] || WaitForSingleObject(clients[c], waited < TEST_TIMEOUT ? TEST_TIMEOUT - waited : 0) != WAIT_OBJECT_0)
+        {
+            fprintf(stderr, "serve_test: client %u did not finish, the server is stuck\n", c);
+            return 1;
+        }
+    }
+
+    if(g_failures)
+        return 1;
+    printf("serve_test: %d clients got every reply\n", TEST_CLIENTS);
+    return 0;
+}
+
+//==================================================
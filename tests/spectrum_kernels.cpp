@@ -0,0 +1,167 @@
+//==================================================
+// Copyright (C) 2011 by Norwegian Radiation Protection Authority
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// Authors: Dag Robøle,
+//
+//==================================================
+//
+// TEST THAT EVERY SPECTRUM KERNEL LEVEL THE PROCESSOR SUPPORTS GIVES EXACTLY
+// THE RESULTS OF THE SCALAR KERNELS. THE SPECTRA ARE ALL ZERO, NEAR THE 32
+// BIT LIMITS OR RANDOM, WITH LENGTHS THAT ARE NOT A MULTIPLE OF THE VECTOR
+// WIDTH AND CHANNELS AT EVERY ALIGNMENT. THE STRING KERNELS OF THE HEADER
+// ARE TESTED IN header_kernels.cpp
+//
+//==================================================
+// HEADER INCLUDES
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "../spectrum.h"
+
+using namespace std;
+
+//==================================================
+
+#define TEST_MAX_CHANNELS	16384
+#define TEST_RANDOM_RUNS	2000
+
+enum { FILL_ZERO, FILL_HIGH, FILL_LIMITS, FILL_RANDOM, FILL_COUNT };
+
+static const char* const g_fill_names[FILL_COUNT] = { "zero", "high", "limits", "random" };
+
+static unsigned int next_random(unsigned int& state)
+{
+    state = state * 1103515245 + 12345;
+    return (state >> 16) | (state << 16);
+}
+
+//==================================================
+// FUNCTION FILLING count CHANNELS AT channels. THE HIGH FILL IS NEAR
+// UINT_MAX, WHICH IS ALSO NEGATIVE AS A SIGNED COUNT, THE LIMITS FILL MIXES
+// THE VALUES AROUND 0, INT_MAX AND UINT_MAX
+
+static void fill_channels(int fill, char* channels, int count, unsigned int& state)
+{
+    static const unsigned int limits[] = { 0, 1, 0x7FFFFFFE, 0x7FFFFFFF, 0x80000000, 0x80000001, 0xFFFFFFFE, 0xFFFFFFFF };
+
+    for(int i = 0; i < count; i++)
+    {
+        unsigned int value = 0;
+        switch(fill)
+        {
+            case FILL_HIGH: value = 0xFFFFFFFF - next_random(state) % 4; break;
+            case FILL_LIMITS: value = limits[next_random(state) % (sizeof(limits) / sizeof(limits[0]))]; break;
+            case FILL_RANDOM: value = next_random(state); break;
+        }
+        memcpy(channels + i * sizeof(int), &value, sizeof(int));
+    }
+}
+
+//==================================================
+// FUNCTION RUNNING THE KERNELS OF level AND THE SCALAR KERNELS ON ONE
+// SPECTRUM, RETURNS FALSE AND PRINTS THE CASE WHEN THEY DIFFER
+
+static bool same_results(int level, int fill, const char* channels, int count, unsigned int offset, unsigned int& state)
+{
+    vector<unsigned __int64> start(count + 1), sums[2];
+    for(int i = 0; i < count; i++)
+        start[i] = (unsigned __int64)next_random(state) << 32 | next_random(state);
+
+    unsigned __int64 total[2];
+    int peak[2];
+    int levels[2] = { CPU_SCALAR, level };
+    for(int k = 0; k < 2; k++)
+    {
+        select_spectrum_kernels(levels[k]);
+        total[k] = sum_counts(channels, count);
+        peak[k] = count ? max_counts(channels, count) : 0;
+        sums[k] = start;
+        accumulate_counts(channels, count, &sums[k][0]);
+        accumulate_counts(channels, count, &sums[k][0]);
+    }
+
+    if(total[0] == total[1] && peak[0] == peak[1] && sums[0] == sums[1])
+        return true;
+
+    fprintf(stderr, "spectrum_kernels: %s differs from scalar for %s channels, count %d, offset %u:%s%s%s\n",
+        cpu_level_name(level), g_fill_names[fill], count, offset,
+        total[0] != total[1] ? " sum_counts" : "", peak[0] != peak[1] ? " max_counts" : "", sums[0] != sums[1] ? " accumulate_counts" : "");
+    return false;
+}
+
+int main()
+{
+    vector<char> buffer(TEST_MAX_CHANNELS * sizeof(int) + 16);
+    int supported = detect_cpu_level();
+    unsigned int state = 1, cases = 0, failures = 0;
+
+    for(int level = CPU_SCALAR + 1; level < CPU_LEVEL_COUNT; level++)
+    {
+        if(level > supported || select_spectrum_kernels(level) != level)
+        {
+            printf("spectrum_kernels: %s not available, skipped\n", cpu_level_name(level));
+            continue;
+        }
+
+        for(int fill = 0; fill < FILL_COUNT; fill++)
+        {
+            // EVERY SHORT LENGTH AT EVERY ALIGNMENT, THEN LONG SPECTRA
+
+            for(int count = 0; count <= 67; count++)
+            {
+                for(unsigned int offset = 0; offset < 16; offset++)
+                {
+                    fill_channels(fill, &buffer[offset], count, state);
+                    failures += !same_results(level, fill, &buffer[offset], count, offset, state);
+                    ++cases;
+                }
+            }
+
+            static const int counts[] = { 1023, 1024, 1025, 4095, 8191, 8192, TEST_MAX_CHANNELS - 1, TEST_MAX_CHANNELS };
+            for(size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++)
+            {
+                unsigned int offset = (unsigned int)c % 4;
+                fill_channels(fill, &buffer[offset], counts[c], state);
+                failures += !same_results(level, fill, &buffer[offset], counts[c], offset, state);
+                ++cases;
+            }
+        }
+
+        for(int run = 0; run < TEST_RANDOM_RUNS; run++)
+        {
+            int fill = (int)(next_random(state) % FILL_COUNT);
+            int count = (int)(next_random(state) % (TEST_MAX_CHANNELS + 1));
+            unsigned int offset = next_random(state) % 16;
+            fill_channels(fill, &buffer[offset], count, state);
+            failures += !same_results(level, fill, &buffer[offset], count, offset, state);
+            ++cases;
+        }
+    }
+
+    select_spectrum_kernels(supported);
+    if(failures)
+        return 1;
+    printf("spectrum_kernels: %u cases passed up to %s\n", cases, cpu_level_name(supported));
+    return 0;
+}
+
+//==================================================
@@ -0,0 +1,289 @@
+//==================================================
+// Copyright (C) 2011 by Norwegian Radiation Protection Authority
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// Authors: Dag Robøle,
+//
+//==================================================
+// HEADER INCLUDES
+
+#include <cstring>
+#include <new>
+#include <process.h>
+#include "pipeline.h"
+#include "writer.h"
+
+//==================================================
+// RING BUFFER SETUP
+
+bool WriteRing::init(unsigned int capacity)
+{
+    m_slots = new (std::nothrow) WriteSlot[capacity];
+    if(!m_slots)
+        return false;
+    m_capacity = capacity;
+    m_head = m_done = m_tail = 0;
+    return true;
+}
+
+void WriteRing::destroy()
+{
+    delete [] m_slots;
+    m_slots = 0;
+    m_capacity = 0;
+}
+
+//==================================================
+// PIPELINE
+
+#define WRITE_SLOTS_PER_WRITER	64
+
+WritePipeline::WritePipeline()
+    : m_formatter(0), m_limiter(0), m_writers(0), m_writer_count(0), m_started(0), m_current(0), m_collect(0),
+      m_acquired(0), m_pending(0), m_stop(0)
+{
+}
+
+bool WritePipeline::start(unsigned int writers, WriteFormatter formatter)
+{
+    m_formatter = formatter;
+    m_writer_count = writers ? writers : 1;
+
+    m_writers = new (std::nothrow) Writer[m_writer_count];
+    if(!m_writers)
+        return false;
+
+    for(unsigned int w = 0; w < m_writer_count; w++)
+    {
+        m_writers[w].pipeline = this;
+        m_writers[w].thread = 0;
+        if(!m_writers[w].ring.init(WRITE_SLOTS_PER_WRITER))
+            return false;
+    }
+
+    // A WRITER THAT DID NOT START WOULD LEAVE ITS SLOTS UNWRITTEN, SO ONLY THE
+    // RINGS OF THE STARTED WRITERS ARE USED. WITH NONE THE FIRST RING IS
+    // WRITTEN BY submit ON THE CONVERTING THREAD
+
+    for(unsigned int w = 0; w < writers; w++)
+    {
+        m_writers[m_started].thread = (HANDLE)_beginthreadex(NULL, 0, writer_main, &m_writers[m_started], 0, NULL);
+        if(m_writers[m_started].thread)
+            ++m_started;
+    }
+    m_writer_count = m_started ? m_started : 1;
+    return true;
+}
+
+unsigned __stdcall WritePipeline::writer_main(void* arg)
+{
+    Writer* writer = (Writer*)arg;
+    writer->pipeline->write_files(*writer);
+    return 0;
+}
+
+//==================================================
+// THE SLOTS ALREADY HANDED TO A WRITER ARE WRITTEN BEFORE IT STOPS
+
+void WritePipeline::write_files(Writer& writer)
+{
+    unsigned int spins = 0;
+    for(;;)
+    {
+        WriteSlot* slot = writer.ring.acquire_work();
+        if(slot)
+        {
+            write_slot(*slot, writer.inp, writer.sta);
+            writer.ring.commit_work();
+            spins = 0;
+        }
+        else if(m_stop)
+            return;
+        else backoff(spins);
+    }
+}
+
+//==================================================
+// FUNCTION WRITING THE FILES OF ONE SLOT. A FAILED WRITE REMOVES THE PARTIAL
+// FILE, THE STA FILE IS ONLY WRITTEN WHEN THE INP FILE WAS
+
+void WritePipeline::write_slot(WriteSlot& slot, RecordBuffer& inp, RecordBuffer& sta)
+{
+    char fname[MAX_PATH + 1], tname[MAX_PATH + 1];
+
+    slot.out_size = 0;
+    inp.clear();
+    sta.clear();
+    m_formatter(slot, inp, sta);
+
+    memcpy(fname, slot.path, slot.length);
+    memcpy(fname + slot.length, ".INP", 5);
+
+    const char* oname = fname;
+    if(slot.use_temp)
+    {
+        memcpy(tname, slot.path, slot.length);
+        memcpy(tname + slot.length, ".IN~", 5);
+        oname = tname;
+    }
+
+    slot.status = write_file(oname, inp);
+    if(slot.status != WRITE_OK)
+    {
+        strcpy(slot.failed, oname);
+        return;
+    }
+    slot.out_size = (unsigned int)inp.size();
+
+    if(slot.use_temp && !MoveFileEx(tname, fname, MOVEFILE_REPLACE_EXISTING))
+    {
+        DeleteFile(tname);
+        slot.status = WRITE_RENAME_FAILED;
+        strcpy(slot.failed, fname);
+        return;
+    }
+
+    if(slot.has_stats)
+    {
+        memcpy(fname + slot.length, ".STA", 5);
+        slot.status = write_file(fname, sta);
+        if(slot.status != WRITE_OK)
+            strcpy(slot.failed, fname);
+    }
+}
+
+int WritePipeline::write_file(const char* path, const RecordBuffer& record)
+{
+    // THE LIMITER, WHEN GIVEN, IS SHARED WITH THE READERS AND THE OTHER WRITERS
+
+    DWORD size = (DWORD)record.size();
+    __int64 started = m_limiter ? m_limiter->begin(size) : 0;
+    HANDLE hFile = CreateFile(path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(hFile == INVALID_HANDLE_VALUE)
+    {
+        if(m_limiter)
+            m_limiter->end(IO_WRITE, started);
+        return WRITE_OPEN_FAILED;
+    }
+
+    DWORD written = 0;
+    bool ok = !size || (WriteFile(hFile, record.data(), size, &written, NULL) && written == size);
+    ok = CloseHandle(hFile) && ok;
+    if(m_limiter)
+        m_limiter->end(IO_WRITE, started);
+    if(!ok)
+    {
+        DeleteFile(path);
+        return WRITE_FAILED;
+    }
+    return WRITE_OK;
+}
+
+//==================================================
+// FUNCTION RETURNING A FREE SLOT, OR 0 WHEN ALL RINGS ARE FULL. THE SLOTS OF
+// A FULL RING ARE FREED BY TAKING THEM BACK WITH finished
+
+WriteSlot* WritePipeline::acquire()
+{
+    for(unsigned int n = 0; n < m_writer_count; n++)
+    {
+        WriteRing& ring = m_writers[m_current].ring;
+        m_current = (m_current + 1) % m_writer_count;
+
+        WriteSlot* slot = ring.acquire_write();
+        if(slot)
+        {
+            m_acquired = &ring;
+            return slot;
+        }
+    }
+    return 0;
+}
+
+void WritePipeline::submit()
+{
+    if(!m_started)
+    {
+        write_slot(*m_acquired->acquire_write(), m_writers[0].inp, m_writers[0].sta);
+        m_acquired->commit_write();
+        m_acquired->commit_work();
+    }
+    else m_acquired->commit_write();
+    m_acquired = 0;
+}
+
+//==================================================
+// FUNCTION RETURNING THE NEXT WRITTEN SLOT, OR 0 WHEN NO SLOT HAS BEEN WRITTEN
+// SINCE THE LAST CALL. THE SLOT RETURNED BY THE PREVIOUS CALL IS FREED
+
+const WriteSlot* WritePipeline::finished()
+{
+    if(m_pending)
+    {
+        m_pending->commit_read();
+        m_pending = 0;
+    }
+
+    for(unsigned int n = 0; m_writers && n < m_writer_count; n++)
+    {
+        WriteRing& ring = m_writers[m_collect].ring;
+        m_collect = (m_collect + 1) % m_writer_count;
+
+        WriteSlot* slot = ring.acquire_read();
+        if(slot)
+        {
+            m_pending = &ring;
+            return slot;
+        }
+    }
+    return 0;
+}
+
+//==================================================
+// FUNCTION WAITING UNTIL EVERY SUBMITTED SLOT HAS BEEN WRITTEN
+
+void WritePipeline::flush()
+{
+    unsigned int spins = 0;
+    for(unsigned int w = 0; m_writers && w < m_writer_count; w++)
+    {
+        while(!m_writers[w].ring.written())
+            backoff(spins);
+    }
+}
+
+void WritePipeline::stop()
+{
+    if(!m_writers)
+        return;
+
+    InterlockedExchange(&m_stop, 1);
+    for(unsigned int w = 0; w < m_started; w++)
+    {
+        WaitForSingleObject(m_writers[w].thread, INFINITE);
+        CloseHandle(m_writers[w].thread);
+    }
+
+    delete [] m_writers;
+    m_writers = 0;
+    m_acquired = m_pending = 0;
+}
+
+//==================================================
@@ -0,0 +1,172 @@
+//==================================================
+// Copyright (C) 2011 by Norwegian Radiation Protection Authority
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// Authors: Dag Robøle,
+//
+//==================================================
+
+#ifndef WRITER_H
+#define WRITER_H
+
+//==================================================
+
+#include <Windows.h>
+#include "main.h"
+#include "buffers.h"
+#include "limiter.h"
+#include "spectrum.h"
+
+//==================================================
+// THE WRITE STAGE OF THE CONVERSION PIPELINE.
+// THE CONVERTING THREAD HANDS EACH DECODED HEADER TO ONE OF THE WRITER THREADS
+// IN A SLOT OF A BOUNDED RING BUFFER, ONE RING PER WRITER. THE WRITER FORMATS
+// THE INP AND STA FILES AND WRITES THEM, SO THE FILE CREATION, WHICH BLOCKS
+// THE LONGEST ON A NETWORK SHARE, IS NOT ON THE CONVERTING THREAD. THE WRITER
+// HANDS THE RESULT BACK IN THE SLOT AND THE CONVERTING THREAD REPORTS IT.
+// THE SLOTS HOLD THE HEADER AND NOT THE FORMATTED FILES, SO THE MEMORY OF THE
+// STAGE IS FIXED BY THE NUMBER OF SLOTS AND NOT BY THE NUMBER OF FILES
+
+enum { WRITE_OK, WRITE_OPEN_FAILED, WRITE_FAILED, WRITE_RENAME_FAILED };
+
+struct WriteSlot
+{
+    // THE DAT FILE, FOR THE JOURNAL AND THE MESSAGES
+
+    char name[MAX_PATH + 1];
+    unsigned int size;
+    unsigned __int64 hash;
+
+    // THE OUTPUT PATH WITHOUT EXTENSION. WITH use_temp THE INP IS WRITTEN
+    // UNDER A TEMPORARY NAME AND RENAMED WHEN COMPLETE
+
+    char path[MAX_PATH + 1];
+    unsigned int length;
+    bool use_temp;
+    IO_Header io;
+    bool has_stats;
+    SpectrumStats stats;
+
+    // FILLED IN BY THE WRITER, failed IS THE FILE THE WRITE FAILED ON
+
+    int status;
+    unsigned int out_size;
+    char failed[MAX_PATH + 1];
+};
+
+//==================================================
+// FUNCTION FORMATTING THE INP FILE AND, WHEN THE SLOT HAS STATISTICS, THE STA
+// FILE OF A SLOT. CALLED BY SEVERAL WRITER THREADS AT ONCE
+
+typedef void (*WriteFormatter)(const WriteSlot& slot, RecordBuffer& inp, RecordBuffer& sta);
+
+//==================================================
+// SINGLE PRODUCER SINGLE CONSUMER RING OF SLOTS WITH A THIRD INDEX BETWEEN
+// THE TWO. THE CONVERTING THREAD FILLS SLOTS AT THE TAIL, THE WRITER WRITES
+// THEM AT done AND THE CONVERTING THREAD TAKES THE WRITTEN SLOTS BACK AT THE
+// HEAD. EACH INDEX IS ONLY WRITTEN BY ONE THREAD
+
+class WriteRing
+{
+public:
+
+    WriteRing() : m_slots(0), m_capacity(0), m_head(0), m_done(0), m_tail(0) {}
+    ~WriteRing() { destroy(); }
+
+    bool init(unsigned int capacity);
+    void destroy();
+
+    WriteSlot* acquire_write() { return (unsigned int)(m_tail - m_head) < m_capacity ? &m_slots[(unsigned int)m_tail % m_capacity] : 0; }
+    void commit_write() { InterlockedIncrement(&m_tail); }
+    WriteSlot* acquire_work() { return m_done != m_tail ? &m_slots[(unsigned int)m_done % m_capacity] : 0; }
+    void commit_work() { InterlockedIncrement(&m_done); }
+    WriteSlot* acquire_read() { return m_head != m_done ? &m_slots[(unsigned int)m_head % m_capacity] : 0; }
+    void commit_read() { InterlockedIncrement(&m_head); }
+    bool written() const { return m_done == m_tail; }
+
+private:
+
+    WriteRing(const WriteRing&);
+    WriteRing& operator=(const WriteRing&);
+
+    WriteSlot* m_slots;
+    unsigned int m_capacity;
+    volatile LONG m_head;
+    volatile LONG m_done;
+    volatile LONG m_tail;
+};
+
+//==================================================
+// THE SLOTS ARE GIVEN OUT ROUND ROBIN. WITH NO WRITER THREADS, OR WHEN NONE
+// COULD BE STARTED, submit WRITES THE SLOT ON THE CONVERTING THREAD
+
+class WritePipeline
+{
+public:
+
+    WritePipeline();
+    ~WritePipeline() { stop(); }
+
+    void set_limiter(IoLimiter* limiter) { m_limiter = limiter; }
+    bool start(unsigned int writers, WriteFormatter formatter);
+    WriteSlot* acquire();
+    void submit();
+    const WriteSlot* finished();
+    void flush();
+    void stop();
+
+    unsigned int writer_threads() const { return m_started; }
+
+private:
+
+    WritePipeline(const WritePipeline&);
+    WritePipeline& operator=(const WritePipeline&);
+
+    struct Writer
+    {
+        WritePipeline* pipeline;
+        WriteRing ring;
+        HANDLE thread;
+        RecordBuffer inp;
+        RecordBuffer sta;
+    };
+
+    static unsigned __stdcall writer_main(void* arg);
+    void write_files(Writer& writer);
+    void write_slot(WriteSlot& slot, RecordBuffer& inp, RecordBuffer& sta);
+    int write_file(const char* path, const RecordBuffer& record);
+
+    WriteFormatter m_formatter;
+    IoLimiter* m_limiter;
+    Writer* m_writers;
+    unsigned int m_writer_count;
+    unsigned int m_started;
+    unsigned int m_current;
+    unsigned int m_collect;
+    WriteRing* m_acquired;
+    WriteRing* m_pending;
+    volatile LONG m_stop;
+};
+
+//==================================================
+
+#endif // WRITER_H
+
+//==================================================